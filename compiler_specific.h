@@ -81,6 +81,14 @@ extern "C"
 #    error "I don't know the details of this compiler... Plz hack."
 
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// GCC on the build host (test/Makefile only, see test/host/windows.h)
+
+#  elif defined(__GNUC__) && defined(YAMY_TEST_HOST)
+
+#    define stati64_t struct stat
+
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // unknown
 
@@ -15,6 +15,37 @@
 #include <process.h>
 
 
+/// focus information of Windows
+class Win32FocusProvider : public FocusProvider
+{
+public:
+	///
+	HWND getForegroundWindow(DWORD *o_threadId) {
+		HWND hwnd = GetForegroundWindow();
+		*o_threadId = GetWindowThreadProcessId(hwnd, NULL);
+		return hwnd;
+	}
+	///
+	bool getClassName(HWND i_hwnd, tstringi *o_className) {
+		_TCHAR className[GANA_MAX_ATOM_LENGTH];
+		if (!GetClassName(i_hwnd, className, NUMBER_OF(className)))
+			return false;
+		*o_className = className;
+		return true;
+	}
+	///
+	bool getTitleName(HWND i_hwnd, tstringi *o_titleName) {
+		_TCHAR titleName[1024];
+		if (GetWindowText(i_hwnd, titleName, NUMBER_OF(titleName)) == 0)
+			titleName[0] = _T('\0');
+		*o_titleName = titleName;
+		return true;
+	}
+};
+
+static Win32FocusProvider s_win32FocusProvider;
+
+
 // check focus window
 void Engine::checkFocusWindow()
 {
@@ -23,8 +54,8 @@ void Engine::checkFocusWindow()
 restart:
 	count ++;
 
-	HWND hwndFore = GetForegroundWindow();
-	DWORD threadId = GetWindowThreadProcessId(hwndFore, NULL);
+	DWORD threadId;
+	HWND hwndFore = m_focusProvider->getForegroundWindow(&threadId);
 
 	if (hwndFore) {
 		{
@@ -43,14 +74,16 @@ restart:
 					FocusOfThreads::iterator j = m_focusOfThreads.find((*i));
 					if (j != m_focusOfThreads.end()) {
 						FocusOfThread *fot = &((*j).second);
-						Acquire a(&m_log, 1);
-						m_log << _T("RemoveThread") << std::endl;
-						m_log << _T("\tHWND:\t") << std::hex << (int)fot->m_hwndFocus
-						<< std::dec << std::endl;
-						m_log << _T("\tTHREADID:") << fot->m_threadId << std::endl;
-						m_log << _T("\tCLASS:\t") << fot->m_className << std::endl;
-						m_log << _T("\tTITLE:\t") << fot->m_titleName << std::endl;
-						m_log << std::endl;
+						if (m_log.isLogged(1)) {
+							Acquire a(&m_log, 1);
+							m_log << _T("RemoveThread") << std::endl;
+							m_log << _T("\tHWND:\t") << std::hex << (int)fot->m_hwndFocus
+							<< std::dec << std::endl;
+							m_log << _T("\tTHREADID:") << fot->m_threadId << std::endl;
+							m_log << _T("\tCLASS:\t") << fot->m_className << std::endl;
+							m_log << _T("\tTITLE:\t") << fot->m_titleName << std::endl;
+							m_log << std::endl;
+						}
 						m_focusOfThreads.erase(j);
 					}
 				}
@@ -68,7 +101,11 @@ restart:
 						setCurrentKeymap(*m_currentFocusOfThread->m_keymaps.begin());
 					m_hwndFocus = m_currentFocusOfThread->m_hwndFocus;
 					checkShow(m_hwndFocus);
+					m_trace.record(EventTrace::Type_focusChange,
+								   reinterpret_cast<u_int64>(m_hwndFocus));
 
+					if (!m_log.isLogged(1))
+						return;
 					Acquire a(&m_log, 1);
 					m_log << _T("FocusChanged") << std::endl;
 					m_log << _T("\tHWND:\t")
@@ -86,19 +123,20 @@ restart:
 			}
 		}
 
-		_TCHAR className[GANA_MAX_ATOM_LENGTH];
-		if (GetClassName(hwndFore, className, NUMBER_OF(className))) {
-			if (_tcsicmp(className, _T("ConsoleWindowClass")) == 0) {
-				_TCHAR titleName[1024];
-				if (GetWindowText(hwndFore, titleName, NUMBER_OF(titleName)) == 0)
-					titleName[0] = _T('\0');
+		tstringi className;
+		if (m_focusProvider->getClassName(hwndFore, &className)) {
+			if (className == _T("ConsoleWindowClass")) {
+				tstringi titleName;
+				m_focusProvider->getTitleName(hwndFore, &titleName);
 				setFocus(hwndFore, threadId, className, titleName, true);
-				Acquire a(&m_log, 1);
-				m_log << _T("HWND:\t") << std::hex << reinterpret_cast<int>(hwndFore)
-				<< std::dec << std::endl;
-				m_log << _T("THREADID:") << threadId << std::endl;
-				m_log << _T("CLASS:\t") << className << std::endl;
-				m_log << _T("TITLE:\t") << titleName << std::endl << std::endl;
+				if (m_log.isLogged(1)) {
+					Acquire a(&m_log, 1);
+					m_log << _T("HWND:\t") << std::hex << reinterpret_cast<int>(hwndFore)
+					<< std::dec << std::endl;
+					m_log << _T("THREADID:") << threadId << std::endl;
+					m_log << _T("CLASS:\t") << className << std::endl;
+					m_log << _T("TITLE:\t") << titleName << std::endl << std::endl;
+				}
 				goto restart;
 			}
 		}
@@ -106,14 +144,18 @@ restart:
 
 	Acquire a(&m_cs);
 	if (m_globalFocus.m_keymaps.empty()) {
-		Acquire a(&m_log, 1);
-		m_log << _T("NO GLOBAL FOCUS") << std::endl;
+		if (m_log.isLogged(1)) {
+			Acquire a(&m_log, 1);
+			m_log << _T("NO GLOBAL FOCUS") << std::endl;
+		}
 		m_currentFocusOfThread = NULL;
 		setCurrentKeymap(NULL);
 	} else {
 		if (m_currentFocusOfThread != &m_globalFocus) {
-			Acquire a(&m_log, 1);
-			m_log << _T("GLOBAL FOCUS") << std::endl;
+			if (m_log.isLogged(1)) {
+				Acquire a(&m_log, 1);
+				m_log << _T("GLOBAL FOCUS") << std::endl;
+			}
 			m_currentFocusOfThread = &m_globalFocus;
 			setCurrentKeymap(m_globalFocus.m_keymaps.front());
 		}
@@ -126,39 +168,82 @@ restart:
 // is modifier pressed ?
 bool Engine::isPressed(Modifier::Type i_mt)
 {
-	const Keymap::ModAssignments &ma = m_currentKeymap->getModAssignments(i_mt);
-	for (Keymap::ModAssignments::const_iterator i = ma.begin();
-			i != ma.end(); ++ i)
-		if ((*i).m_key->m_isPressed)
-			return true;
-	return false;
+	return m_currentKeymap->isModifierPressed(i_mt, m_pressedKeys);
+}
+
+
+// the modifiers getCurrentModifiers() takes from the modifier keys
+static const Modifier::MODIFIERS KEY_MODIFIERS =
+	Modifier::getMask(Modifier::Type_Shift) |
+	Modifier::getMask(Modifier::Type_Alt) |
+	Modifier::getMask(Modifier::Type_Control) |
+	Modifier::getMask(Modifier::Type_Windows) |
+	((Modifier::getMask(Modifier::Type_Mod9) << 1) -
+	 Modifier::getMask(Modifier::Type_Mod0));
+
+
+// set m_isPressed of a key
+void Engine::setPressed(Key *i_key, bool i_isPressed)
+{
+	bool wasPressed = i_key->m_isPressed;
+	i_key->m_isPressed = i_isPressed;
+	m_pressedKeys.set(i_key->getId(), i_isPressed);
+
+	if (wasPressed == i_isPressed || !m_pressedModifiersKeymap)
+		return;
+	Modifier::MODIFIERS mask;
+	if (!m_pressedModifiersKeymap->getModifierMask(i_key, &mask)) {
+		m_pressedModifiersKeymap = NULL;	// not compiled
+		return;
+	}
+	mask &= KEY_MODIFIERS;
+	if (i_isPressed) {
+		m_pressedModifiers |= mask;
+		return;
+	}
+	// another key of the modifier may still be pressed
+	for (int i = Modifier::Type_begin; mask; ++ i) {
+		Modifier::Type mt = static_cast<Modifier::Type>(i);
+		if (!(mask & Modifier::getMask(mt)))
+			continue;
+		mask &= ~Modifier::getMask(mt);
+		if (!m_pressedModifiersKeymap->isModifierPressed(mt, m_pressedKeys))
+			m_pressedModifiers &= ~Modifier::getMask(mt);
+	}
+}
+
+
+// get the modifiers of m_currentKeymap whose keys are pressed
+Modifier::MODIFIERS Engine::getPressedModifiers()
+{
+	// the modifier keys differ from keymap to keymap
+	if (m_pressedModifiersKeymap != m_currentKeymap) {
+		m_pressedModifiers = 0;
+		for (int i = Modifier::Type_begin; i != Modifier::Type_end; ++ i) {
+			Modifier::Type mt = static_cast<Modifier::Type>(i);
+			if ((KEY_MODIFIERS & Modifier::getMask(mt)) && isPressed(mt))
+				m_pressedModifiers |= Modifier::getMask(mt);
+		}
+		m_pressedModifiersKeymap = m_currentKeymap;
+	}
+	return m_pressedModifiers;
 }
 
 
 // fix modifier key (if fixed, return true)
 bool Engine::fixModifierKey(ModifiedKey *io_mkey, Keymap::AssignMode *o_am)
 {
-	// for all modifier ...
-	for (int i = Modifier::Type_begin; i != Modifier::Type_end; ++ i) {
-		// get modifier assignments (list of modifier keys)
-		const Keymap::ModAssignments &ma =
-			m_currentKeymap->getModAssignments(static_cast<Modifier::Type>(i));
-
-		for (Keymap::ModAssignments::const_iterator
-				j = ma.begin(); j != ma.end(); ++ j)
-			if (io_mkey->m_key == (*j).m_key) { // is io_mkey a modifier ?
-				{
-					Acquire a(&m_log, 1);
-					m_log << _T("* Modifier Key") << std::endl;
-				}
-				// set dontcare for this modifier
-				io_mkey->m_modifier.dontcare(static_cast<Modifier::Type>(i));
-				*o_am = (*j).m_assignMode;
-				return true;
-			}
+	Modifier::Type mt;
+	if (!m_currentKeymap->searchModifier(io_mkey->m_key, &mt, o_am))
+		return false;
+
+	if (m_log.isLogged(1)) {
+		Acquire a(&m_log, 1);
+		m_log << _T("* Modifier Key") << std::endl;
 	}
-	*o_am = Keymap::AM_notModifier;
-	return false;
+	// set dontcare for this modifier
+	io_mkey->m_modifier.dontcare(mt);
+	return true;
 }
 
 
@@ -166,6 +251,9 @@ bool Engine::fixModifierKey(ModifiedKey *io_mkey, Keymap::AssignMode *o_am)
 void Engine::outputToLog(const Key *i_key, const ModifiedKey &i_mkey,
 						 int i_debugLevel)
 {
+	if (!m_log.isLogged(i_debugLevel))
+		return;
+
 	size_t i;
 	Acquire a(&m_log, i_debugLevel);
 
@@ -228,10 +316,8 @@ Modifier Engine::getCurrentModifiers(Key *i_key, bool i_isPressed)
 	Modifier cmods;
 	cmods.add(m_currentLock);
 
-	cmods.press(Modifier::Type_Shift  , isPressed(Modifier::Type_Shift  ));
-	cmods.press(Modifier::Type_Alt    , isPressed(Modifier::Type_Alt    ));
-	cmods.press(Modifier::Type_Control, isPressed(Modifier::Type_Control));
-	cmods.press(Modifier::Type_Windows, isPressed(Modifier::Type_Windows));
+	// Shift, Alt, Control, Windows and Mod0 .. Mod9
+	cmods.press(KEY_MODIFIERS, getPressedModifiers());
 	cmods.press(Modifier::Type_Up     , !i_isPressed);
 	cmods.press(Modifier::Type_Down   , i_isPressed);
 
@@ -244,10 +330,6 @@ Modifier Engine::getCurrentModifiers(Key *i_key, bool i_isPressed)
 				cmods.press(Modifier::Type_Repeat, true);
 	}
 
-	for (int i = Modifier::Type_Mod0; i <= Modifier::Type_Mod9; ++ i)
-		cmods.press(static_cast<Modifier::Type>(i),
-					isPressed(static_cast<Modifier::Type>(i)));
-
 	return cmods;
 }
 
@@ -289,14 +371,14 @@ void Engine::generateKeyEvent(Key *i_key, bool i_doPress, bool i_isByAssign)
 				kid.Flags = sc[i].m_flags;
 				if (!i_doPress)
 					kid.Flags |= KEYBOARD_INPUT_DATA::BREAK;
-				injectInput(&kid, NULL);
+				output(kid);
 			}
 
 			m_lastGeneratedKey = i_doPress ? i_key : NULL;
 		}
 	}
 
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << _T("\t\t    =>\t");
 		if (isAlreadyReleased)
@@ -317,7 +399,7 @@ void Engine::generateEvents(Current i_c, const Keymap *i_keymap, Key *i_event)
 	i_c.m_mkey.m_key = i_event;
 	if (const Keymap::KeyAssignment *keyAssign =
 				i_c.m_keymap->searchAssignment(i_c.m_mkey)) {
-		{
+		if (m_log.isLogged(1)) {
 			Acquire a(&m_log, 1);
 			m_log << std::endl << _T("           ")
 			<< i_event->getName() << std::endl;
@@ -330,10 +412,11 @@ void Engine::generateEvents(Current i_c, const Keymap *i_keymap, Key *i_event)
 // genete modifier events
 void Engine::generateModifierEvents(const Modifier &i_mod)
 {
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << _T("* Gen Modifiers\t{") << std::endl;
 	}
+	m_isGeneratingModifierEvents = true;
 
 	for (int i = Modifier::Type_begin; i < Modifier::Type_BASIC; ++ i) {
 		Keyboard::Mods &mods =
@@ -391,7 +474,8 @@ void Engine::generateModifierEvents(const Modifier &i_mod)
 		}
 	}
 
-	{
+	m_isGeneratingModifierEvents = false;
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << _T("\t\t}") << std::endl;
 	}
@@ -430,6 +514,7 @@ void Engine::generateActionEvents(const Current &i_c, const Action *i_a,
 	// keyseq
 	case Action::Type_keySeq: {
 		const ActionKeySeq *aks = reinterpret_cast<const ActionKeySeq *>(i_a);
+		setLatencyKind(LatencyKind_keySeq);
 		generateKeySeqEvents(i_c, aks->m_keySeq,
 							 i_doPress ? Part_down : Part_up);
 		break;
@@ -447,8 +532,9 @@ void Engine::generateActionEvents(const Current &i_c, const Action *i_a,
 
 		if (!is_down && !is_up)
 			break;
+		setLatencyKind(LatencyKind_function);
 
-		{
+		if (m_log.isLogged(1)) {
 			Acquire a(&m_log, 1);
 			m_log << _T("\t\t     >\t") << af->m_functionData;
 		}
@@ -463,9 +549,16 @@ void Engine::generateActionEvents(const Current &i_c, const Action *i_a,
 		param.m_c.m_mkey.m_modifier.on(Modifier::Type_Up, !i_doPress);
 		param.m_c.m_mkey.m_modifier.on(Modifier::Type_Down, i_doPress);
 
+		// functions may look at or act on the window, so let it receive
+		// the keys generated so far
+		flushOutput();
+		m_trace.record(EventTrace::Type_functionBegin,
+					   reinterpret_cast<u_int64>(af->m_functionData->getName()));
 		af->m_functionData->exec(this, &param);
+		m_trace.record(EventTrace::Type_functionEnd,
+					   reinterpret_cast<u_int64>(af->m_functionData->getName()));
 
-		if (param.m_doesNeedEndl) {
+		if (param.m_doesNeedEndl && m_log.isLogged(1)) {
 			Acquire a(&m_log, 1);
 			m_log << std::endl;
 		}
@@ -482,6 +575,8 @@ void Engine::generateKeySeqEvents(const Current &i_c, const KeySeq *i_keySeq,
 	const KeySeq::Actions &actions = i_keySeq->getActions();
 	if (actions.empty())
 		return;
+	if (1 < actions.size())
+		setLatencyKind(LatencyKind_keySeq);
 	if (i_part == Part_up)
 		generateActionEvents(i_c, actions[actions.size() - 1], false);
 	else {
@@ -560,7 +655,7 @@ void Engine::beginGeneratingKeyboardEvents(
 					type, i_c.m_mkey.m_modifier.isPressed(type));
 		}
 
-		{
+		if (m_log.isLogged(1)) {
 			Acquire a(&m_log, 1);
 			m_log << _T("* substitute") << std::endl;
 		}
@@ -600,6 +695,96 @@ void Engine::beginGeneratingKeyboardEvents(
 }
 
 
+// output an event to the output sink or Windows
+void Engine::output(const KEYBOARD_INPUT_DATA &i_kid)
+{
+	m_pendingOutputs.push_back(
+		PendingOutput(i_kid, m_isGeneratingModifierEvents));
+}
+
+
+// remove redundant modifier toggles from m_pendingOutputs.
+// "U-X D-X" of a modifier that generateModifierEvents() emitted leaves X
+// pressed as before and nothing was typed in between, so the pair can
+// be removed.  m_isPressedOnWin32 is not affected because it was
+// updated when the events were generated.  "D-X U-X" is a tap and is
+// kept (the "Alt U-Alt" workaround depends on it).
+void Engine::cancelModifierToggles()
+{
+	PendingOutputs::iterator o = m_pendingOutputs.begin();
+	for (PendingOutputs::iterator
+			i = m_pendingOutputs.begin(); i != m_pendingOutputs.end(); ++ i) {
+		if (o != m_pendingOutputs.begin() && i->m_isModifierFixup) {
+			const PendingOutput &prev = *(o - 1);
+			if (prev.m_isModifierFixup &&
+					prev.m_kid.MakeCode == i->m_kid.MakeCode &&
+					prev.m_kid.Flags ==
+					(i->m_kid.Flags | KEYBOARD_INPUT_DATA::BREAK) &&
+					!(i->m_kid.Flags & KEYBOARD_INPUT_DATA::BREAK)) {
+				-- o;				// cancel "U-X D-X"
+				continue;
+			}
+		}
+		*o ++ = *i;
+	}
+	m_outputCancelledCount +=
+		static_cast<LONG>(m_pendingOutputs.end() - o);
+	m_pendingOutputs.erase(o, m_pendingOutputs.end());
+}
+
+
+// send m_pendingInputs to Windows
+void Engine::sendPendingInputs()
+{
+	if (m_pendingInputs.empty())
+		return;
+	SendInput(static_cast<UINT>(m_pendingInputs.size()),
+			  &m_pendingInputs[0], sizeof(m_pendingInputs[0]));
+	m_pendingInputs.clear();
+}
+
+
+// send the events buffered by output()
+void Engine::flushOutput()
+{
+	if (m_pendingOutputs.empty())
+		return;
+
+	if (m_setting && m_setting->m_cancelModifierToggle)
+		cancelModifierToggles();
+
+	for (PendingOutputs::iterator
+			i = m_pendingOutputs.begin(); i != m_pendingOutputs.end(); ++ i) {
+		m_trace.record(EventTrace::Type_inject, i->m_kid);
+		if (m_outputSink)
+			m_outputSink->inject(i->m_kid);
+		else {
+			// a mouse event may change the foreground window, so the
+			// preceding keyboard events must arrive first
+			if (i->m_kid.Flags & KEYBOARD_INPUT_DATA::E1)
+				sendPendingInputs();
+			injectInput(&i->m_kid, NULL);
+		}
+	}
+	if (m_outputSink)
+		m_outputSink->flush();
+	else
+		sendPendingInputs();
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	m_lastOutputTime = now.QuadPart;
+
+	LONG count = static_cast<LONG>(m_pendingOutputs.size());
+	m_pendingOutputs.clear();
+	if (count == 0)
+		return;
+	++ m_outputFlushCount;
+	m_outputEventCount += count;
+	if (m_outputMaxEventsPerFlush < count)
+		m_outputMaxEventsPerFlush = count;
+}
+
+
 unsigned int Engine::injectInput(const KEYBOARD_INPUT_DATA *i_kid, const KBDLLHOOKSTRUCT *i_kidRaw)
 {
 	if (i_kid->Flags & KEYBOARD_INPUT_DATA::E1) {
@@ -732,7 +917,7 @@ unsigned int Engine::injectInput(const KEYBOARD_INPUT_DATA *i_kid, const KBDLLHO
 		if (i_kid->Flags & KEYBOARD_INPUT_DATA::E0) {
 			kid.ki.dwFlags |= KEYEVENTF_EXTENDEDKEY;
 		}
-		SendInput(1, &kid, sizeof(kid));
+		m_pendingInputs.push_back(kid);	// sent by sendPendingInputs()
 	}
 	return 1;
 }
@@ -779,12 +964,14 @@ unsigned int Engine::keyboardDetour(KBDLLHOOKSTRUCT *i_kid)
 			kid.Flags |= KEYBOARD_INPUT_DATA::E0;
 		}
 		kid.Reserved = 0;
-		kid.ExtraInformation = 0;
+		kid.ExtraInformation = getHookTime();
+		m_trace.record(EventTrace::Type_hookEntry, kid);
 
-		WaitForSingleObject(m_queueMutex, INFINITE);
-		m_inputQueue->push_back(kid);
-		SetEvent(m_readEvent);
-		ReleaseMutex(m_queueMutex);
+		// if the queue is full, let the key pass through rather than
+		// blocking the hook thread
+		if (!m_inputQueue.push(kid))
+			return 0;
+		m_trace.record(EventTrace::Type_queuePush, kid);
 		return 1;
 	}
 }
@@ -804,7 +991,7 @@ unsigned int Engine::mouseDetour(WPARAM i_message, MSLLHOOKSTRUCT *i_mid)
 		kid.UnitId = 0;
 		kid.Flags = KEYBOARD_INPUT_DATA::E1;
 		kid.Reserved = 0;
-		kid.ExtraInformation = 0;
+		kid.ExtraInformation = getHookTime();
 		switch (i_message) {
 		case WM_LBUTTONUP:
 			kid.Flags |= KEYBOARD_INPUT_DATA::BREAK;
@@ -861,11 +1048,8 @@ unsigned int Engine::mouseDetour(WPARAM i_message, MSLLHOOKSTRUCT *i_mid)
 			if (m_buttonPressed && !m_dragging && m_setting->m_dragThreshold &&
 				(m_setting->m_dragThreshold * m_setting->m_dragThreshold < dr)) {
 				kid.MakeCode = 0;
-				WaitForSingleObject(m_queueMutex, INFINITE);
-				m_dragging = true;
-				m_inputQueue->push_back(kid);
-				SetEvent(m_readEvent);
-				ReleaseMutex(m_queueMutex);
+				if (m_inputQueue.push(kid))
+					m_dragging = true;
 			}
 
 			switch (g_hookData->m_mouseHookType) {
@@ -920,39 +1104,41 @@ unsigned int Engine::mouseDetour(WPARAM i_message, MSLLHOOKSTRUCT *i_mid)
 			break;
 		}
 
-		WaitForSingleObject(m_queueMutex, INFINITE);
+		// events of one mouse message are queued all or nothing
+		KEYBOARD_INPUT_DATA kids[2];
+		LONG count = 0;
 
 		if (kid.Flags & KEYBOARD_INPUT_DATA::BREAK) {
 			m_buttonPressed = false;
 			if (m_dragging) {
-				KEYBOARD_INPUT_DATA kid2;
+				KEYBOARD_INPUT_DATA &kid2 = kids[count ++];
 
 				m_dragging = false;
 				kid2.UnitId = 0;
 				kid2.Flags = KEYBOARD_INPUT_DATA::E1 | KEYBOARD_INPUT_DATA::BREAK;
 				kid2.Reserved = 0;
-				kid2.ExtraInformation = 0;
+				kid2.ExtraInformation = kid.ExtraInformation;
 				kid2.MakeCode = 0;
-				m_inputQueue->push_back(kid2);
 			}
 		} else if (i_message != WM_MOUSEWHEEL && i_message != WM_MOUSEHWHEEL) {
 			m_buttonPressed = true;
 			m_msllHookCurrent = *i_mid;
 		}
 
-		m_inputQueue->push_back(kid);
+		kids[count ++] = kid;
+		m_trace.record(EventTrace::Type_hookEntry, kid);
 
 		if (i_message == WM_MOUSEWHEEL || i_message == WM_MOUSEHWHEEL) {
 			kid.UnitId = 0;
 			kid.Flags |= KEYBOARD_INPUT_DATA::BREAK;
 			kid.Reserved = 0;
-			kid.ExtraInformation = 0;
-			m_inputQueue->push_back(kid);
+			kids[count ++] = kid;
 		}
 
-		SetEvent(m_readEvent);
-		ReleaseMutex(m_queueMutex);
-
+		if (!m_inputQueue.push(kids, count))
+			return 0;
+		for (LONG i = 0; i < count; ++ i)
+			m_trace.record(EventTrace::Type_queuePush, kids[i]);
 		return 1;
 	}
 }
@@ -967,234 +1153,242 @@ unsigned int WINAPI Engine::keyboardHandler(void *i_this)
 void Engine::keyboardHandler()
 {
 	// loop
-	Key key;
 	while (1) {
 		KEYBOARD_INPUT_DATA kid;
 
-		WaitForSingleObject(m_queueMutex, INFINITE);
-		while (SignalObjectAndWait(m_queueMutex, m_readEvent, INFINITE, true) == WAIT_OBJECT_0) {
-			if (m_inputQueue == NULL) {
-				ReleaseMutex(m_queueMutex);
-				return;
-			}
-
-			if (m_inputQueue->empty()) {
-				ResetEvent(m_readEvent);
-				continue;
-			}
-
-			kid = m_inputQueue->front();
-			m_inputQueue->pop_front();
-			if (m_inputQueue->empty()) {
-				ResetEvent(m_readEvent);
+		// publishSetting() wakes the thread up even if no event comes
+		if (m_pendingSetting)
+			applyPendingSetting();
+
+		// drain all queued events before going to sleep
+		if (!m_inputQueue.pop(&kid)) {
+			if (m_inputQueueOverflowCount != m_inputQueue.getOverflowCount()) {
+				m_inputQueueOverflowCount = m_inputQueue.getOverflowCount();
+				Acquire a(&m_log, 0);
+				m_log << _T("input queue overflow: ")
+				<< m_inputQueueOverflowCount << _T(" events passed through")
+				<< _T(" (high water: ") << m_inputQueue.getHighWater()
+				<< _T("/") << m_inputQueue.getCapacity() << _T(")")
+				<< std::endl;
 			}
+			if (!m_inputQueue.wait())
+				return;
+			continue;
+		}
 
-			break;
+		m_trace.record(EventTrace::Type_queuePop, kid);
+		LARGE_INTEGER dequeued;
+		QueryPerformanceCounter(&dequeued);
+		m_latencyKind = LatencyKind_key;
+		m_lastOutputTime = 0;
+		processInput(kid);
+		flushOutput();
+		addLatency(kid, dequeued.QuadPart);
+	}
+}
 
-#if 0
-			case WAIT_OBJECT_0 + NUMBER_OF(handles): {
-				MSG message;
-
-				while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE)) {
-					switch (message.message) {
-					case WM_APP + 201: {
-						if (message.wParam) {
-							m_currentLock.on(Modifier::Type_Touchpad);
-							m_currentLock.on(Modifier::Type_TouchpadSticky);
-						} else
-							m_currentLock.off(Modifier::Type_Touchpad);
-						Acquire a(&m_log, 1);
-						m_log << _T("touchpad: ") << message.wParam
-						<< _T(".") << (message.lParam & 0xffff)
-						<< _T(".") << (message.lParam >> 16 & 0xffff)
-						<< std::endl;
-						break;
-					}
-					default:
-						break;
-					}
-				}
-				goto rewait;
-			}
-#endif
-		}
-		ReleaseMutex(m_queueMutex);
 
+// process an input event
+void Engine::processInput(const KEYBOARD_INPUT_DATA &i_kid)
+{
+	// windows that mayu.dll cannot hook (e.g. consoles) do not notify,
+	// so the focus is also examined now and then
+	if (m_focusEpoch.isDue(GetTickCount()))
 		checkFocusWindow();
 
-		if (!m_setting ||	// m_setting has not been loaded
-				!m_isEnabled) {	// disabled
-			if (m_isLogMode) {
-				Key key;
-				key.addScanCode(ScanCode(kid.MakeCode, kid.Flags));
-				outputToLog(&key, ModifiedKey(), 0);
-				if (kid.Flags & KEYBOARD_INPUT_DATA::E1) {
-					// through mouse event even if log mode
-					injectInput(&kid, NULL);
-				}
-			} else {
-				injectInput(&kid, NULL);
+	if (!m_setting ||	// m_setting has not been loaded
+			!m_isEnabled) {	// disabled
+		if (m_isLogMode) {
+			Key key;
+			key.addScanCode(ScanCode(i_kid.MakeCode, i_kid.Flags));
+			outputToLog(&key, ModifiedKey(), 0);
+			if (i_kid.Flags & KEYBOARD_INPUT_DATA::E1) {
+				// through mouse event even if log mode
+				output(i_kid);
 			}
-			updateLastPressedKey(NULL);
-			continue;
+		} else {
+			output(i_kid);
 		}
+		updateLastPressedKey(NULL);
+		return;
+	}
 
-		Acquire a(&m_cs);
+	Acquire a(&m_cs);
+	commitLatency();
 
-		if (!m_currentFocusOfThread ||
-				!m_currentKeymap) {
-			injectInput(&kid, NULL);
-			Acquire a(&m_log, 0);
-			if (!m_currentFocusOfThread)
-				m_log << _T("internal error: m_currentFocusOfThread == NULL")
-				<< std::endl;
-			if (!m_currentKeymap)
-				m_log << _T("internal error: m_currentKeymap == NULL")
-				<< std::endl;
-			updateLastPressedKey(NULL);
-			continue;
-		}
+	if (!m_currentFocusOfThread ||
+			!m_currentKeymap) {
+		output(i_kid);
+		Acquire a(&m_log, 0);
+		if (!m_currentFocusOfThread)
+			m_log << _T("internal error: m_currentFocusOfThread == NULL")
+			<< std::endl;
+		if (!m_currentKeymap)
+			m_log << _T("internal error: m_currentKeymap == NULL")
+			<< std::endl;
+		updateLastPressedKey(NULL);
+		return;
+	}
 
-		Current c;
-		c.m_keymap = m_currentKeymap;
-		c.m_i = m_currentFocusOfThread->m_keymaps.begin();
+	Current c;
+	c.m_keymap = m_currentKeymap;
+	c.m_i = m_currentFocusOfThread->m_keymaps.begin();
+
+	// search key
+	m_inputKey.addScanCode(ScanCode(i_kid.MakeCode, i_kid.Flags));
+	c.m_mkey = m_setting->m_keyboard.searchKey(m_inputKey);
+	if (!c.m_mkey.m_key) {
+		c.m_mkey.m_key = m_setting->m_keyboard.searchPrefixKey(m_inputKey);
+		if (c.m_mkey.m_key)
+			return;
+	}
 
-		// search key
-		key.addScanCode(ScanCode(kid.MakeCode, kid.Flags));
-		c.m_mkey = m_setting->m_keyboard.searchKey(key);
-		if (!c.m_mkey.m_key) {
-			c.m_mkey.m_key = m_setting->m_keyboard.searchPrefixKey(key);
-			if (c.m_mkey.m_key)
-				continue;
-		}
+	// press the key and update counter
+	bool isPhysicallyPressed
+	= !(m_inputKey.getScanCodes()[0].m_flags & ScanCode::BREAK);
+	m_trace.record(EventTrace::Type_keyResolved,
+				   static_cast<u_int32>(c.m_mkey.m_key ?
+										c.m_mkey.m_key->getId() :
+										Key::ID_NONE) |
+				   (static_cast<u_int64>(isPhysicallyPressed) << 32));
+	m_trace.record(EventTrace::Type_keymapChosen,
+				   reinterpret_cast<u_int64>(c.m_keymap));
+	if (c.m_mkey.m_key) {
+		if (!c.m_mkey.m_key->m_isPressed && isPhysicallyPressed)
+			++ m_currentKeyPressCount;
+		else if (c.m_mkey.m_key->m_isPressed && !isPhysicallyPressed)
+			-- m_currentKeyPressCount;
+		setPressed(c.m_mkey.m_key, isPhysicallyPressed);
+	}
 
-		// press the key and update counter
-		bool isPhysicallyPressed
-		= !(key.getScanCodes()[0].m_flags & ScanCode::BREAK);
-		if (c.m_mkey.m_key) {
-			if (!c.m_mkey.m_key->m_isPressed && isPhysicallyPressed)
-				++ m_currentKeyPressCount;
-			else if (c.m_mkey.m_key->m_isPressed && !isPhysicallyPressed)
-				-- m_currentKeyPressCount;
-			c.m_mkey.m_key->m_isPressed = isPhysicallyPressed;
+	// create modifiers
+	c.m_mkey.m_modifier = getCurrentModifiers(c.m_mkey.m_key,
+						  isPhysicallyPressed);
+	Keymap::AssignMode am;
+	bool isModifier = fixModifierKey(&c.m_mkey, &am);
+	if (m_isPrefix) {
+		if (isModifier && m_doesIgnoreModifierForPrefix)
+			am = Keymap::AM_true;
+		if (m_doesEditNextModifier) {
+			Modifier modifier = m_modifierForNextKey;
+			modifier.add(c.m_mkey.m_modifier);
+			c.m_mkey.m_modifier = modifier;
 		}
+	}
 
-		// create modifiers
-		c.m_mkey.m_modifier = getCurrentModifiers(c.m_mkey.m_key,
-							  isPhysicallyPressed);
-		Keymap::AssignMode am;
-		bool isModifier = fixModifierKey(&c.m_mkey, &am);
-		if (m_isPrefix) {
-			if (isModifier && m_doesIgnoreModifierForPrefix)
-				am = Keymap::AM_true;
-			if (m_doesEditNextModifier) {
-				Modifier modifier = m_modifierForNextKey;
-				modifier.add(c.m_mkey.m_modifier);
-				c.m_mkey.m_modifier = modifier;
-			}
+	if (m_isLogMode) {
+		outputToLog(&m_inputKey, c.m_mkey, 0);
+		if (i_kid.Flags & KEYBOARD_INPUT_DATA::E1) {
+			// through mouse event even if log mode
+			output(i_kid);
 		}
-
-		if (m_isLogMode) {
-			outputToLog(&key, c.m_mkey, 0);
-			if (kid.Flags & KEYBOARD_INPUT_DATA::E1) {
-				// through mouse event even if log mode
-				injectInput(&kid, NULL);
-			}
-		} else if (am == Keymap::AM_true) {
-			{
-				Acquire a(&m_log, 1);
-				m_log << _T("* true modifier") << std::endl;
-			}
-			// true modifier doesn't generate scan code
-			outputToLog(&key, c.m_mkey, 1);
-		} else if (am == Keymap::AM_oneShot || am == Keymap::AM_oneShotRepeatable) {
-			{
-				Acquire a(&m_log, 1);
-				if (am == Keymap::AM_oneShot)
-					m_log << _T("* one shot modifier") << std::endl;
-				else
-					m_log << _T("* one shot repeatable modifier") << std::endl;
-			}
-			// oneShot modifier doesn't generate scan code
-			outputToLog(&key, c.m_mkey, 1);
-			if (isPhysicallyPressed) {
-				if (am == Keymap::AM_oneShotRepeatable	// the key is repeating
-						&& m_oneShotKey.m_key == c.m_mkey.m_key) {
-					if (m_oneShotRepeatableRepeatCount <
-							m_setting->m_oneShotRepeatableDelay) {
-						; // delay
-					} else {
-						Current cnew = c;
-						beginGeneratingKeyboardEvents(cnew, false);
-					}
-					++ m_oneShotRepeatableRepeatCount;
+	} else if (am == Keymap::AM_true) {
+		if (m_log.isLogged(1)) {
+			Acquire a(&m_log, 1);
+			m_log << _T("* true modifier") << std::endl;
+		}
+		// true modifier doesn't generate scan code
+		outputToLog(&m_inputKey, c.m_mkey, 1);
+	} else if (am == Keymap::AM_oneShot || am == Keymap::AM_oneShotRepeatable) {
+		if (m_log.isLogged(1)) {
+			Acquire a(&m_log, 1);
+			if (am == Keymap::AM_oneShot)
+				m_log << _T("* one shot modifier") << std::endl;
+			else
+				m_log << _T("* one shot repeatable modifier") << std::endl;
+		}
+		// oneShot modifier doesn't generate scan code
+		outputToLog(&m_inputKey, c.m_mkey, 1);
+		if (isPhysicallyPressed) {
+			if (am == Keymap::AM_oneShotRepeatable	// the key is repeating
+					&& m_oneShotKey.m_key == c.m_mkey.m_key) {
+				if (m_oneShotRepeatableRepeatCount <
+						m_setting->m_oneShotRepeatableDelay) {
+					; // delay
 				} else {
-					m_oneShotKey = c.m_mkey;
-					m_oneShotRepeatableRepeatCount = 0;
-				}
-			} else {
-				if (m_oneShotKey.m_key) {
 					Current cnew = c;
-					cnew.m_mkey.m_modifier = m_oneShotKey.m_modifier;
-					cnew.m_mkey.m_modifier.off(Modifier::Type_Up);
-					cnew.m_mkey.m_modifier.on(Modifier::Type_Down);
-					beginGeneratingKeyboardEvents(cnew, false);
-
-					cnew = c;
-					cnew.m_mkey.m_modifier = m_oneShotKey.m_modifier;
-					cnew.m_mkey.m_modifier.on(Modifier::Type_Up);
-					cnew.m_mkey.m_modifier.off(Modifier::Type_Down);
 					beginGeneratingKeyboardEvents(cnew, false);
 				}
-				m_oneShotKey.m_key = NULL;
+				++ m_oneShotRepeatableRepeatCount;
+			} else {
+				m_oneShotKey = c.m_mkey;
 				m_oneShotRepeatableRepeatCount = 0;
 			}
-		} else if (c.m_mkey.m_key) {
-			// normal key
-			outputToLog(&key, c.m_mkey, 1);
-			if (isPhysicallyPressed)
-				m_oneShotKey.m_key = NULL;
-			beginGeneratingKeyboardEvents(c, isModifier);
 		} else {
-			// undefined key
-			if (kid.Flags & KEYBOARD_INPUT_DATA::E1) {
-				// through mouse event even if undefined for fail safe
-				injectInput(&kid, NULL);
+			if (m_oneShotKey.m_key) {
+				Current cnew = c;
+				cnew.m_mkey.m_modifier = m_oneShotKey.m_modifier;
+				cnew.m_mkey.m_modifier.off(Modifier::Type_Up);
+				cnew.m_mkey.m_modifier.on(Modifier::Type_Down);
+				beginGeneratingKeyboardEvents(cnew, false);
+
+				cnew = c;
+				cnew.m_mkey.m_modifier = m_oneShotKey.m_modifier;
+				cnew.m_mkey.m_modifier.on(Modifier::Type_Up);
+				cnew.m_mkey.m_modifier.off(Modifier::Type_Down);
+				beginGeneratingKeyboardEvents(cnew, false);
 			}
+			m_oneShotKey.m_key = NULL;
+			m_oneShotRepeatableRepeatCount = 0;
 		}
-
-		// if counter is zero, reset modifiers and keys on win32
-		if (m_currentKeyPressCount <= 0) {
-			{
-				Acquire a(&m_log, 1);
-				m_log << _T("* No key is pressed") << std::endl;
-			}
-			generateModifierEvents(Modifier());
-			if (0 < m_currentKeyPressCountOnWin32)
-				keyboardResetOnWin32();
-			m_currentKeyPressCount = 0;
-			m_currentKeyPressCountOnWin32 = 0;
+	} else if (c.m_mkey.m_key) {
+		// normal key
+		outputToLog(&m_inputKey, c.m_mkey, 1);
+		if (isPhysicallyPressed)
 			m_oneShotKey.m_key = NULL;
-			if (m_currentLock.isOn(Modifier::Type_Touchpad) == false)
-				m_currentLock.off(Modifier::Type_TouchpadSticky);
+		beginGeneratingKeyboardEvents(c, isModifier);
+	} else {
+		// undefined key
+		if (i_kid.Flags & KEYBOARD_INPUT_DATA::E1) {
+			// through mouse event even if undefined for fail safe
+			output(i_kid);
 		}
+	}
 
-		key.initialize();
-		updateLastPressedKey(isPhysicallyPressed ? c.m_mkey.m_key : NULL);
+	// if counter is zero, reset modifiers and keys on win32
+	if (m_currentKeyPressCount <= 0) {
+		if (m_log.isLogged(1)) {
+			Acquire a(&m_log, 1);
+			m_log << _T("* No key is pressed") << std::endl;
+		}
+		generateModifierEvents(Modifier());
+		if (0 < m_currentKeyPressCountOnWin32)
+			keyboardResetOnWin32();
+		m_currentKeyPressCount = 0;
+		m_currentKeyPressCountOnWin32 = 0;
+		m_oneShotKey.m_key = NULL;
+		if (m_currentLock.isOn(Modifier::Type_Touchpad) == false)
+			m_currentLock.off(Modifier::Type_TouchpadSticky);
 	}
+
+	m_inputKey.initialize();
+	updateLastPressedKey(isPhysicallyPressed ? c.m_mkey.m_key : NULL);
 }
 
 
 Engine::Engine(tomsgstream &i_log)
 		: m_hwndAssocWindow(NULL),
 		m_setting(NULL),
+		m_pendingSetting(NULL),
+		m_publishedGeneration(0),
+		m_appliedGeneration(0),
 		m_buttonPressed(false),
 		m_dragging(false),
 		m_keyboardHandler(installKeyboardHook, Engine::keyboardDetour),
 		m_mouseHandler(installMouseHook, Engine::mouseDetour),
-		m_inputQueue(NULL),
-		m_readEvent(NULL),
-		m_queueMutex(NULL),
+		m_threadHandle(NULL),
+		m_inputQueueOverflowCount(0),
+		m_outputSink(NULL),
+		m_focusProvider(&s_win32FocusProvider),
+		m_isGeneratingModifierEvents(false),
+		m_outputFlushCount(0),
+		m_outputEventCount(0),
+		m_outputMaxEventsPerFlush(0),
+		m_outputCancelledCount(0),
+		m_latencySamplesSize(0),
+		m_latencyKind(LatencyKind_key),
+		m_lastOutputTime(0),
+		m_performanceFrequency(0),
 		m_sts4mayu(NULL),
 		m_cts4mayu(NULL),
 		m_isLogMode(false),
@@ -1204,12 +1398,15 @@ Engine::Engine(tomsgstream &i_log)
 		m_generateKeyboardEventsRecursionGuard(0),
 		m_currentKeyPressCount(0),
 		m_currentKeyPressCountOnWin32(0),
+		m_pressedModifiers(0),
+		m_pressedModifiersKeymap(NULL),
 		m_lastGeneratedKey(NULL),
 		m_oneShotRepeatableRepeatCount(0),
 		m_isPrefix(false),
 		m_currentKeymap(NULL),
 		m_currentFocusOfThread(NULL),
 		m_hwndFocus(NULL),
+		m_focusEpoch(FOCUS_CHECK_INTERVAL),
 		m_afShellExecute(NULL),
 		m_variable(0),
 		m_log(i_log) {
@@ -1223,6 +1420,10 @@ Engine::Engine(tomsgstream &i_log)
 	for (size_t i = 0; i < NUMBER_OF(m_lastPressedKey); ++ i)
 		m_lastPressedKey[i] = NULL;
 
+	LARGE_INTEGER frequency;
+	CHECK_TRUE( QueryPerformanceFrequency(&frequency) );
+	m_performanceFrequency = frequency.QuadPart;
+
 	// set default lock state
 	for (int i = 0; i < Modifier::Type_end; ++ i)
 		m_currentLock.dontcare(static_cast<Modifier::Type>(i));
@@ -1251,16 +1452,11 @@ Engine::Engine(tomsgstream &i_log)
 
 // start keyboard handler thread
 void Engine::start() {
+	m_inputQueue.open();
+
 	m_keyboardHandler.start(this);
 	m_mouseHandler.start(this);
 
-	CHECK_TRUE( m_inputQueue = new std::deque<KEYBOARD_INPUT_DATA> );
-	CHECK_TRUE( m_queueMutex = CreateMutex(NULL, FALSE, NULL) );
-	CHECK_TRUE( m_readEvent = CreateEvent(NULL, TRUE, FALSE, NULL) );
-	m_ol.Offset = 0;
-	m_ol.OffsetHigh = 0;
-	m_ol.hEvent = m_readEvent;
-
 	CHECK_TRUE( m_threadHandle = (HANDLE)_beginthreadex(NULL, 0, keyboardHandler, this, 0, &m_threadId) );
 }
 
@@ -1270,19 +1466,12 @@ void Engine::stop() {
 	m_mouseHandler.stop();
 	m_keyboardHandler.stop();
 
-	WaitForSingleObject(m_queueMutex, INFINITE);
-	delete m_inputQueue;
-	m_inputQueue = NULL;
-	SetEvent(m_readEvent);
-	ReleaseMutex(m_queueMutex);
+	m_inputQueue.close();
 
 	WaitForSingleObject(m_threadHandle, 2000);
 	CHECK_TRUE( CloseHandle(m_threadHandle) );
 	m_threadHandle = NULL;
 
-	CHECK_TRUE( CloseHandle(m_readEvent) );
-	m_readEvent = NULL;
-
 	for (ThreadIds::iterator i = m_attachedThreadIds.begin();
 		 i != m_attachedThreadIds.end(); i++) {
 		 PostThreadMessage(*i, WM_NULL, 0, 0);
@@ -1302,6 +1491,7 @@ bool Engine::prepairQuit() {
 
 Engine::~Engine() {
 	CHECK_TRUE( CloseHandle(m_eSync) );
+	delete m_pendingSetting;
 
 	// destroy named pipe for &SetImeString
 	if (m_hookPipe && m_hookPipe != INVALID_HANDLE_VALUE) {
@@ -1355,39 +1545,289 @@ void Engine::manageTs4mayu(TCHAR *i_ts4mayuDllName,
 }
 
 
+// time stamp of the hook
+ULONG Engine::getHookTime()
+{
+	// the low bits are enough for the intervals we measure.  0 means
+	// that the event did not come from a hook.
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return static_cast<ULONG>(now.QuadPart) | 1;
+}
+
+
+// add the latencies of an input event to m_latencySamples
+void Engine::addLatency(const KEYBOARD_INPUT_DATA &i_kid, LONGLONG i_dequeued)
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	LONGLONG end = m_lastOutputTime ? m_lastOutputTime : now.QuadPart;
+	u_int64 process = static_cast<u_int64>(end - i_dequeued);
+	u_int64 queue = static_cast<ULONG>((static_cast<ULONG>(i_dequeued) | 1) -
+									   i_kid.ExtraInformation);
+	u_int64 frequency = static_cast<u_int64>(m_performanceFrequency);
+
+	// processInput() commits the samples while it holds m_cs anyway, so
+	// m_cs is taken here only if it has not done so for a while (e.g.
+	// while yamy is disabled)
+	LatencySample &s = m_latencySamples[m_latencySamplesSize ++];
+	s.m_kind = m_latencyKind;
+	s.m_isHooked = !!i_kid.ExtraInformation;
+	s.m_queue = static_cast<u_int32>(queue * 1000000 / frequency);
+	s.m_process = static_cast<u_int32>(process * 1000000 / frequency);
+	if (m_latencySamplesSize == LATENCY_SAMPLES_SIZE) {
+		Acquire a(&m_cs);
+		commitLatency();
+	}
+}
+
+
+// move m_latencySamples to m_latency
+void Engine::commitLatency()
+{
+	for (size_t i = 0; i < m_latencySamplesSize; ++ i) {
+		const LatencySample &s = m_latencySamples[i];
+		LatencyHistogram *h = m_latency[s.m_kind];
+		h[LatencyPart_process].add(s.m_process);
+		if (s.m_isHooked) {
+			h[LatencyPart_queue].add(s.m_queue);
+			h[LatencyPart_total].add(s.m_queue + s.m_process);
+		}
+	}
+	m_latencySamplesSize = 0;
+}
+
+
+// write the input latency statistics to the log
+void Engine::reportLatency()
+{
+	static const _TCHAR *kinds[LatencyKind_end] = {
+		_T("key"), _T("keyseq"), _T("function"),
+	};
+	static const _TCHAR *parts[LatencyPart_end] = {
+		_T("queue"), _T("process"), _T("total"),
+	};
+
+	Acquire a(&m_cs);
+	Acquire b(&m_log, 0);
+	m_log << _T("latency (microseconds):") << std::endl
+		  << _T("                    count     p50     p99    p999     max")
+		  << std::endl;
+	for (int i = 0; i < LatencyKind_end; ++ i)
+		for (int j = 0; j < LatencyPart_end; ++ j) {
+			const LatencyHistogram &h = m_latency[i][j];
+			m_log << std::setfill(_T(' '))
+				  << std::setw(8) << std::left << (j == 0 ? kinds[i] : _T(""))
+				  << std::setw(7) << parts[j] << std::right
+				  << std::setw(10) << h.getCount()
+				  << std::setw(8) << h.getPercentile(500)
+				  << std::setw(8) << h.getPercentile(990)
+				  << std::setw(8) << h.getPercentile(999)
+				  << std::setw(8) << h.getMax() << std::endl;
+		}
+}
+
+
+// forget the input latency statistics
+void Engine::resetLatency()
+{
+	Acquire a(&m_cs);
+	for (int i = 0; i < LatencyKind_end; ++ i)
+		for (int j = 0; j < LatencyPart_end; ++ j)
+			m_latency[i][j].reset();
+}
+
+
+// write the event trace
+bool Engine::dumpTrace(const tstring &i_filename)
+{
+	EventTrace::Names names;
+	{
+		Acquire a(&m_cs);
+		if (m_setting) {
+			for (Keyboard::KeyIterator
+					i = m_setting->m_keyboard.getKeyIterator(); *i; ++ i)
+				names.push_back(EventTrace::Name(EventTrace::NameType_key,
+												 (*i)->getId(),
+												 (*i)->getName()));
+			Keymaps::KeymapPtrList keymaps;
+			m_setting->m_keymaps.getKeymaps(&keymaps);
+			for (Keymaps::KeymapPtrList::iterator
+					i = keymaps.begin(); i != keymaps.end(); ++ i)
+				names.push_back(EventTrace::Name(EventTrace::NameType_keymap,
+												 reinterpret_cast<u_int64>(*i),
+												 (*i)->getName()));
+		}
+	}
+	FunctionNames functionNames;
+	getFunctionNames(&functionNames);
+	for (FunctionNames::iterator
+			i = functionNames.begin(); i != functionNames.end(); ++ i)
+		names.push_back(EventTrace::Name(EventTrace::NameType_function,
+										 reinterpret_cast<u_int64>(*i), *i));
+	return m_trace.dump(i_filename, names);
+}
+
+
+// do the part of changing the setting that does not need m_cs
+void Engine::prepareSetting(PendingSetting *io_ps)
+{
+	typedef std::pair<tstringi, tstringi> WindowName;
+	std::list<WindowName> windows;
+	{
+		Acquire a(&m_cs);
+		io_ps->m_base = m_setting;
+		for (FocusOfThreads::iterator i = m_focusOfThreads.begin();
+				i != m_focusOfThreads.end(); ++ i)
+			windows.push_back(WindowName((*i).second.m_className,
+										 (*i).second.m_titleName));
+	}
+
+	// the engine thread changes only the states of the keys of m_base,
+	// so they can be searched without m_cs
+	Setting *setting = io_ps->m_setting;
+	if (io_ps->m_base) {
+		Keyboard &keyboard = io_ps->m_base->m_keyboard;
+		io_ps->m_keys.resize(keyboard.getKeysSize(), NULL);
+		for (Keyboard::KeyIterator i = keyboard.getKeyIterator(); *i; ++ i)
+			io_ps->m_keys[(*i)->getId()] = setting->m_keyboard.searchKey(*(*i));
+	}
+
+	// fill the window cache of the new keymaps, so changeSetting() only
+	// looks them up
+	KeymapPtrList keymaps;
+	for (std::list<WindowName>::iterator i = windows.begin();
+			i != windows.end(); ++ i)
+		setting->m_keymaps.searchWindow(&keymaps, (*i).first, (*i).second);
+	setting->m_keymaps.searchWindow(&keymaps, _T(""), _T(""));
+}
+
+
 // set m_setting
 bool Engine::setSetting(Setting *i_setting) {
+	PendingSetting ps(i_setting);
+	prepareSetting(&ps);
+
 	Acquire a(&m_cs);
 	if (m_isSynchronizing)
 		return false;
+	ps.m_generation = InterlockedIncrement(&m_publishedGeneration);
+	moveKeyStates(&ps);
+	changeSetting(&ps);
+	return true;
+}
 
-	if (m_setting) {
+
+// let the engine thread use i_setting from its next input event
+LONG Engine::publishSetting(Setting *i_setting)
+{
+	if (!m_threadHandle) {
+		// nobody else can be using the engine (nor synchronizing)
+		CHECK_TRUE( setSetting(i_setting) );
+		return m_appliedGeneration;
+	}
+
+	PendingSetting *ps = new PendingSetting(i_setting);
+	prepareSetting(ps);
+	LONG generation = ps->m_generation =
+		InterlockedIncrement(&m_publishedGeneration);
+	ps = reinterpret_cast<PendingSetting *>(
+		InterlockedExchangePointer(
+			reinterpret_cast<PVOID volatile *>(&m_pendingSetting), ps));
+	delete ps;					// has never been used
+
+	// the engine thread may be waiting for input (replay() looks at
+	// m_pendingSetting before each event anyway)
+	m_inputQueue.wakeUp();
+	return generation;
+}
+
+
+// use m_pendingSetting (engine thread only)
+void Engine::applyPendingSetting()
+{
+	PendingSetting *ps = reinterpret_cast<PendingSetting *>(
+		InterlockedExchangePointer(
+			reinterpret_cast<PVOID volatile *>(&m_pendingSetting), NULL));
+	if (!ps)
+		return;
+
+	// the states of the keys belong to this thread, and nobody uses the
+	// keys of the new setting yet, so only the swap itself takes m_cs
+	moveKeyStates(ps);
+	{
+		Acquire a(&m_cs);
+		if (m_isSynchronizing) {
+			// try again after the synchronization, unless a newer setting
+			// has been published meanwhile
+			if (!InterlockedCompareExchangePointer(
+					reinterpret_cast<PVOID volatile *>(&m_pendingSetting),
+					ps, NULL))
+				return;
+		} else
+			changeSetting(ps);
+	}
+	delete ps;
+	if (m_hwndAssocWindow)
+		PostMessage(m_hwndAssocWindow, WM_APP_engineNotify,
+					EngineNotify_settingApplied, 0);
+}
+
+
+// copy the states of the keys to the new setting
+void Engine::moveKeyStates(PendingSetting *io_ps)
+{
+	if (io_ps->m_base != m_setting)
+		io_ps->m_keys.clear();			// m_setting has changed since
+	Setting *setting = io_ps->m_setting;
+
+	if (m_setting)
 		for (Keyboard::KeyIterator i = m_setting->m_keyboard.getKeyIterator();
 				*i; ++ i) {
-			Key *key = i_setting->m_keyboard.searchKey(*(*i));
+			Key *key = io_ps->searchKey(*(*i));
 			if (key) {
 				key->m_isPressed = (*i)->m_isPressed;
 				key->m_isPressedOnWin32 = (*i)->m_isPressedOnWin32;
 				key->m_isPressedByAssign = (*i)->m_isPressedByAssign;
 			}
 		}
+
+	io_ps->m_pressedKeys.reset(setting->m_keyboard.getKeysSize());
+	for (Keyboard::KeyIterator i = setting->m_keyboard.getKeyIterator();
+			*i; ++ i)
+		io_ps->m_pressedKeys.set((*i)->getId(), (*i)->m_isPressed);
+}
+
+
+// change the setting (m_cs must be acquired, moveKeyStates() must be called)
+void Engine::changeSetting(PendingSetting *io_ps)
+{
+	if (m_setting) {
 		if (m_lastGeneratedKey)
-			m_lastGeneratedKey =
-				i_setting->m_keyboard.searchKey(*m_lastGeneratedKey);
+			m_lastGeneratedKey = io_ps->searchKey(*m_lastGeneratedKey);
 		for (size_t i = 0; i < NUMBER_OF(m_lastPressedKey); ++ i)
 			if (m_lastPressedKey[i])
-				m_lastPressedKey[i] =
-					i_setting->m_keyboard.searchKey(*m_lastPressedKey[i]);
+				m_lastPressedKey[i] = io_ps->searchKey(*m_lastPressedKey[i]);
+		if (m_oneShotKey.m_key)
+			m_oneShotKey.m_key = io_ps->searchKey(*m_oneShotKey.m_key);
 	}
 
-	m_setting = i_setting;
+	m_setting = io_ps->m_setting;
+	InterlockedExchange(&m_appliedGeneration, io_ps->m_generation);
+	m_trace.record(EventTrace::Type_settingSwap,
+				   reinterpret_cast<u_int64>(m_setting));
+
+	m_pressedKeys.swap(io_ps->m_pressedKeys);
+	m_pressedModifiersKeymap = NULL;
 
 	manageTs4mayu(_T("sts4mayu.dll"), _T("SynCOM.dll"),
 				  m_setting->m_sts4mayu, &m_sts4mayu);
 	manageTs4mayu(_T("cts4mayu.dll"), _T("TouchPad.dll"),
 				  m_setting->m_cts4mayu, &m_cts4mayu);
 
-	g_hookData->m_correctKanaLockHandling = m_setting->m_correctKanaLockHandling;
+	if (!isHeadless())
+		g_hookData->m_correctKanaLockHandling =
+			m_setting->m_correctKanaLockHandling;
 	if (m_currentFocusOfThread) {
 		for (FocusOfThreads::iterator i = m_focusOfThreads.begin();
 				i != m_focusOfThreads.end(); i ++) {
@@ -1405,12 +1845,66 @@ bool Engine::setSetting(Setting *i_setting) {
 	m_currentFocusOfThread = &m_globalFocus;
 	setCurrentKeymap(m_globalFocus.m_keymaps.front());
 	m_hwndFocus = NULL;
-	return true;
+	notifyFocusChanged();
+}
+
+// set destination of generated events
+void Engine::setOutputSink(OutputSink *i_outputSink)
+{
+	Acquire a(&m_cs);
+	flushOutput();
+	m_outputSink = i_outputSink;
+}
+
+
+// set source of focus information
+void Engine::setFocusProvider(FocusProvider *i_focusProvider)
+{
+	Acquire a(&m_cs);
+	m_focusProvider =
+		i_focusProvider ? i_focusProvider : &s_win32FocusProvider;
 }
 
+
+// process all events of i_inputSource on the caller's thread
+void Engine::replay(InputSource *i_inputSource)
+{
+	ASSERT(!m_inputQueue.isOpened());
+	HANDLE thread;
+	CHECK_TRUE( DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
+								GetCurrentProcess(), &thread,
+								0, FALSE, DUPLICATE_SAME_ACCESS) );
+	{
+		Acquire a(&m_cs);
+		m_threadHandle = thread;
+	}
+
+	KEYBOARD_INPUT_DATA kid;
+	while (i_inputSource->read(&kid)) {
+		if (m_pendingSetting)
+			applyPendingSetting();
+		LARGE_INTEGER dequeued;
+		QueryPerformanceCounter(&dequeued);
+		m_latencyKind = LatencyKind_key;
+		m_lastOutputTime = 0;
+		processInput(kid);
+		flushOutput();
+		addLatency(kid, dequeued.QuadPart);
+	}
+
+	// the last setting published before i_inputSource ran out
+	applyPendingSetting();
+	{
+		Acquire a(&m_cs);
+		m_threadHandle = NULL;
+	}
+	CHECK_TRUE( CloseHandle(thread) );
+}
+
+
 void Engine::unlocked()
 {
-	if (m_inputQueue == NULL) {
+	if (!m_inputQueue.isOpened()) {
 		return;
 	}
 
@@ -1424,8 +1918,6 @@ void Engine::unlocked()
 
 void Engine::releaseKey(uint16_t scanCode)
 {
-	WaitForSingleObject(m_queueMutex, INFINITE);
-
 	KEYBOARD_INPUT_DATA kid;
 	kid.UnitId = 0;
 	kid.MakeCode = scanCode;
@@ -1436,9 +1928,18 @@ void Engine::releaseKey(uint16_t scanCode)
 	}
 	kid.Reserved = 0;
 	kid.ExtraInformation = 0;
-	m_inputQueue->push_back(kid);
-	SetEvent(m_readEvent);
-	ReleaseMutex(m_queueMutex);
+	// nobody passes this event through for us, so wait for the keyboard
+	// handler to make room instead of dropping it
+	for (int i = 0; !m_inputQueue.push(kid); ++ i) {
+		if (!m_inputQueue.isOpened() || RELEASE_KEY_RETRY_COUNT <= i) {
+			Acquire a(&m_log, 0);
+			m_log << _T("input queue full: release of scan code 0x")
+			<< std::hex << scanCode << std::dec << _T(" is lost")
+			<< std::endl;
+			return;
+		}
+		Sleep(1);
+	}
 }
 
 void Engine::checkShow(HWND i_hwnd) {
@@ -1512,6 +2013,7 @@ bool Engine::setFocus(HWND i_hwndFocus, DWORD i_threadId,
 		return false;
 	if (i_hwndFocus == NULL)
 		return true;
+	notifyFocusChanged();
 
 	// remove newly created thread's id from m_detachedThreadIds
 	if (!m_detachedThreadIds.empty()) {
@@ -1586,7 +2088,6 @@ bool Engine::setShow(bool i_isMaximized, bool i_isMinimized,
 	Acquire a(&m_cs);
 	if (m_isSynchronizing)
 		return false;
-	Acquire b(&m_log, 1);
 	Modifier::Type max, min;
 	if (i_isMDI == true) {
 		max = Modifier::Type_MdiMaximized;
@@ -1597,12 +2098,15 @@ bool Engine::setShow(bool i_isMaximized, bool i_isMinimized,
 	}
 	m_currentLock.on(max, i_isMaximized);
 	m_currentLock.on(min, i_isMinimized);
-	m_log << _T("Set show to ") << (i_isMaximized ? _T("Maximized") :
-									i_isMinimized ? _T("Minimized") : _T("Normal"));
-	if (i_isMDI == true) {
-		m_log << _T(" (MDI)");
+	if (m_log.isLogged(1)) {
+		Acquire b(&m_log, 1);
+		m_log << _T("Set show to ") << (i_isMaximized ? _T("Maximized") :
+										i_isMinimized ? _T("Minimized") : _T("Normal"));
+		if (i_isMDI == true) {
+			m_log << _T(" (MDI)");
+		}
+		m_log << std::endl;
 	}
-	m_log << std::endl;
 	return true;
 }
 
@@ -1629,6 +2133,7 @@ bool Engine::threadAttachNotify(DWORD i_threadId) {
 bool Engine::threadDetachNotify(DWORD i_threadId) {
 	Acquire a(&m_cs);
 	m_detachedThreadIds.push_back(i_threadId);
+	notifyFocusChanged();
 	m_attachedThreadIds.erase(remove(m_attachedThreadIds.begin(), m_attachedThreadIds.end(), i_threadId),
 							  m_attachedThreadIds.end());
 	return true;
@@ -9,6 +9,10 @@
 #  include "setting.h"
 #  include "msgstream.h"
 #  include "hook.h"
+#  include "inputqueue.h"
+#  include "engineio.h"
+#  include "eventtrace.h"
+#  include "latency.h"
 #  include <set>
 #  include <queue>
 
@@ -27,6 +31,8 @@ enum EngineNotify {
 	EngineNotify_helpMessage,			///
 	EngineNotify_setForegroundWindow,		///
 	EngineNotify_clearLog,			///
+	EngineNotify_settingApplied,			/** a setting passed to
+						    publishSetting() is used */
 };
 
 
@@ -37,10 +43,44 @@ private:
 	enum {
 		MAX_GENERATE_KEYBOARD_EVENTS_RECURSION_COUNT = 64, ///
 		MAX_KEYMAP_PREFIX_HISTORY = 64, ///
+		FOCUS_CHECK_INTERVAL = 200,		/** ms to examine the focus
+						    without notification */
+		RELEASE_KEY_RETRY_COUNT = 100,	/** ms releaseKey() waits for
+						    room in the input queue */
+		LATENCY_SAMPLES_SIZE = 64,		/** latencies addLatency()
+						    keeps before it locks */
 	};
 
 	typedef Keymaps::KeymapPtrList KeymapPtrList;	///
 
+	/// what an input event has executed (in order of precedence)
+	enum LatencyKind {
+		LatencyKind_key,				/// keys only
+		LatencyKind_keySeq,				/// a keyseq
+		LatencyKind_function,			/// a function
+		LatencyKind_end,				///
+	};
+
+	/// part of the latency of an input event
+	enum LatencyPart {
+		LatencyPart_queue,				/// from the hook to dequeue
+		LatencyPart_process,			/** from dequeue to the last
+						    output */
+		LatencyPart_total,				/** from the hook to the last
+						    output */
+		LatencyPart_end,				///
+	};
+
+	/// the latencies of an input event that are not in m_latency yet
+	class LatencySample
+	{
+	public:
+		LatencyKind m_kind;				///
+		bool m_isHooked;				/// is m_queue valid ?
+		u_int32 m_queue;				/// microseconds
+		u_int32 m_process;				/// microseconds
+	};
+
 	/// focus of a thread
 	class FocusOfThread
 	{
@@ -61,6 +101,37 @@ private:
 
 	typedef std::list<DWORD /*ThreadId*/> ThreadIds;	///
 
+	/** a setting prepared for changeSetting() without holding m_cs.
+	    the heavy part of changing the setting (searching the new keys of
+	    the pressed keys and the keymaps of the windows) is done here by
+	    the caller of publishSetting(), not by the engine thread.  the
+	    engine thread copies the key states by moveKeyStates(), also
+	    without m_cs. */
+	class PendingSetting
+	{
+	public:
+		Setting *m_setting;				/// new setting
+		LONG m_generation;				/// see publishSetting()
+		Setting *m_base;				/// m_keys is made from this
+		std::vector<Key *> m_keys;		/** keys of m_setting indexed by
+						    Key::getId() of m_base */
+		KeyIdSet m_pressedKeys;			/** m_pressedKeys for
+						    m_setting */
+
+	public:
+		///
+		PendingSetting(Setting *i_setting)
+			: m_setting(i_setting), m_generation(0), m_base(NULL) { }
+
+		/// get the key of m_setting that is i_key of m_base
+		Key *searchKey(const Key &i_key) const {
+			size_t id = static_cast<size_t>(i_key.getId());
+			if (id < m_keys.size())
+				return m_keys[id];
+			return m_setting->m_keyboard.searchKey(i_key);
+		}
+	};
+
 	/// current status in generateKeyboardEvents
 	class Current
 	{
@@ -138,6 +209,28 @@ private:
 
 	typedef std::list<HWND> WindowsWithAlpha; /// windows for &amp;WindowSetAlpha
 
+	/// queue between the hook threads and the keyboard handler thread
+	typedef ::InputQueue<KEYBOARD_INPUT_DATA, 1024> InputQueue;
+
+	typedef std::vector<INPUT> Inputs;		/// for SendInput()
+
+	/// an event waiting for flushOutput()
+	class PendingOutput
+	{
+	public:
+		KEYBOARD_INPUT_DATA m_kid;			///
+		bool m_isModifierFixup;			/** generated by
+							    generateModifierEvents() ? */
+
+	public:
+		///
+		PendingOutput(const KEYBOARD_INPUT_DATA &i_kid, bool i_isModifierFixup)
+			: m_kid(i_kid),
+			  m_isModifierFixup(i_isModifierFixup) {
+		}
+	};
+	typedef std::vector<PendingOutput> PendingOutputs; ///
+
 	enum InterruptThreadReason {
 		InterruptThreadReason_Terminate,
 		InterruptThreadReason_Pause,
@@ -177,21 +270,53 @@ private:
 	HWND m_hwndAssocWindow;			/** associated window (we post
                                                     message to it) */
 	Setting * volatile m_setting;			/// setting
+	PendingSetting * volatile m_pendingSetting;	/** published but not used
+						    yet.  the publisher and
+						    the engine thread only
+						    exchange it atomically */
+	volatile LONG m_publishedGeneration;		/** generation of the last
+						    published setting */
+	volatile LONG m_appliedGeneration;		/** generation of m_setting
+						    (written under m_cs) */
 
 	// engine thread state
 	HANDLE m_threadHandle;
 	unsigned m_threadId;
-	std::deque<KEYBOARD_INPUT_DATA> *m_inputQueue;
-	HANDLE m_queueMutex;
+	InputQueue m_inputQueue;			/** events from the hook
+						    threads */
+	LONG m_inputQueueOverflowCount;		/** overflow count already
+						    reported to the log */
+	EventTrace m_trace;				/// binary event trace
 	MSLLHOOKSTRUCT m_msllHookCurrent;
 	bool m_buttonPressed;
 	bool m_dragging;
 	InputHandler m_keyboardHandler;
 	InputHandler m_mouseHandler;
-	HANDLE m_readEvent;				/** reading from mayu device
-                                                    has been completed */
-	OVERLAPPED m_ol;				/** for async read/write of
-						    mayu device */
+	Key m_inputKey;				/** scan codes of the key being
+						    input */
+	OutputSink *m_outputSink;			/** destination of generated
+						    events (NULL: Windows) */
+	FocusProvider *m_focusProvider;		/// source of focus information
+	PendingOutputs m_pendingOutputs;		/// events not flushed yet
+	Inputs m_pendingInputs;			/** events not sent to
+						    Windows yet */
+	bool m_isGeneratingModifierEvents;		/** in
+						    generateModifierEvents() ? */
+	LONG m_outputFlushCount;			/// number of flushes
+	LONG m_outputEventCount;			/// events flushed so far
+	LONG m_outputMaxEventsPerFlush;		/// largest flush
+	LONG m_outputCancelledCount;			/** events removed by
+						    cancelModifierToggles() */
+	LatencyHistogram m_latency[LatencyKind_end][LatencyPart_end]; /** guarded
+						    by m_cs */
+	LatencySample m_latencySamples[LATENCY_SAMPLES_SIZE]; /** used only by
+						    the engine thread */
+	size_t m_latencySamplesSize;			///
+	LatencyKind m_latencyKind;			/// of the input being processed
+	LONGLONG m_lastOutputTime;			/** when the last event was
+						    sent for the input being
+						    processed (0: none) */
+	LONGLONG m_performanceFrequency;		/// QueryPerformanceFrequency()
 	HANDLE m_hookPipe;				/// named pipe for &SetImeString
 	HMODULE m_sts4mayu;				/// DLL module for ThumbSense
 	HMODULE m_cts4mayu;				/// DLL module for ThumbSense
@@ -208,6 +333,13 @@ private:
                                                     phisically ? */
 	int m_currentKeyPressCountOnWin32;		/** how many keys are pressed
                                                     on win32 ? */
+	KeyIdSet m_pressedKeys;			/** keys whose m_isPressed is
+						    true */
+	Modifier::MODIFIERS m_pressedModifiers;	/** modifiers of
+						    m_pressedModifiersKeymap
+						    whose keys are pressed */
+	const Keymap *m_pressedModifiersKeymap;	/** NULL if m_pressedModifiers
+						    must be rebuilt */
 	Key *m_lastGeneratedKey;			/// last generated key
 	Key *m_lastPressedKey[2];			/// last pressed key
 	ModifiedKey m_oneShotKey;			/// one shot key
@@ -235,6 +367,8 @@ private:
 	FocusOfThread * volatile m_currentFocusOfThread; ///
 	FocusOfThread m_globalFocus;			///
 	HWND m_hwndFocus;				/// current focus window
+	FocusEpoch m_focusEpoch;			/** when checkFocusWindow()
+						    must run */
 	ThreadIds m_attachedThreadIds;	///
 	ThreadIds m_detachedThreadIds;	///
 
@@ -267,17 +401,60 @@ private:
 	unsigned int mouseDetour(WPARAM i_message, MSLLHOOKSTRUCT *i_mid);
 	///
 	unsigned int injectInput(const KEYBOARD_INPUT_DATA *i_kid, const KBDLLHOOKSTRUCT *i_kidRaw);
+	/// output an event to m_outputSink or Windows
+	void output(const KEYBOARD_INPUT_DATA &i_kid);
+	/** send the events buffered by output().
+	    must be called before anything that has to see their effect. */
+	void flushOutput();
+	/// remove "U-X D-X" of modifiers from m_pendingOutputs
+	void cancelModifierToggles();
+	/// send m_pendingInputs to Windows
+	void sendPendingInputs();
+	/// raise m_latencyKind to i_kind
+	void setLatencyKind(LatencyKind i_kind) {
+		if (m_latencyKind < i_kind)
+			m_latencyKind = i_kind;
+	}
+	/** add the latencies of an input event to m_latencySamples.
+	    it takes m_cs only when m_latencySamples is full. */
+	void addLatency(const KEYBOARD_INPUT_DATA &i_kid, LONGLONG i_dequeued);
+	/** move m_latencySamples to m_latency (m_cs must be held by the
+	    engine thread) */
+	void commitLatency();
+	/// time stamp of the hook put in KEYBOARD_INPUT_DATA::ExtraInformation
+	static ULONG getHookTime();
+	/// are the generated events kept away from Windows ?
+	bool isHeadless() const {
+		return m_outputSink != NULL;
+	}
 
 private:
 	/// keyboard handler thread
 	static unsigned int WINAPI keyboardHandler(void *i_this);
 	///
 	void keyboardHandler();
+	/// process an input event
+	void processInput(const KEYBOARD_INPUT_DATA &i_kid);
+
+	/// do the part of changing the setting that does not need m_cs
+	void prepareSetting(PendingSetting *io_ps);
+	/** copy the states of the keys to the new setting (engine thread,
+	    m_cs need not be acquired) */
+	void moveKeyStates(PendingSetting *io_ps);
+	/// change the setting (m_cs must be acquired)
+	void changeSetting(PendingSetting *io_ps);
+	/// use m_pendingSetting (engine thread only)
+	void applyPendingSetting();
 
 	/// check focus window
 	void checkFocusWindow();
 	/// is modifier pressed ?
 	bool isPressed(Modifier::Type i_mt);
+	/** set m_isPressed of a key and update m_pressedKeys and
+	    m_pressedModifiers */
+	void setPressed(Key *i_key, bool i_isPressed);
+	/// get the modifiers of m_currentKeymap whose keys are pressed
+	Modifier::MODIFIERS getPressedModifiers();
 	/// fix modifier key
 	bool fixModifierKey(ModifiedKey *io_mkey, Keymap::AssignMode *o_am);
 
@@ -508,6 +685,11 @@ private:
 					const StrExprArg &i_funcName = StrExprArg(),
 					const StrExprArg &i_funcParam = StrExprArg(),
 					BooleanType i_doesCreateThread = BooleanType_false);
+	/// dump the event trace to a file
+	void funcTraceDump(FunctionParam *i_param, const StrExprArg &i_filename);
+	/// report the input latency statistics
+	void funcLatencyReport(FunctionParam *i_param,
+						   BooleanType i_doesReset = BooleanType_false);
 	/// set IME open status
 	void funcSetImeStatus(FunctionParam *i_param, ToggleType i_toggle = ToggleType_toggle);
 	/// set string to IME
@@ -565,6 +747,43 @@ public:
 		return m_isEnabled;
 	}
 
+	/// number of input events dropped because the input queue was full
+	LONG getInputQueueOverflowCount() const {
+		return m_inputQueue.getOverflowCount();
+	}
+	/// maximum number of input events that were queued at once
+	LONG getInputQueueHighWater() const {
+		return m_inputQueue.getHighWater();
+	}
+	/// number of flushes of the generated events
+	LONG getOutputFlushCount() const {
+		return m_outputFlushCount;
+	}
+	/// number of generated events that have been flushed
+	LONG getOutputEventCount() const {
+		return m_outputEventCount;
+	}
+	/// maximum number of generated events sent by one flush
+	LONG getOutputMaxEventsPerFlush() const {
+		return m_outputMaxEventsPerFlush;
+	}
+	/// number of generated events removed as redundant modifier toggles
+	LONG getOutputCancelledCount() const {
+		return m_outputCancelledCount;
+	}
+
+	/** write the event trace with the names of the current setting.
+	    @return false if the file cannot be written */
+	bool dumpTrace(const tstring &i_filename);
+
+	/** write the input latency statistics to the log.
+	    the latest events may be missing: the engine thread adds them at
+	    the next event (or after LATENCY_SAMPLES_SIZE events while
+	    disabled). */
+	void reportLatency();
+	/// forget the input latency statistics
+	void resetLatency();
+
 	// 
 	void unlocked();
 	void releaseKey(uint16_t scanCode);
@@ -579,14 +798,55 @@ public:
 		return m_hwndAssocWindow;
 	}
 
-	/// setting
+	/** setting.
+	    @return false if the engine is synchronizing */
 	bool setSetting(Setting *i_setting);
 
+	/** let the engine thread use i_setting from its next input event.
+	    this does not wait for the engine thread, and must not be called
+	    after replay() has returned.
+	    @return the generation of i_setting.  the caller must keep the
+	    setting used before and the settings published before until
+	    isApplied() returns true for it, which is worth asking after
+	    EngineNotify_settingApplied. */
+	LONG publishSetting(Setting *i_setting);
+
+	/** has the engine thread changed to the setting of i_generation or to
+	    a later one ? */
+	bool isApplied(LONG i_generation) const {
+		return 0 <= m_appliedGeneration - i_generation;
+	}
+
+	/// the setting in use (engine thread only)
+	const Setting *getSetting() const {
+		return m_setting;
+	}
+
+	/// set destination of generated events (NULL: Windows)
+	void setOutputSink(OutputSink *i_outputSink);
+
+	/// set source of focus information (NULL: Windows)
+	void setFocusProvider(FocusProvider *i_focusProvider);
+
+	/** process all events of i_inputSource on the caller's thread.
+	    the keyboard handler thread must not be started.  the caller is
+	    the engine thread meanwhile, so settings published by other
+	    threads are used from the next event. */
+	void replay(InputSource *i_inputSource);
+
 	/// focus
 	bool setFocus(HWND i_hwndFocus, DWORD i_threadId,
 				  const tstringi &i_className,
 				  const tstringi &i_titleName, bool i_isConsole);
 
+	/** the foreground window may have changed.
+	    processInput() examines the focus only after this (or setFocus(),
+	    setSetting(), ...) has been called, or every FOCUS_CHECK_INTERVAL
+	    ms. */
+	void notifyFocusChanged() {
+		m_focusEpoch.notify();
+	}
+
 	/// lock state
 	bool setLockState(bool i_isNumLockToggled, bool i_isCapsLockToggled,
 					  bool i_isScrollLockToggled, bool i_isKanaLockToggled,
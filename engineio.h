@@ -0,0 +1,102 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// engineio.h
+
+
+#ifndef _ENGINEIO_H
+#  define _ENGINEIO_H
+
+#  include "misc.h"
+#  include "stringtool.h"
+#  include "driver.h"
+
+
+/** source of the physical input events.
+    the hook threads feed Engine through its InputQueue; a replay feeds
+    Engine::replay() through this interface. */
+class InputSource
+{
+public:
+	///
+	virtual ~InputSource() { }
+	/** get next event.
+	    @return false if no more events exist */
+	virtual bool read(KEYBOARD_INPUT_DATA *o_kid) = 0;
+};
+
+
+/** destination of the events generated by Engine.
+    if Engine has no OutputSink, events are sent to Windows by
+    Engine::injectInput(). */
+class OutputSink
+{
+public:
+	///
+	virtual ~OutputSink() { }
+	/// output an event
+	virtual void inject(const KEYBOARD_INPUT_DATA &i_kid) = 0;
+	/** deliver the events injected since the last flush.
+	    Engine calls this once per input event, and before anything that
+	    must see the effect of the generated events. */
+	virtual void flush() { }
+};
+
+
+/** source of the focus information.
+    if Engine has no FocusProvider, the foreground window of Windows is
+    used. */
+class FocusProvider
+{
+public:
+	///
+	virtual ~FocusProvider() { }
+	/// get the foreground window and its thread id
+	virtual HWND getForegroundWindow(DWORD *o_threadId) = 0;
+	/// get the class name of i_hwnd
+	virtual bool getClassName(HWND i_hwnd, tstringi *o_className) = 0;
+	/// get the title name of i_hwnd
+	virtual bool getTitleName(HWND i_hwnd, tstringi *o_titleName) = 0;
+};
+
+
+/** when Engine asks its FocusProvider for the focus.
+    notify() may be called by any thread, isDue() only by the engine
+    thread. */
+class FocusEpoch
+{
+	volatile LONG m_epoch;			/** incremented when the focus
+						    may have changed */
+	LONG m_checkedEpoch;				/** m_epoch when isDue()
+						    returned true */
+	DWORD m_checkTime;				/// when isDue() returned true
+	const DWORD m_interval;			/** ms to examine the focus
+						    without notification */
+
+public:
+	///
+	FocusEpoch(DWORD i_interval)
+		: m_epoch(1),
+		  m_checkedEpoch(0),
+		  m_checkTime(0),
+		  m_interval(i_interval) {
+	}
+
+	/// the focus may have changed
+	void notify() {
+		InterlockedIncrement(&m_epoch);
+	}
+
+	/** must the focus be examined at i_now (GetTickCount()) ?
+	    true if notify() has been called since isDue() returned true last,
+	    or if m_interval ms have passed since then. */
+	bool isDue(DWORD i_now) {
+		LONG epoch = m_epoch;
+		if (epoch == m_checkedEpoch && i_now - m_checkTime < m_interval)
+			return false;
+		m_checkedEpoch = epoch;
+		m_checkTime = i_now;
+		return true;
+	}
+};
+
+
+#endif // !_ENGINEIO_H
@@ -0,0 +1,136 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// eventtrace.cpp
+
+
+#include "misc.h"
+#include "eventtrace.h"
+#include <algorithm>
+#include <vector>
+
+
+// is i_a older than i_b ?
+static bool isOlder(const EventTrace::Record &i_a,
+					const EventTrace::Record &i_b)
+{
+	return i_a.m_time < i_b.m_time;
+}
+
+
+// write i_size bytes
+static bool writeBytes(HANDLE i_file, const void *i_data, size_t i_size)
+{
+	DWORD written;
+	return WriteFile(i_file, i_data, static_cast<DWORD>(i_size),
+					 &written, NULL) && written == i_size;
+}
+
+
+//
+EventTrace::EventTrace()
+		: m_rings(new Ring[MAX_THREADS]),
+		m_ringsClaimed(0),
+		m_tlsIndex(TlsAlloc())
+{
+	ASSERT((RING_SIZE & (RING_SIZE - 1)) == 0);
+	ASSERT(sizeof(Record) == 24);
+	CHECK_TRUE( m_tlsIndex != TLS_OUT_OF_INDEXES );
+	for (int i = 0; i < MAX_THREADS; ++ i) {
+		m_rings[i].m_count = 0;
+		m_rings[i].m_threadId = 0;
+	}
+}
+
+
+//
+EventTrace::~EventTrace()
+{
+	TlsFree(m_tlsIndex);
+	delete [] m_rings;
+}
+
+
+// get the ring of the current thread
+EventTrace::Ring *EventTrace::getRing()
+{
+	// m_rings + MAX_THREADS marks a thread that has no ring
+	Ring *ring = reinterpret_cast<Ring *>(TlsGetValue(m_tlsIndex));
+	if (!ring) {
+		LONG i = InterlockedIncrement(&m_ringsClaimed) - 1;
+		if (i < MAX_THREADS) {
+			ring = &m_rings[i];
+			ring->m_threadId = GetCurrentThreadId();
+		} else
+			ring = m_rings + MAX_THREADS;
+		TlsSetValue(m_tlsIndex, ring);
+	}
+	return ring == m_rings + MAX_THREADS ? NULL : ring;
+}
+
+
+// write the records of all threads
+bool EventTrace::dump(const tstring &i_filename, const Names &i_names) const
+{
+	typedef std::vector<Record> Records;
+	Records records;
+
+	LONG ringsSize = std::min<LONG>(m_ringsClaimed, MAX_THREADS);
+	for (LONG i = 0; i < ringsSize; ++ i) {
+		const Ring &ring = m_rings[i];
+		LONG end = ring.m_count;
+		LONG begin = std::max<LONG>(0, end - RING_SIZE);
+		size_t top = records.size();
+		for (LONG j = begin; j < end; ++ j)
+			records.push_back(ring.m_records[j & (RING_SIZE - 1)]);
+
+		// the writer may have overwritten the oldest records meanwhile.
+		// the slot being written now is not counted in m_count yet.
+		LONG valid = ring.m_count + 1 - RING_SIZE;
+		if (begin < valid)
+			records.erase(records.begin() + top,
+						  records.begin() + top +
+						  std::min<LONG>(valid - begin, end - begin));
+	}
+	std::stable_sort(records.begin(), records.end(), isOlder);
+
+	HANDLE file = CreateFile(i_filename.c_str(), GENERIC_WRITE, 0, NULL,
+							 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	// header
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	u_int64 freq = frequency.QuadPart;
+	u_int32 version = DUMP_VERSION;
+	u_int32 recordSize = sizeof(Record);
+	u_int32 namesSize = static_cast<u_int32>(i_names.size());
+	u_int32 recordsSize = static_cast<u_int32>(records.size());
+	u_int32 untracedThreads = static_cast<u_int32>(getUntracedThreadCount());
+	bool ok =
+		writeBytes(file, "YAMYTRC", 8) &&
+		writeBytes(file, &version, sizeof(version)) &&
+		writeBytes(file, &recordSize, sizeof(recordSize)) &&
+		writeBytes(file, &freq, sizeof(freq)) &&
+		writeBytes(file, &namesSize, sizeof(namesSize)) &&
+		writeBytes(file, &recordsSize, sizeof(recordsSize)) &&
+		writeBytes(file, &untracedThreads, sizeof(untracedThreads));
+
+	// names (UTF-8)
+	for (Names::const_iterator
+			i = i_names.begin(); ok && i != i_names.end(); ++ i) {
+		std::string name = to_UTF_8(i->m_name);
+		u_int32 type = i->m_type;
+		u_int32 length = static_cast<u_int32>(name.size());
+		ok = writeBytes(file, &type, sizeof(type)) &&
+			 writeBytes(file, &length, sizeof(length)) &&
+			 writeBytes(file, &i->m_id, sizeof(i->m_id)) &&
+			 writeBytes(file, name.data(), name.size());
+	}
+
+	// records
+	if (ok && !records.empty())
+		ok = writeBytes(file, &records[0], records.size() * sizeof(Record));
+
+	CHECK_TRUE( CloseHandle(file) );
+	return ok;
+}
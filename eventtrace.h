@@ -0,0 +1,135 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// eventtrace.h
+
+
+#ifndef _EVENTTRACE_H
+#  define _EVENTTRACE_H
+
+#  include "misc.h"
+#  include "stringtool.h"
+#  include "driver.h"
+#  include <list>
+
+
+/** binary trace of the engine events.
+    each thread writes its own ring of fixed size, so record() takes no
+    lock and never allocates.  dump() writes the rings to a file that
+    tools/yamy-trace decodes. */
+class EventTrace
+{
+public:
+	/// event type (stored in dumps, so do not renumber)
+	enum Type {
+		Type_hookEntry = 1,			/// arg: input data
+		Type_queuePush = 2,			/// arg: input data
+		Type_queuePop = 3,			/// arg: input data
+		Type_keyResolved = 4,			/// arg: key id | pressed << 32
+		Type_keymapChosen = 5,		/// arg: keymap
+		Type_functionBegin = 6,		/// arg: function name
+		Type_functionEnd = 7,			/// arg: function name
+		Type_inject = 8,			/// arg: input data
+		Type_focusChange = 9,			/// arg: HWND
+		Type_settingSwap = 10,		/// arg: Setting
+	};
+
+	/// kind of the id of a Name
+	enum NameType {
+		NameType_key = 1,			/// Key::getId()
+		NameType_keymap = 2,			/// Keymap pointer
+		NameType_function = 3,		/// FunctionData::getName()
+	};
+
+	/// a name for an id found in the records
+	class Name
+	{
+	public:
+		NameType m_type;				///
+		u_int64 m_id;					///
+		tstringi m_name;				///
+
+	public:
+		///
+		Name(NameType i_type, u_int64 i_id, const tstringi &i_name)
+			: m_type(i_type), m_id(i_id), m_name(i_name) { }
+	};
+	typedef std::list<Name> Names;		///
+
+	/// a traced event (24 bytes, little endian in dumps)
+	class Record
+	{
+	public:
+		u_int64 m_time;				/// QueryPerformanceCounter()
+		u_int32 m_threadId;				///
+		u_int16 m_type;				/// Type
+		u_int16 m_reserved;				///
+		u_int64 m_arg;				///
+	};
+
+	enum {
+		MAX_THREADS = 8,				/// threads that get a ring
+		RING_SIZE = 2048,				/// must be a power of two
+		DUMP_VERSION = 2,				/** 2: the header has the
+							    untraced thread count */
+	};
+
+private:
+	/// records of a thread
+	class Ring
+	{
+	public:
+		volatile LONG m_count;			/// records ever written
+		DWORD m_threadId;				///
+		Record m_records[RING_SIZE];		///
+	};
+
+	Ring *m_rings;				/// MAX_THREADS rings
+	volatile LONG m_ringsClaimed;			/// may exceed MAX_THREADS
+	DWORD m_tlsIndex;				/// ring of the thread
+
+private:
+	/// get the ring of the current thread (NULL if none is left)
+	Ring *getRing();
+
+public:
+	///
+	EventTrace();
+	///
+	~EventTrace();
+
+	/// record an event
+	void record(Type i_type, u_int64 i_arg) {
+		Ring *ring = getRing();
+		if (!ring)
+			return;
+		LONG count = ring->m_count;
+		Record &r = ring->m_records[count & (RING_SIZE - 1)];
+		LARGE_INTEGER time;
+		QueryPerformanceCounter(&time);
+		r.m_time = time.QuadPart;
+		r.m_threadId = ring->m_threadId;
+		r.m_type = static_cast<u_int16>(i_type);
+		r.m_reserved = 0;
+		r.m_arg = i_arg;
+		InterlockedExchange(&ring->m_count, count + 1);
+	}
+
+	/// record an event of an input data
+	void record(Type i_type, const KEYBOARD_INPUT_DATA &i_kid) {
+		record(i_type, static_cast<u_int64>(i_kid.MakeCode) |
+			   (static_cast<u_int64>(i_kid.Flags) << 16));
+	}
+
+	/// threads that have recorded nothing, because all rings were taken
+	LONG getUntracedThreadCount() const {
+		LONG claimed = m_ringsClaimed;
+		return claimed <= MAX_THREADS ? 0 : claimed - MAX_THREADS;
+	}
+
+	/** write the records of all threads in the order of time.
+	    the threads may keep on recording while dumping.
+	    @return false if the file cannot be written */
+	bool dump(const tstring &i_filename, const Names &i_names) const;
+};
+
+
+#endif // !_EVENTTRACE_H
@@ -528,22 +528,43 @@ public:
 };
 
 
-// create function
-FunctionData *createFunctionData(const tstring &i_name)
-{
-	static
+///
+static
 #define FUNCTION_CREATOR
 #include "functions.h"
 #undef FUNCTION_CREATOR
-	;
+;
 
-	for (size_t i = 0; i != NUMBER_OF(functionCreators); ++ i)
-		if (i_name == functionCreators[i].m_name)
+
+// create function
+FunctionData *createFunctionData(const tstring &i_name)
+{
+	// makefunc sorts functionCreators by name
+	size_t begin = 0, end = NUMBER_OF(functionCreators);
+	while (begin < end) {
+		size_t i = (begin + end) / 2;
+		int r = _tcscmp(i_name.c_str(), functionCreators[i].m_name);
+		if (r == 0)
 			return functionCreators[i].m_creator();
+		if (r < 0)
+			end = i;
+		else
+			begin = i + 1;
+	}
 	return NULL;
 }
 
 
+// get the names of all functions
+void getFunctionNames(FunctionNames *o_names)
+{
+	// makefunc puts the FunctionData::getName() of each function in
+	// functionCreators, so no FunctionData is needed
+	for (size_t i = 0; i != NUMBER_OF(functionCreators); ++ i)
+		o_names->push_back(functionCreators[i].m_name);
+}
+
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // misc. functions
 
@@ -718,11 +739,11 @@ int Engine::EmacsEditKillLine::pred()
 // send a default key to Windows
 void Engine::funcDefault(FunctionParam *i_param)
 {
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << std::endl;
-		i_param->m_doesNeedEndl = false;
 	}
+	i_param->m_doesNeedEndl = false;
 	if (i_param->m_isPressed)
 		generateModifierEvents(i_param->m_c.m_mkey.m_modifier);
 	generateKeyEvent(i_param->m_c.m_mkey.m_key, i_param->m_isPressed, true);
@@ -738,7 +759,7 @@ void Engine::funcKeymapParent(FunctionParam *i_param)
 		return;
 	}
 
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << _T("(") << c.m_keymap->getName() << _T(")") << std::endl;
 	}
@@ -780,7 +801,7 @@ void Engine::funcOtherWindowClass(FunctionParam *i_param)
 	}
 
 	c.m_keymap = *c.m_i;
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << _T("(") << c.m_keymap->getName() << _T(")") << std::endl;
 	}
@@ -804,7 +825,7 @@ void Engine::funcPrefix(FunctionParam *i_param, const Keymap *i_keymap,
 	m_doesEditNextModifier = false;
 	m_doesIgnoreModifierForPrefix = !!i_doesIgnoreModifiers;
 
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << _T("(") << i_keymap->getName() << _T(", ")
 		<< (i_doesIgnoreModifiers ? _T("true") : _T("false")) << _T(")");
@@ -816,11 +837,11 @@ void Engine::funcKeymap(FunctionParam *i_param, const Keymap *i_keymap)
 {
 	Current c(i_param->m_c);
 	c.m_keymap = i_keymap;
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << _T("(") << c.m_keymap->getName() << _T(")") << std::endl;
-		i_param->m_doesNeedEndl = false;
 	}
+	i_param->m_doesNeedEndl = false;
 	generateKeyboardEvents(c);
 }
 
@@ -835,6 +856,12 @@ void Engine::funcSync(FunctionParam *i_param)
 	Key *sync = m_setting->m_keyboard.getSyncKey();
 	if (sync->getScanCodesSize() == 0)
 		return;
+	if (isHeadless()) {
+		// no hook will see the sync key
+		generateKeyEvent(sync, false, false);
+		flushOutput();
+		return;
+	}
 	const ScanCode *sc = sync->getScanCodes();
 
 	// set variables exported from mayu.dll
@@ -842,6 +869,7 @@ void Engine::funcSync(FunctionParam *i_param)
 	g_hookData->m_syncKeyIsExtended = !!(sc->m_flags & ScanCode::E0E1);
 	m_isSynchronizing = true;
 	generateKeyEvent(sync, false, false);
+	flushOutput();
 
 	m_cs.release();
 	DWORD r = WaitForSingleObject(m_eSync, 5000);
@@ -1175,6 +1203,7 @@ void Engine::funcWait(FunctionParam *i_param, int i_milliSecond)
 	if (i_milliSecond < 0 || 5000 < i_milliSecond)	// too long wait
 		return;
 
+	flushOutput();
 	m_isSynchronizing = true;
 	m_cs.release();
 	Sleep(i_milliSecond);
@@ -1211,7 +1240,7 @@ void Engine::funcDescribeBindings(FunctionParam *i_param)
 {
 	if (!i_param->m_isPressed)
 		return;
-	{
+	if (m_log.isLogged(1)) {
 		Acquire a(&m_log, 1);
 		m_log << std::endl;
 	}
@@ -1604,7 +1633,7 @@ void Engine::funcWindowIdentify(FunctionParam *i_param)
 			_TCHAR titleName[1024];
 			if (GetWindowText(i_param->m_hwnd, titleName, NUMBER_OF(titleName)) == 0)
 				titleName[0] = _T('\0');
-			{
+			if (m_log.isLogged(1)) {
 				Acquire a(&m_log, 1);
 				m_log << _T("HWND:\t") << std::hex
 				<< reinterpret_cast<int>(i_param->m_hwnd)
@@ -1855,6 +1884,36 @@ void Engine::funcLogClear(FunctionParam *i_param)
 				EngineNotify_clearLog, 0);
 }
 
+// dump the event trace to a file
+void Engine::funcTraceDump(FunctionParam *i_param,
+						   const StrExprArg &i_filename)
+{
+	if (!i_param->m_isPressed)
+		return;
+	tstring filename = i_filename.eval();
+	bool ok = dumpTrace(filename);
+	Acquire a(&m_log, 0);
+	if (ok) {
+		m_log << _T("trace dumped to ") << filename << std::endl;
+		if (LONG untraced = m_trace.getUntracedThreadCount())
+			m_log << _T("  ") << untraced << _T(" threads were not traced")
+			<< _T(" (only ") << EventTrace::MAX_THREADS
+			<< _T(" threads are)") << std::endl;
+	} else
+		m_log << _T("error: cannot write ") << filename << std::endl;
+}
+
+// report the input latency statistics
+void Engine::funcLatencyReport(FunctionParam *i_param,
+							   BooleanType i_doesReset)
+{
+	if (!i_param->m_isPressed)
+		return;
+	reportLatency();
+	if (i_doesReset)
+		resetLatency();
+}
+
 // recenter
 void Engine::funcRecenter(FunctionParam *i_param)
 {
@@ -5,6 +5,8 @@
 #ifndef _FUNCTION_H
 #  define _FUNCTION_H
 
+#  include "hook.h"				// MouseHookType
+
 
 class SettingLoader;
 class Engine;
@@ -24,8 +26,12 @@ public:
 	virtual const _TCHAR *getName() const = 0;
 	///
 	virtual tostream &output(tostream &i_ost) const = 0;
-	///
+	/** create clone.  a shared function data returns itself */
 	virtual FunctionData *clone() const = 0;
+	/** is this shared by all of its uses ?  a function without
+	    arguments has no state, so only one instance of it is created and
+	    it must not be deleted */
+	virtual bool isShared() const = 0;
 };
 
 /// stream output
@@ -35,6 +41,13 @@ extern tostream &operator<<(tostream &i_ost, const FunctionData *i_data);
 // create function
 extern FunctionData *createFunctionData(const tstring &i_name);
 
+///
+typedef std::list<const _TCHAR *> FunctionNames;
+
+/** get the names of all functions.  the pointers are the ones
+    FunctionData::getName() returns, not copies. */
+extern void getFunctionNames(FunctionNames *o_names);
+
 ///
 enum VKey {
 	VKey_extended = 0x100,			///
@@ -82,9 +95,6 @@ extern tostream &operator<<(tostream &i_ost, GravityType i_data);
 extern bool getTypeValue(GravityType *o_type, const tstring &i_name);
 
 
-/// enum MouseHookType is defined in hook.h
-extern enum MouseHookType;
-
 /// stream output
 extern tostream &operator<<(tostream &i_ost, MouseHookType i_data);
 
@@ -0,0 +1,184 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// inputqueue.h
+
+
+#ifndef _INPUTQUEUE_H
+#  define _INPUTQUEUE_H
+
+#  include "misc.h"
+#  include <windows.h>
+
+
+/** bounded multi-producer/single-consumer queue.
+    the hook threads (and releaseKey()) push, only the keyboard handler
+    thread pops.  push() never blocks and never allocates, so it is safe
+    to call from a low-level hook callback.  i_size must be a power of
+    two. */
+template <class T, LONG i_size>
+class InputQueue
+{
+	///
+	class Cell
+	{
+	public:
+		volatile LONG m_sequence;		/// slot generation
+		T m_data;				///
+	};
+
+	Cell m_cells[i_size];				///
+	volatile LONG m_enqueuePos;			/// next slot to be claimed
+	volatile LONG m_dequeuePos;			/// next slot to be popped
+	HANDLE m_event;				/// wake up the consumer
+	volatile LONG m_isWaiting;			/// is the consumer sleeping ?
+	volatile LONG m_isOpened;			/// does push() accept data ?
+	volatile LONG m_overflowCount;		/// events dropped by full queue
+	volatile LONG m_highWater;			/// maximum depth ever seen
+
+private:
+	/// raise m_highWater to i_depth
+	void updateHighWater(LONG i_depth) {
+		LONG hw = m_highWater;
+		while (hw < i_depth) {
+			LONG prev = InterlockedCompareExchange(&m_highWater, i_depth, hw);
+			if (prev == hw)
+				break;
+			hw = prev;
+		}
+	}
+
+	/// wake the consumer up if it is sleeping
+	void notify() {
+		if (InterlockedExchange(&m_isWaiting, 0))
+			SetEvent(m_event);
+	}
+
+public:
+	///
+	InputQueue()
+		: m_enqueuePos(0),
+		  m_dequeuePos(0),
+		  m_event(NULL),
+		  m_isWaiting(0),
+		  m_isOpened(0),
+		  m_overflowCount(0),
+		  m_highWater(0) {
+		ASSERT((i_size & (i_size - 1)) == 0);
+		for (LONG i = 0; i < i_size; ++ i)
+			m_cells[i].m_sequence = i;
+		CHECK_TRUE( m_event = CreateEvent(NULL, FALSE, FALSE, NULL) );
+	}
+	///
+	~InputQueue() {
+		CHECK_TRUE( CloseHandle(m_event) );
+	}
+
+	/// start accepting data
+	void open() {
+		InterlockedExchange(&m_isOpened, 1);
+	}
+
+	/// stop accepting data and wake the consumer up to terminate
+	void close() {
+		InterlockedExchange(&m_isOpened, 0);
+		InterlockedExchange(&m_isWaiting, 0);
+		SetEvent(m_event);
+	}
+
+	///
+	bool isOpened() const {
+		return !!m_isOpened;
+	}
+
+	/** push i_count elements (all or nothing).
+	    @return false if the queue is closed or there is no room */
+	bool push(const T *i_data, LONG i_count = 1) {
+		ASSERT(0 < i_count && i_count <= i_size);
+		if (!m_isOpened)
+			return false;
+
+		// claim [pos, pos + i_count).  slots are freed by the single
+		// consumer in order, so the last slot being free implies that
+		// the preceding ones are free too.
+		LONG pos = m_enqueuePos;
+		while (true) {
+			Cell *last = &m_cells[(pos + i_count - 1) & (i_size - 1)];
+			LONG diff = last->m_sequence - (pos + i_count - 1);
+			if (diff == 0) {
+				LONG prev =
+					InterlockedCompareExchange(&m_enqueuePos, pos + i_count, pos);
+				if (prev == pos)
+					break;
+				pos = prev;
+			} else if (diff < 0) {
+				InterlockedExchangeAdd(&m_overflowCount, i_count);
+				return false;
+			} else
+				pos = m_enqueuePos;
+		}
+
+		for (LONG i = 0; i < i_count; ++ i) {
+			Cell *cell = &m_cells[(pos + i) & (i_size - 1)];
+			cell->m_data = i_data[i];
+			InterlockedExchange(&cell->m_sequence, pos + i + 1);
+		}
+		updateHighWater(pos + i_count - m_dequeuePos);
+		notify();
+		return true;
+	}
+
+	/// push an element
+	bool push(const T &i_data) {
+		return push(&i_data, 1);
+	}
+
+	/** pop an element (consumer thread only).
+	    @return false if no element is available */
+	bool pop(T *o_data) {
+		LONG pos = m_dequeuePos;
+		Cell *cell = &m_cells[pos & (i_size - 1)];
+		if (cell->m_sequence - (pos + 1) < 0)
+			return false;
+		*o_data = cell->m_data;
+		InterlockedExchange(&cell->m_sequence, pos + i_size);
+		InterlockedExchange(&m_dequeuePos, pos + 1);
+		return true;
+	}
+
+	/** sleep until something is pushed (consumer thread only).
+	    @return false if the queue has been closed */
+	bool wait() {
+		InterlockedExchange(&m_isWaiting, 1);
+		// re-check after publishing m_isWaiting, or we may miss a notify()
+		Cell *cell = &m_cells[m_dequeuePos & (i_size - 1)];
+		if (0 <= cell->m_sequence - (m_dequeuePos + 1) || !m_isOpened)
+			InterlockedExchange(&m_isWaiting, 0);
+		else
+			WaitForSingleObject(m_event, INFINITE);
+		return !!m_isOpened;
+	}
+
+	/** make wait() return once even if nothing is pushed, so that the
+	    consumer looks at something else it is told of */
+	void wakeUp() {
+		InterlockedExchange(&m_isWaiting, 0);
+		SetEvent(m_event);
+	}
+
+	/// number of events dropped because the queue was full
+	LONG getOverflowCount() const {
+		return m_overflowCount;
+	}
+
+	/// maximum number of events that were queued at once
+	LONG getHighWater() const {
+		return m_highWater;
+	}
+
+	///
+	LONG getCapacity() const {
+		return i_size;
+	}
+};
+
+
+#endif // !_INPUTQUEUE_H
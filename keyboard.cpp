@@ -57,6 +57,9 @@ bool Key::isSameScanCode(const Key &i_key) const
 // is the key's scan code the prefix of this key's scan code ?
 bool Key::isPrefixScanCode(const Key &i_key) const
 {
+	// the unused slots of m_scanCodes must not be compared
+	if (m_scanCodesSize < i_key.m_scanCodesSize)
+		return false;
 	for (size_t i = 0; i < i_key.m_scanCodesSize; ++ i)
 		if (m_scanCodes[i] != i_key.m_scanCodes[i])
 			return false;
@@ -97,14 +100,7 @@ Modifier::Modifier()
 // add m's modifiers where this dontcare
 void Modifier::add(const Modifier &i_m)
 {
-	for (int i = 0; i < Type_end; ++ i) {
-		if (isDontcare(static_cast<Modifier::Type>(i)))
-			if (!i_m.isDontcare(static_cast<Modifier::Type>(i)))
-				if (i_m.isPressed(static_cast<Modifier::Type>(i)))
-					press(static_cast<Modifier::Type>(i));
-				else
-					release(static_cast<Modifier::Type>(i));
-	}
+	press(m_dontcares & ~i_m.m_dontcares, i_m.m_modifiers);
 }
 
 // stream output
@@ -205,7 +201,7 @@ tostream &operator<<(tostream &i_ost, Modifier::Type i_type)
 	};
 
 	int i = static_cast<int>(i_type);
-	if (0 <= i && i < NUMBER_OF(modNames))
+	if (0 <= i && i < static_cast<int>(NUMBER_OF(modNames)))
 		i_ost << modNames[i];
 
 	return i_ost;
@@ -280,10 +276,28 @@ Keyboard::Keys &Keyboard::getKeys(const Key &i_key)
 }
 
 
+Keyboard::Keyboard()
+{
+	for (size_t i = 0; i < NUMBER_OF(m_scanCodeTable); ++ i)
+		m_scanCodeTable[i] = NULL;
+}
+
+
 // add a key
 void Keyboard::addKey(const Key &i_key)
 {
-	getKeys(i_key).push_front(i_key);
+	Keys &keys = getKeys(i_key);
+	keys.push_front(i_key);
+	Key *key = &keys.front();
+	key->setId(static_cast<int>(m_keysById.size()));
+	m_keysById.push_back(key);
+
+	if (key->getScanCodesSize() == 1) {
+		int index = getScanCodeTableIndex(key->getScanCodes()[0]);
+		if (0 <= index)
+			m_scanCodeTable[index] = key;
+	} else
+		m_multiScanCodeKeys.insert(m_multiScanCodeKeys.begin(), key);
 }
 
 
@@ -312,25 +326,56 @@ void Keyboard::addModifier(Modifier::Type i_mt, Key *i_key)
 }
 
 
-// search a key
-Key *Keyboard::searchKey(const Key &i_key)
+// search a key in m_hashedKeys
+Key *Keyboard::searchKeyInHashedKeys(const Key &i_key, bool i_isPrefix)
 {
 	Keys &keys = getKeys(i_key);
 	for (Keys::iterator i = keys.begin(); i != keys.end(); ++ i)
-		if ((*i).isSameScanCode(i_key))
+		if (i_isPrefix ? (*i).isPrefixScanCode(i_key) :
+				(*i).isSameScanCode(i_key))
 			return &*i;
 	return NULL;
 }
 
 
+// search a key
+Key *Keyboard::searchKey(const Key &i_key)
+{
+	if (i_key.getScanCodesSize() == 1) {
+		int index = getScanCodeTableIndex(i_key.getScanCodes()[0]);
+		if (0 <= index)
+			return m_scanCodeTable[index];
+	} else {
+		for (KeyPointers::iterator i = m_multiScanCodeKeys.begin();
+				i != m_multiScanCodeKeys.end(); ++ i)
+			if ((*i)->isSameScanCode(i_key))
+				return *i;
+		return NULL;
+	}
+	return searchKeyInHashedKeys(i_key, false);
+}
+
+
 // search a key (of which the key's scan code is the prefix)
 Key *Keyboard::searchPrefixKey(const Key &i_key)
 {
-	Keys &keys = getKeys(i_key);
-	for (Keys::iterator i = keys.begin(); i != keys.end(); ++ i)
-		if ((*i).isPrefixScanCode(i_key))
-			return &*i;
-	return NULL;
+	Key *key = NULL;
+	if (i_key.getScanCodesSize() == 1) {
+		int index = getScanCodeTableIndex(i_key.getScanCodes()[0]);
+		if (index < 0)
+			return searchKeyInHashedKeys(i_key, true);
+		key = m_scanCodeTable[index];
+	}
+
+	// the last added key is found first as in m_hashedKeys
+	for (KeyPointers::iterator i = m_multiScanCodeKeys.begin();
+			i != m_multiScanCodeKeys.end(); ++ i)
+		if ((*i)->isPrefixScanCode(i_key)) {
+			if (!key || key->getId() < (*i)->getId())
+				key = *i;
+			break;
+		}
+	return key;
 }
 
 
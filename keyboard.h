@@ -11,6 +11,7 @@
 #  include <vector>
 #  include <list>
 #  include <map>
+#  include <algorithm>
 
 
 /// a scan code with flags
@@ -54,6 +55,8 @@ public:
 	enum {
 		///
 		MAX_SCAN_CODES_SIZE = 4,
+		/// id of a key which is not in a Keyboard
+		ID_NONE = -1,
 	};
 
 private:
@@ -75,6 +78,8 @@ private:
 	size_t m_scanCodesSize;
 	/// key scan code
 	ScanCode m_scanCodes[MAX_SCAN_CODES_SIZE];
+	/// dense index in the Keyboard (ID_NONE if not in a Keyboard)
+	int m_id;
 
 public:
 	///
@@ -82,14 +87,16 @@ public:
 			: m_isPressed(false),
 			m_isPressedOnWin32(false),
 			m_isPressedByAssign(false),
-			m_scanCodesSize(0) { }
+			m_scanCodesSize(0),
+			m_id(ID_NONE) { }
 
 	/// for Event::* only
 	Key(const tstringi &i_name)
 			: m_isPressed(false),
 			m_isPressedOnWin32(false),
 			m_isPressedByAssign(false),
-			m_scanCodesSize(0) {
+			m_scanCodesSize(0),
+			m_id(ID_NONE) {
 		addName(i_name);
 		addScanCode(ScanCode());
 	}
@@ -108,6 +115,15 @@ public:
 		return m_scanCodesSize;
 	}
 
+	/// get the index in the Keyboard (0 .. Keyboard::getKeysSize() - 1)
+	int getId() const {
+		return m_id;
+	}
+	/// for Keyboard only
+	void setId(int i_id) {
+		m_id = i_id;
+	}
+
 	/// add a name of key
 	void addName(const tstringi &i_name);
 
@@ -140,11 +156,70 @@ public:
 };
 
 
+/// a set of keys of a Keyboard (a bitset indexed by Key::getId())
+class KeyIdSet
+{
+	///
+	typedef u_int32 Word;
+	///
+	enum {
+		WORD_BITS = sizeof(Word) * 8,		///
+	};
+	///
+	typedef std::vector<Word> Words;
+
+	Words m_words;				///
+
+public:
+	/// make room for the keys of ids 0 .. i_size - 1 and clear all
+	void reset(size_t i_size) {
+		m_words.assign((i_size + WORD_BITS - 1) / WORD_BITS, 0);
+	}
+
+	/// add or remove a key.  keys out of the range are ignored
+	void set(int i_id, bool i_isIn) {
+		size_t i = static_cast<size_t>(i_id) / WORD_BITS;
+		if (i_id < 0 || m_words.size() <= i)
+			return;
+		Word bit = Word(1) << (i_id % WORD_BITS);
+		if (i_isIn)
+			m_words[i] |= bit;
+		else
+			m_words[i] &= ~bit;
+	}
+
+	/// is the key in this set ?
+	bool test(int i_id) const {
+		size_t i = static_cast<size_t>(i_id) / WORD_BITS;
+		if (i_id < 0 || m_words.size() <= i)
+			return false;
+		return !!(m_words[i] & (Word(1) << (i_id % WORD_BITS)));
+	}
+
+	///
+	void swap(KeyIdSet &io_set) {
+		m_words.swap(io_set.m_words);
+	}
+
+	/// do this and i_set have a key in common ?
+	bool intersects(const KeyIdSet &i_set) const {
+		size_t size = std::min(m_words.size(), i_set.m_words.size());
+		for (size_t i = 0; i < size; ++ i)
+			if (m_words[i] & i_set.m_words[i])
+				return true;
+		return false;
+	}
+};
+
+
 ///
 class Modifier
 {
-	///
+public:
+	/// a bit per Type
 	typedef u_int64 MODIFIERS;
+
+private:
 	///
 	MODIFIERS m_modifiers;
 	///
@@ -252,6 +327,17 @@ public:
 	Modifier &care(Type i_type, bool i_doCare) {
 		return i_doCare ? care(i_type) : dontcare(i_type);
 	}
+	/// press the modifiers of i_pressed and release the others in i_mask
+	Modifier &press(MODIFIERS i_mask, MODIFIERS i_pressed) {
+		m_modifiers = (m_modifiers & ~i_mask) | (i_pressed & i_mask);
+		m_dontcares &= ~i_mask;
+		return *this;
+	}
+
+	///
+	static MODIFIERS getMask(Type i_type) {
+		return MODIFIERS(1) << i_type;
+	}
 
 	///
 	bool operator==(const Modifier &i_m) const {
@@ -345,8 +431,12 @@ private:
 	    of Key's elements must be fixed.  */
 	enum {
 		HASHED_KEYS_SIZE = 128,			///
+		/** size of m_scanCodeTable: 256 scan codes for each of
+		    none/E0/E1/E0E1 */
+		SCAN_CODE_TABLE_SIZE = 256 * 4,
 	};
 	typedef std::list<Key> Keys;			///
+	typedef std::vector<Key *> KeyPointers;	///
 	typedef std::map<tstringi, Key *> Aliases;	/// key name aliases
 	///
 	class Substitute
@@ -364,6 +454,13 @@ private:
 
 private:
 	Keys m_hashedKeys[HASHED_KEYS_SIZE];		///
+	KeyPointers m_keysById;			/// indexed by Key::getId()
+	/** keys of one scan code indexed by getScanCodeTableIndex().
+	    if several keys have the same scan code, the last added one is
+	    stored like searchKey() finds it first. */
+	Key *m_scanCodeTable[SCAN_CODE_TABLE_SIZE];
+	KeyPointers m_multiScanCodeKeys;		/** keys of several scan
+						    codes (last added first) */
 	Aliases m_aliases;				///
 	Substitutes m_substitutes;			///
 	Key m_syncKey;				/// key used to synchronize
@@ -401,7 +498,20 @@ private:
 	///
 	Keys &getKeys(const Key &i_key);
 
+	/// index of m_scanCodeTable (-1 if out of the table)
+	static int getScanCodeTableIndex(const ScanCode &i_sc) {
+		if (256 <= i_sc.m_scan)
+			return -1;
+		return (((i_sc.m_flags & ScanCode::E0E1) >> 1) << 8) | i_sc.m_scan;
+	}
+
+	/// search a key in m_hashedKeys
+	Key *searchKeyInHashedKeys(const Key &i_key, bool i_isPrefix);
+
 public:
+	///
+	Keyboard();
+
 	/// add a key
 	void addKey(const Key &i_key);
 
@@ -440,6 +550,17 @@ public:
 		return m_mods[i_mt];
 	}
 
+	/// number of keys (the ids of the keys are 0 .. getKeysSize() - 1)
+	size_t getKeysSize() const {
+		return m_keysById.size();
+	}
+
+	/// get a key by Key::getId()
+	Key *getKeyById(int i_id) const {
+		ASSERT(0 <= i_id && i_id < static_cast<int>(m_keysById.size()));
+		return m_keysById[i_id];
+	}
+
 	/// get key iterator
 	KeyIterator getKeyIterator() {
 		return KeyIterator(&m_hashedKeys[0], HASHED_KEYS_SIZE);
@@ -78,7 +78,8 @@ ActionFunction::ActionFunction(FunctionData *i_functionData,
 //
 ActionFunction::~ActionFunction()
 {
-	delete m_functionData;
+	if (m_functionData && !m_functionData->isShared())
+		delete m_functionData;
 }
 
 //
@@ -178,6 +179,67 @@ ModifiedKey KeySeq::getFirstModifiedKey() const
 }
 
 
+// does i_a do the same as i_b ?
+static bool isSameAction(const Action *i_a, const Action *i_b)
+{
+	if (i_a->getType() != i_b->getType())
+		return false;
+	switch (i_a->getType()) {
+	case Action::Type_key:
+		return (reinterpret_cast<const ActionKey *>(i_a)->m_modifiedKey ==
+				reinterpret_cast<const ActionKey *>(i_b)->m_modifiedKey);
+	case Action::Type_keySeq:
+		return (reinterpret_cast<const ActionKeySeq *>(i_a)->m_keySeq ==
+				reinterpret_cast<const ActionKeySeq *>(i_b)->m_keySeq);
+	case Action::Type_function: {
+		const ActionFunction *a = reinterpret_cast<const ActionFunction *>(i_a);
+		const ActionFunction *b = reinterpret_cast<const ActionFunction *>(i_b);
+		return (a->m_functionData->isShared() &&
+				a->m_functionData == b->m_functionData &&
+				a->m_modifier == b->m_modifier);
+	}
+	}
+	return false;
+}
+
+
+// does this do the same as i_ks ?
+bool KeySeq::isSame(const KeySeq &i_ks) const
+{
+	if (m_mode != i_ks.m_mode || m_actions.size() != i_ks.m_actions.size())
+		return false;
+	for (size_t i = 0; i < m_actions.size(); ++ i)
+		if (!isSameAction(m_actions[i], i_ks.m_actions[i]))
+			return false;
+	return true;
+}
+
+
+// hash value for isSame()
+size_t KeySeq::getHash() const
+{
+	size_t hash = m_mode;
+	for (Actions::const_iterator
+			i = m_actions.begin(); i != m_actions.end(); ++ i) {
+		const void *p = NULL;
+		switch ((*i)->getType()) {
+		case Action::Type_key:
+			p = reinterpret_cast<const ActionKey *>(*i)->m_modifiedKey.m_key;
+			break;
+		case Action::Type_keySeq:
+			p = reinterpret_cast<const ActionKeySeq *>(*i)->m_keySeq;
+			break;
+		case Action::Type_function:
+			p = reinterpret_cast<const ActionFunction *>(*i)->m_functionData;
+			break;
+		}
+		hash = hash * 31 + (*i)->getType();
+		hash = hash * 31 + reinterpret_cast<size_t>(p);
+	}
+	return hash;
+}
+
+
 // stream output
 tostream &operator<<(tostream &i_ost, const KeySeq &i_ks)
 {
@@ -188,6 +250,293 @@ tostream &operator<<(tostream &i_ost, const KeySeq &i_ks)
 }
 
 
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// WindowPattern
+
+
+// does i_str contain a character where ^ or $ of tregex also match ?
+static bool hasLineSeparator(const tstring &i_str)
+{
+	for (tstring::const_iterator i = i_str.begin(); i != i_str.end(); ++ i) {
+		switch (static_cast<_TUCHAR>(*i)) {
+		case _T('\n'): case _T('\r'): case _T('\f'): case _T('\v'):
+		case 0x85:
+#ifdef _UNICODE
+		case 0x2028: case 0x2029:
+#endif // _UNICODE
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* get the string i_pattern matches if it is ^?literal$? .
+   the literal must be printable ASCII and may contain escaped
+   metacharacters. */
+static bool getLiteral(const tstring &i_pattern, WindowPattern::Type *o_type,
+					   tstring *o_literal)
+{
+	size_t i = 0;
+	size_t end = i_pattern.size();
+	bool isBeginAnchored = (0 < end && i_pattern[0] == _T('^'));
+	bool isEndAnchored = false;
+	if (isBeginAnchored)
+		++ i;
+	o_literal->erase();
+	for (; i < end; ++ i) {
+		_TCHAR c = i_pattern[i];
+		if (c == _T('$') && i + 1 == end) {
+			isEndAnchored = true;
+			break;
+		}
+		if (c == _T('\\')) {
+			if (i + 1 == end ||
+					!_tcschr(_T("\\.[]{}()*+?|^$/-:#, "), i_pattern[i + 1]))
+				return false;			// \d, \w, \<, ...
+			c = i_pattern[++ i];
+		} else if (c < 0x20 || 0x7e < c || _tcschr(_T(".[]{}()*+?|^$"), c))
+			return false;
+		*o_literal += c;
+	}
+
+	if (isBeginAnchored)
+		*o_type = isEndAnchored ? WindowPattern::Type_exact :
+			WindowPattern::Type_prefix;
+	else
+		*o_type = isEndAnchored ? WindowPattern::Type_suffix :
+			WindowPattern::Type_substring;
+	return true;
+}
+
+
+/* is i_pattern a regexp tregex surely compiles ?
+   this accepts only the common syntax: literals, escaped punctuation,
+   \d \w \s, ., simple [...], groups without (?, | and * + ? .  false
+   means "unknown", not "invalid". */
+static bool isSimpleRegexp(const tstring &i_pattern)
+{
+	size_t end = i_pattern.size();
+	int depth = 0;
+	bool canRepeat = false;
+	for (size_t i = 0; i < end; ++ i) {
+		_TCHAR c = i_pattern[i];
+		switch (c) {
+		case _T('('):
+			if (i + 1 < end && i_pattern[i + 1] == _T('?'))
+				return false;
+			++ depth;
+			canRepeat = false;
+			break;
+		case _T(')'):
+			if (depth == 0)
+				return false;
+			-- depth;
+			canRepeat = true;
+			break;
+		case _T('|'): case _T('^'): case _T('$'):
+			canRepeat = false;
+			break;
+		case _T('*'): case _T('+'): case _T('?'):
+			if (!canRepeat)
+				return false;
+			if (i + 1 < end && (i_pattern[i + 1] == _T('?') ||
+								i_pattern[i + 1] == _T('+')))
+				++ i;					// lazy or possessive
+			canRepeat = false;
+			break;
+		case _T('.'):
+			canRepeat = true;
+			break;
+		case _T('\\'):
+			if (i + 1 == end ||
+					!_tcschr(_T("\\.[]{}()*+?|^$/-:#, dDwWsS"), i_pattern[i + 1]))
+				return false;
+			++ i;
+			canRepeat = true;
+			break;
+		case _T('['):
+		{
+			++ i;
+			if (i < end && i_pattern[i] == _T('^'))
+				++ i;
+			if (i < end && i_pattern[i] == _T(']'))
+				return false;			// may begin a range
+			for (size_t begin = i; i < end && i_pattern[i] != _T(']'); ++ i) {
+				_TCHAR from = i_pattern[i];
+				if (from == _T('[') || from == _T('\\') ||
+						from < 0x20 || 0x7e < from)
+					return false;
+				if (from == _T('-') && begin < i &&
+						i + 1 < end && i_pattern[i + 1] != _T(']'))
+					return false;			// [a-b-c]
+				if (i + 2 < end && i_pattern[i + 1] == _T('-') &&
+						i_pattern[i + 2] != _T(']')) {
+					_TCHAR to = i_pattern[i + 2];
+					if (!((_T('0') <= from && to <= _T('9')) ||
+						  (_T('a') <= from && to <= _T('z')) ||
+						  (_T('A') <= from && to <= _T('Z'))) || to < from)
+						return false;
+					i += 2;
+				}
+			}
+			if (i == end)
+				return false;
+			canRepeat = true;
+			break;
+		}
+		case _T('{'): case _T('}'): case _T(']'):
+			return false;
+		default:
+#ifdef _UNICODE
+			if (c < 0x20)
+#else // !_UNICODE
+			if (c < 0x20 || 0x7e < c)	// may be a lead byte
+#endif // !_UNICODE
+				return false;
+			canRepeat = true;
+			break;
+		}
+	}
+	return depth == 0;
+}
+
+
+WindowPattern::WindowPattern()
+	: m_type(Type_any),
+	  m_source(_T(".*")),
+	  m_regex(NULL)
+{
+}
+
+
+WindowPattern::WindowPattern(const WindowPattern &i_wp)
+	: m_type(i_wp.m_type),
+	  m_source(i_wp.m_source),
+	  m_literal(i_wp.m_literal),
+	  m_regex(i_wp.m_regex ? new tregex(*i_wp.m_regex) : NULL)
+{
+}
+
+
+WindowPattern::~WindowPattern()
+{
+	delete m_regex;
+}
+
+
+WindowPattern &WindowPattern::operator=(const WindowPattern &i_wp)
+{
+	if (this != &i_wp) {
+		tregex *regex = i_wp.m_regex ? new tregex(*i_wp.m_regex) : NULL;
+		delete m_regex;
+		m_type = i_wp.m_type;
+		m_source = i_wp.m_source;
+		m_literal = i_wp.m_literal;
+		m_regex = regex;
+	}
+	return *this;
+}
+
+
+// get m_regex (compile it if not yet)
+const tregex &WindowPattern::getRegex() const
+{
+	tregex *regex = m_regex;
+	if (regex)
+		return *regex;
+	// the threads may race to compile it; the first one wins
+	regex = new tregex(m_source, tregex::normal | tregex::icase);
+	tregex *prev = reinterpret_cast<tregex *>(
+		InterlockedCompareExchangePointer(
+			reinterpret_cast<PVOID volatile *>(&m_regex), regex, NULL));
+	if (prev) {
+		delete regex;
+		return *prev;
+	}
+	return *regex;
+}
+
+
+// set the pattern
+void WindowPattern::assign(const tstringi &i_pattern)
+{
+	Type type;
+	tstring literal;
+	if (i_pattern == _T(".*"))
+		type = Type_any;
+	else if (getLiteral(i_pattern, &type, &literal))
+		literal = toLowerAscii(literal);
+	else
+		type = Type_regex;
+
+	delete m_regex;
+	m_type = type;
+	m_source = i_pattern;
+	m_literal = literal;
+	m_regex = NULL;
+}
+
+
+// throw ErrorMessage if tregex rejects i_pattern
+void WindowPattern::validate(const tstringi &i_pattern)
+{
+	Type type;
+	tstring literal;
+	if (getLiteral(i_pattern, &type, &literal) || isSimpleRegexp(i_pattern))
+		return;
+	try {
+		tregex regex(i_pattern, tregex::normal | tregex::icase);
+	} catch (boost::bad_expression &i_e) {
+		throw ErrorMessage() << _T("`") << i_pattern << _T("': ")
+							 << i_e.what();
+	}
+}
+
+
+// does i_name match ?
+bool WindowPattern::match(const tstringi &i_name,
+						  const tstring &i_lowerName) const
+{
+	size_t size = i_lowerName.size();
+	size_t n = m_literal.size();
+	switch (m_type) {
+	case Type_any:
+		return true;
+	case Type_substring:
+		return i_lowerName.find(m_literal) != tstring::npos;
+	case Type_exact:
+	case Type_prefix:
+	case Type_suffix:
+		if (hasLineSeparator(i_name))
+			break;					// ^ and $ also match at each line
+		if (size < n)
+			return false;
+		if (m_type == Type_exact)
+			return size == n && i_lowerName == m_literal;
+		if (m_type == Type_prefix)
+			return i_lowerName.compare(0, n, m_literal) == 0;
+		return i_lowerName.compare(size - n, n, m_literal) == 0;
+	case Type_regex:
+		break;
+	}
+	tsmatch what;
+	return boost::regex_search(i_name, what, getRegex());
+}
+
+
+// lower the ASCII characters of i_str
+tstring WindowPattern::toLowerAscii(const tstring &i_str)
+{
+	// tregex::icase lowers each _TCHAR, even a trail byte of MBCS
+	tstring str(i_str);
+	for (tstring::iterator i = str.begin(); i != str.end(); ++ i)
+		if (_T('A') <= *i && *i <= _T('Z'))
+			*i = static_cast<_TCHAR>(*i - _T('A') + _T('a'));
+	return str;
+}
+
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Keymap
 
@@ -217,21 +566,14 @@ Keymap::Keymap(Type i_type,
 		: m_type(i_type),
 		m_name(i_name),
 		m_defaultKeySeq(i_defaultKeySeq),
-		m_parentKeymap(i_parentKeymap),
-		m_windowClass(_T(".*")),
-		m_windowTitle(_T(".*"))
-{
-	if (i_type == Type_windowAnd || i_type == Type_windowOr)
-		try {
-			tregex::flag_type f = (tregex::normal |
-								   tregex::icase);
-			if (!i_windowClass.empty())
-				m_windowClass.assign(i_windowClass, f);
-			if (!i_windowTitle.empty())
-				m_windowTitle.assign(i_windowTitle, f);
-		} catch (boost::bad_expression &i_e) {
-			throw ErrorMessage() << i_e.what();
-		}
+		m_parentKeymap(i_parentKeymap)
+{
+	if (i_type == Type_windowAnd || i_type == Type_windowOr) {
+		if (!i_windowClass.empty())
+			m_windowClass.assign(i_windowClass);
+		if (!i_windowTitle.empty())
+			m_windowTitle.assign(i_windowTitle);
+	}
 }
 
 
@@ -245,6 +587,7 @@ void Keymap::addAssignment(const ModifiedKey &i_mk, KeySeq *i_keySeq)
 			return;
 		}
 	ka.push_front(KeyAssignment(i_mk, i_keySeq));
+	m_compiledIndex.clear();			// must be compiled again
 }
 
 
@@ -268,12 +611,13 @@ void Keymap::addModifier(Modifier::Type i_mt, AssignOperator i_ao,
 	ma.m_assignMode = i_am;
 	ma.m_key = i_key;
 	m_modAssignments[i_mt].push_back(ma);
+	m_modifierIndex.clear();			// must be compiled again
 }
 
 
-// search
+// search m_hashedKeyAssignments
 const Keymap::KeyAssignment *
-Keymap::searchAssignment(const ModifiedKey &i_mk) const
+Keymap::searchAssignmentInList(const ModifiedKey &i_mk) const
 {
 	const KeyAssignments &ka = getKeyAssignments(i_mk);
 	for (KeyAssignments::const_iterator i = ka.begin(); i != ka.end(); ++ i)
@@ -284,24 +628,156 @@ Keymap::searchAssignment(const ModifiedKey &i_mk) const
 }
 
 
+// search
+const Keymap::KeyAssignment *
+Keymap::searchAssignment(const ModifiedKey &i_mk) const
+{
+	int id = i_mk.m_key->getId();
+	if (id < 0 || m_compiledIndex.size() <= static_cast<size_t>(id) + 1)
+		return searchAssignmentInList(i_mk);	// events or not compiled
+
+	// test/test_keymap.cpp checks that this finds what the lists find
+	for (size_t i = m_compiledIndex[id]; i < m_compiledIndex[id + 1]; ++ i)
+		if (m_compiledAssignments[i].m_modifier.doesMatch(i_mk.m_modifier))
+			return m_compiledAssignments[i].m_keyAssignment;
+	return NULL;
+}
+
+
+// search the modifier assigned to i_key
+bool Keymap::searchModifier(const Key *i_key, Modifier::Type *o_mt,
+							AssignMode *o_am) const
+{
+	int id = i_key->getId();
+	if (0 <= id && static_cast<size_t>(id) < m_modifierIndex.size()) {
+		const ModifierOfKey &mok = m_modifierIndex[id];
+		*o_mt = mok.m_type;
+		*o_am = mok.m_assignMode;
+		return mok.m_type != Modifier::Type_end;
+	}
+
+	// not compiled
+	for (int i = Modifier::Type_begin; i != Modifier::Type_end; ++ i) {
+		const ModAssignments &ma = m_modAssignments[i];
+		for (ModAssignments::const_iterator j = ma.begin(); j != ma.end(); ++ j)
+			if ((*j).m_key == i_key) {
+				*o_mt = static_cast<Modifier::Type>(i);
+				*o_am = (*j).m_assignMode;
+				return true;
+			}
+	}
+	*o_mt = Modifier::Type_end;
+	*o_am = AM_notModifier;
+	return false;
+}
+
+
+// is any key of the modifier i_mt pressed ?
+bool Keymap::isModifierPressed(Modifier::Type i_mt,
+							   const KeyIdSet &i_pressedKeys) const
+{
+	if (!m_modifierIndex.empty())
+		return m_modifierKeys[i_mt].intersects(i_pressedKeys);
+
+	// not compiled
+	const ModAssignments &ma = m_modAssignments[i_mt];
+	for (ModAssignments::const_iterator i = ma.begin(); i != ma.end(); ++ i)
+		if ((*i).m_key->m_isPressed)
+			return true;
+	return false;
+}
+
+
+// get all the modifiers i_key is assigned to
+bool Keymap::getModifierMask(const Key *i_key,
+							 Modifier::MODIFIERS *o_mask) const
+{
+	if (m_modifierIndex.empty())
+		return false;
+	int id = i_key->getId();
+	if (0 <= id && static_cast<size_t>(id) < m_modifierIndex.size())
+		*o_mask = m_modifierIndex[id].m_mask;
+	else
+		*o_mask = 0;
+	return true;
+}
+
+
+// build the tables used by searchAssignment() and searchModifier()
+void Keymap::compile(const Keyboard &i_keyboard)
+{
+	size_t keysSize = i_keyboard.getKeysSize();
+
+	// modifier index.  the first assignment in the order of
+	// Modifier::Type wins like searchModifier() without the index.
+	m_modifierIndex.assign(keysSize, ModifierOfKey());
+	for (int i = Modifier::Type_end - 1; Modifier::Type_begin <= i; -- i) {
+		m_modifierKeys[i].reset(keysSize);
+		const ModAssignments &ma = m_modAssignments[i];
+		for (ModAssignments::const_reverse_iterator
+				j = ma.rbegin(); j != ma.rend(); ++ j) {
+			int id = (*j).m_key->getId();
+			if (id < 0 || keysSize <= static_cast<size_t>(id)) {
+				m_modifierIndex.clear();	// not a key of i_keyboard
+				break;
+			}
+			m_modifierKeys[i].set(id, true);
+			m_modifierIndex[id].m_type = static_cast<Modifier::Type>(i);
+			m_modifierIndex[id].m_assignMode = (*j).m_assignMode;
+			m_modifierIndex[id].m_mask |=
+				Modifier::getMask(static_cast<Modifier::Type>(i));
+		}
+		if (m_modifierIndex.empty())
+			break;
+	}
+
+	// count assignments of each key
+	m_compiledIndex.assign(keysSize + 1, 0);
+	for (size_t i = 0; i < HASHED_KEY_ASSIGNMENT_SIZE; ++ i) {
+		const KeyAssignments &ka = m_hashedKeyAssignments[i];
+		for (KeyAssignments::const_iterator j = ka.begin(); j != ka.end(); ++ j) {
+			int id = j->m_modifiedKey.m_key->getId();
+			if (0 <= id && static_cast<size_t>(id) < keysSize)
+				++ m_compiledIndex[id + 1];
+		}
+	}
+	for (size_t i = 0; i < keysSize; ++ i)
+		m_compiledIndex[i + 1] += m_compiledIndex[i];
+
+	// all assignments of a key are in the same list, so the order of the
+	// list is kept
+	std::vector<size_t> next(m_compiledIndex.begin(), m_compiledIndex.end() - 1);
+	m_compiledAssignments.resize(m_compiledIndex[keysSize]);
+	for (size_t i = 0; i < HASHED_KEY_ASSIGNMENT_SIZE; ++ i) {
+		const KeyAssignments &ka = m_hashedKeyAssignments[i];
+		for (KeyAssignments::const_iterator j = ka.begin(); j != ka.end(); ++ j) {
+			int id = j->m_modifiedKey.m_key->getId();
+			if (0 <= id && static_cast<size_t>(id) < keysSize)
+				m_compiledAssignments[next[id] ++] = CompiledAssignment(&*j);
+		}
+	}
+}
+
+
 // does same window
-bool Keymap::doesSameWindow(const tstringi i_className,
-							const tstringi &i_titleName)
+bool Keymap::doesSameWindow(const tstringi &i_className,
+							const tstringi &i_titleName,
+							const tstring &i_lowerClassName,
+							const tstring &i_lowerTitleName) const
 {
 	if (m_type == Type_keymap)
 		return false;
 
-	tsmatch what;
-	if (boost::regex_search(i_className, what, m_windowClass)) {
+	if (m_windowClass.match(i_className, i_lowerClassName)) {
 		if (m_type == Type_windowAnd)
-			return boost::regex_search(i_titleName, what, m_windowTitle);
+			return m_windowTitle.match(i_titleName, i_lowerTitleName);
 		else // type == Type_windowOr
 			return true;
 	} else {
 		if (m_type == Type_windowAnd)
 			return false;
 		else // type == Type_windowOr
-			return boost::regex_search(i_titleName, what, m_windowTitle);
+			return m_windowTitle.match(i_titleName, i_lowerTitleName);
 	}
 }
 
@@ -499,11 +975,96 @@ extern tostream &operator<<(tostream &i_ost, const Keymap *i_keymap)
 // Keymaps
 
 
+// add the keymap at i_position whose pattern is i_wp
+bool Keymaps::WindowIndex::add(const WindowPattern &i_wp, size_t i_position)
+{
+	const tstring &literal = i_wp.getLowerLiteral();
+	switch (i_wp.getType()) {
+	case WindowPattern::Type_exact:
+		m_exact[literal].push_back(i_position);
+		return true;
+	case WindowPattern::Type_prefix:
+		m_prefix[literal.size()][literal].push_back(i_position);
+		return true;
+	case WindowPattern::Type_suffix:
+		m_suffix[literal.size()][literal].push_back(i_position);
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+// add the positions of the keymaps whose pattern may match a name
+void Keymaps::WindowIndex::search(const tstring &i_lowerName,
+								  std::vector<size_t> *io_positions) const
+{
+	size_t size = i_lowerName.size();
+	Literals::const_iterator l = m_exact.find(i_lowerName);
+	if (l != m_exact.end())
+		io_positions->insert(io_positions->end(),
+							 l->second.begin(), l->second.end());
+	for (LiteralsBySize::const_iterator i = m_prefix.begin();
+			i != m_prefix.end() && i->first <= size; ++ i) {
+		l = i->second.find(i_lowerName.substr(0, i->first));
+		if (l != i->second.end())
+			io_positions->insert(io_positions->end(),
+								 l->second.begin(), l->second.end());
+	}
+	for (LiteralsBySize::const_iterator i = m_suffix.begin();
+			i != m_suffix.end() && i->first <= size; ++ i) {
+		l = i->second.find(i_lowerName.substr(size - i->first));
+		if (l != i->second.end())
+			io_positions->insert(io_positions->end(),
+								 l->second.begin(), l->second.end());
+	}
+}
+
+
+// clear
+void Keymaps::WindowIndex::clear()
+{
+	m_exact.clear();
+	m_prefix.clear();
+	m_suffix.clear();
+}
+
+
 Keymaps::Keymaps()
+		: m_windowCacheHitCount(0),
+		m_windowCacheMissCount(0),
+		m_isWindowIndexed(false)
 {
 }
 
 
+// build m_windowKeymaps and the indexes
+void Keymaps::indexWindows()
+{
+	m_windowKeymaps.clear();
+	m_unindexedWindowKeymaps.clear();
+	m_windowClassIndex.clear();
+	m_windowTitleIndex.clear();
+	for (KeymapList::iterator
+			i = m_keymapList.begin(); i != m_keymapList.end(); ++ i) {
+		if ((*i).getType() == Keymap::Type_keymap)
+			continue;
+		size_t position = m_windowKeymaps.size();
+		m_windowKeymaps.push_back(&*i);
+		// a window || may match by either name, so it is not indexed
+		if ((*i).getType() == Keymap::Type_windowAnd) {
+			if (m_windowClassIndex.add((*i).getWindowClass(), position))
+				continue;
+			if ((*i).getWindowClass().getType() == WindowPattern::Type_any &&
+					m_windowTitleIndex.add((*i).getWindowTitle(), position))
+				continue;
+		}
+		m_unindexedWindowKeymaps.push_back(position);
+	}
+	m_isWindowIndexed = true;
+}
+
+
 // search by name
 Keymap *Keymaps::searchByName(const tstringi &i_name)
 {
@@ -520,11 +1081,49 @@ void Keymaps::searchWindow(KeymapPtrList *o_keymapPtrList,
 						   const tstringi &i_className,
 						   const tstringi &i_titleName)
 {
+	// the keymaps are fixed once the setting is loaded (add() clears the
+	// cache), so the result depends on the names only
+	WindowName name(i_className, i_titleName);
+	WindowCacheIndex::iterator c = m_windowCacheIndex.find(name);
+	if (c != m_windowCacheIndex.end()) {
+		InterlockedIncrement(&m_windowCacheHitCount);
+		m_windowCache.splice(m_windowCache.begin(), m_windowCache, c->second);
+		*o_keymapPtrList = c->second->m_keymapPtrList;
+		return;
+	}
+	InterlockedIncrement(&m_windowCacheMissCount);
+
+	if (!m_isWindowIndexed)
+		indexWindows();
+	tstring lowerClassName = WindowPattern::toLowerAscii(i_className);
+	tstring lowerTitleName = WindowPattern::toLowerAscii(i_titleName);
+	std::vector<size_t> positions;
+	if (hasLineSeparator(i_className) || hasLineSeparator(i_titleName)) {
+		// ^ and $ also match at each line, so the literals select nothing
+		for (size_t i = 0; i < m_windowKeymaps.size(); ++ i)
+			positions.push_back(i);
+	} else {
+		positions = m_unindexedWindowKeymaps;
+		m_windowClassIndex.search(lowerClassName, &positions);
+		m_windowTitleIndex.search(lowerTitleName, &positions);
+		std::sort(positions.begin(), positions.end());
+	}
+
 	o_keymapPtrList->clear();
-	for (KeymapList::iterator
-			i = m_keymapList.begin(); i != m_keymapList.end(); ++ i)
-		if ((*i).doesSameWindow(i_className, i_titleName))
-			o_keymapPtrList->push_back(&(*i));
+	for (std::vector<size_t>::iterator
+			i = positions.begin(); i != positions.end(); ++ i)
+		if (m_windowKeymaps[*i]->doesSameWindow(i_className, i_titleName,
+												lowerClassName,
+												lowerTitleName))
+			o_keymapPtrList->push_back(m_windowKeymaps[*i]);
+
+	if (WINDOW_CACHE_SIZE <= m_windowCache.size()) {
+		m_windowCacheIndex.erase(m_windowCache.back().m_windowName);
+		m_windowCache.pop_back();
+	}
+	m_windowCache.push_front(CachedWindow(name));
+	m_windowCache.front().m_keymapPtrList = *o_keymapPtrList;
+	m_windowCacheIndex[name] = m_windowCache.begin();
 }
 
 
@@ -533,6 +1132,9 @@ Keymap *Keymaps::add(const Keymap &i_keymap)
 {
 	if (Keymap *k = searchByName(i_keymap.getName()))
 		return k;
+	m_windowCache.clear();
+	m_windowCacheIndex.clear();
+	m_isWindowIndexed = false;
 	m_keymapList.push_front(i_keymap);
 	return &m_keymapList.front();
 }
@@ -547,6 +1149,24 @@ void Keymaps::adjustModifier(Keyboard &i_keyboard)
 }
 
 
+// compile key assignments
+void Keymaps::compile(const Keyboard &i_keyboard)
+{
+	for (KeymapList::iterator i = m_keymapList.begin();
+			i != m_keymapList.end(); ++ i)
+		(*i).compile(i_keyboard);
+}
+
+
+// get all keymaps
+void Keymaps::getKeymaps(KeymapPtrList *o_keymapPtrList)
+{
+	for (KeymapList::iterator i = m_keymapList.begin();
+			i != m_keymapList.end(); ++ i)
+		o_keymapPtrList->push_back(&*i);
+}
+
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // KeySeqs
 
@@ -558,6 +1178,20 @@ KeySeq *KeySeqs::add(const KeySeq &i_keySeq)
 		KeySeq *ks = searchByName(i_keySeq.getName());
 		if (ks)
 			return &(*ks = i_keySeq);
+	} else if (m_doesShareAnonymous) {
+		// named keyseqs may be redefined, but anonymous ones are never
+		// changed after they are added, so they can be shared
+		size_t hash = i_keySeq.getHash();
+		for (Anonymous::iterator i = m_anonymous.lower_bound(hash);
+				i != m_anonymous.end() && (*i).first == hash; ++ i)
+			if ((*i).second->isSame(i_keySeq)) {
+				++ m_sharedCount;
+				return (*i).second;
+			}
+		m_keySeqList.push_front(i_keySeq);
+		m_anonymous.insert(
+			Anonymous::value_type(hash, &m_keySeqList.front()));
+		return &m_keySeqList.front();
 	}
 	m_keySeqList.push_front(i_keySeq);
 	return &m_keySeqList.front();
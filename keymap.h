@@ -7,6 +7,7 @@
 
 #  include "keyboard.h"
 #  include "function.h"
+#  include <map>
 #  include <vector>
 
 
@@ -173,6 +174,81 @@ public:
 	Modifier::Type getMode() const {
 		return m_mode;
 	}
+
+	/** does this do the same as i_ks ?  a function action is the same
+	    only if its function data is shared, the others are never
+	    compared */
+	bool isSame(const KeySeq &i_ks) const;
+
+	/// hash value for isSame()
+	size_t getHash() const;
+};
+
+
+/** a window class name or title name pattern of a keymap.
+    most patterns are plain strings with optional ^ and $ (e.g. /:Edit$/),
+    so they are matched by comparing strings instead of running the
+    regexp.  the regexp is compiled when it is used first. */
+class WindowPattern
+{
+public:
+	///
+	enum Type {
+		Type_any,					/// .*
+		Type_exact,					/// ^literal$
+		Type_prefix,				/// ^literal
+		Type_suffix,				/// literal$
+		Type_substring,				/// literal
+		Type_regex,					/// anything else
+	};
+
+private:
+	Type m_type;					///
+	tstring m_source;				/// the pattern
+	tstring m_literal;				/// in lower case (ASCII only)
+	mutable tregex * volatile m_regex;		/// NULL if not compiled yet
+
+private:
+	/// get m_regex (compile it if not yet)
+	const tregex &getRegex() const;
+
+public:
+	///
+	WindowPattern();
+	///
+	WindowPattern(const WindowPattern &i_wp);
+	///
+	~WindowPattern();
+	///
+	WindowPattern &operator=(const WindowPattern &i_wp);
+
+	/** set the pattern.
+	    i_pattern must have passed validate(); it is not compiled here. */
+	void assign(const tstringi &i_pattern);
+
+	/** throw ErrorMessage if tregex rejects i_pattern.
+	    a pattern whose syntax cannot be checked cheaply is compiled. */
+	static void validate(const tstringi &i_pattern);
+
+	/** does i_name match ?
+	    i_lowerName must be toLowerAscii(i_name). */
+	bool match(const tstringi &i_name, const tstring &i_lowerName) const;
+
+	///
+	Type getType() const {
+		return m_type;
+	}
+	/// the literal of the types but Type_any and Type_regex, in lower case
+	const tstring &getLowerLiteral() const {
+		return m_literal;
+	}
+	/// the pattern
+	const tstring &str() const {
+		return m_source;
+	}
+
+	/// lower the ASCII characters of i_str
+	static tstring toLowerAscii(const tstring &i_str);
 };
 
 
@@ -257,16 +333,64 @@ private:
 		HASHED_KEY_ASSIGNMENT_SIZE = 32,	///
 	};
 
+	/// an entry of the compiled key assignment table
+	class CompiledAssignment
+	{
+	public:
+		Modifier m_modifier;			/// to match
+		const KeyAssignment *m_keyAssignment;	///
+
+	public:
+		///
+		CompiledAssignment() : m_keyAssignment(NULL) { }
+		///
+		CompiledAssignment(const KeyAssignment *i_keyAssignment)
+				: m_modifier(i_keyAssignment->m_modifiedKey.m_modifier),
+				m_keyAssignment(i_keyAssignment) { }
+	};
+	typedef std::vector<CompiledAssignment> CompiledAssignments; ///
+
+	/// modifier of a key (an entry of m_modifierIndex)
+	class ModifierOfKey
+	{
+	public:
+		Modifier::Type m_type;			/// Type_end if not a modifier
+		AssignMode m_assignMode;		///
+		Modifier::MODIFIERS m_mask;		/// all modifiers of the key
+
+	public:
+		///
+		ModifierOfKey() : m_type(Modifier::Type_end),
+				m_assignMode(AM_notModifier),
+				m_mask(0) { }
+	};
+	typedef std::vector<ModifierOfKey> ModifierIndex; ///
+
 private:
 	KeyAssignments m_hashedKeyAssignments[HASHED_KEY_ASSIGNMENT_SIZE];	///
 
+	/** m_hashedKeyAssignments grouped by Key::getId().  the
+	    assignments of a key are in the order searchAssignment() tries
+	    them. */
+	CompiledAssignments m_compiledAssignments;
+	/** the assignments of the key whose id is i are
+	    [m_compiledIndex[i], m_compiledIndex[i + 1]) of
+	    m_compiledAssignments.  empty if not compiled. */
+	std::vector<size_t> m_compiledIndex;
+
+	/** modifier of each key indexed by Key::getId().  empty if not
+	    compiled. */
+	ModifierIndex m_modifierIndex;
+	/// keys of each m_modAssignments (valid if m_modifierIndex is)
+	KeyIdSet m_modifierKeys[Modifier::Type_ASSIGN];
+
 	/// modifier assignments
 	ModAssignments m_modAssignments[Modifier::Type_ASSIGN];
 
 	Type m_type;					/// type
 	tstringi m_name;				/// keymap name
-	tregex m_windowClass;				/// window class name regexp
-	tregex m_windowTitle;				/// window title name regexp
+	WindowPattern m_windowClass;		/// window class name regexp
+	WindowPattern m_windowTitle;		/// window title name regexp
 
 	KeySeq *m_defaultKeySeq;			/// default keySeq
 	Keymap *m_parentKeymap;			/// parent keymap
@@ -276,6 +400,8 @@ private:
 	KeyAssignments &getKeyAssignments(const ModifiedKey &i_mk);
 	///
 	const KeyAssignments &getKeyAssignments(const ModifiedKey &i_mk) const;
+	/// search m_hashedKeyAssignments
+	const KeyAssignment *searchAssignmentInList(const ModifiedKey &i_mk) const;
 
 public:
 	///
@@ -308,19 +434,53 @@ public:
 	const tstringi &getName() const {
 		return m_name;
 	}
+	///
+	Type getType() const {
+		return m_type;
+	}
+	///
+	const WindowPattern &getWindowClass() const {
+		return m_windowClass;
+	}
+	///
+	const WindowPattern &getWindowTitle() const {
+		return m_windowTitle;
+	}
 
-	/// does same window
-	bool doesSameWindow(const tstringi i_className,
-						const tstringi &i_titleName);
+	/** does same window.
+	    i_lowerClassName and i_lowerTitleName must be
+	    WindowPattern::toLowerAscii() of the names. */
+	bool doesSameWindow(const tstringi &i_className,
+						const tstringi &i_titleName,
+						const tstring &i_lowerClassName,
+						const tstring &i_lowerTitleName) const;
 
 	/// adjust modifier
 	void adjustModifier(Keyboard &i_keyboard);
 
+	/** build the table used by searchAssignment().
+	    call this after all assignments have been added. */
+	void compile(const Keyboard &i_keyboard);
+
 	/// get modAssignments
 	const ModAssignments &getModAssignments(Modifier::Type i_mt) const {
 		return m_modAssignments[i_mt];
 	}
 
+	/** search the modifier assigned to i_key.
+	    @return false if i_key is not a modifier */
+	bool searchModifier(const Key *i_key, Modifier::Type *o_mt,
+						AssignMode *o_am) const;
+
+	/** is any key of the modifier i_mt pressed ?
+	    i_pressedKeys must contain the keys whose m_isPressed is true. */
+	bool isModifierPressed(Modifier::Type i_mt,
+						   const KeyIdSet &i_pressedKeys) const;
+
+	/** get all the modifiers i_key is assigned to.
+	    @return false if this keymap is not compiled */
+	bool getModifierMask(const Key *i_key, Modifier::MODIFIERS *o_mask) const;
+
 	/// describe
 	void describe(tostream &i_ost, DescribeParam *i_dp) const;
 
@@ -341,10 +501,78 @@ public:
 
 private:
 	typedef std::list<Keymap> KeymapList;		///
+	/// class name and title name of a window
+	typedef std::pair<tstring, tstring> WindowName;
+
+	/// a result of searchWindow()
+	class CachedWindow
+	{
+	public:
+		WindowName m_windowName;			///
+		KeymapPtrList m_keymapPtrList;		///
+
+	public:
+		///
+		CachedWindow(const WindowName &i_windowName)
+			: m_windowName(i_windowName) { }
+	};
+	typedef std::list<CachedWindow> WindowCache; ///
+	typedef std::map<WindowName, WindowCache::iterator> WindowCacheIndex; ///
+
+	/** window keymaps by the literal of a pattern, so that searchWindow()
+	    tests only the keymaps whose literal is in the name */
+	class WindowIndex
+	{
+		/// positions of the keymaps by the literal
+		typedef std::map<tstring, std::vector<size_t> > Literals;
+		/// Literals by the size of the literals
+		typedef std::map<size_t, Literals> LiteralsBySize;
+
+		Literals m_exact;				///
+		LiteralsBySize m_prefix;			///
+		LiteralsBySize m_suffix;			///
+
+	public:
+		/** add the keymap at i_position whose pattern is i_wp.
+		    @return false if i_wp is not Type_exact, _prefix nor _suffix */
+		bool add(const WindowPattern &i_wp, size_t i_position);
+
+		/** add the positions of the keymaps whose pattern may match a name.
+		    i_lowerName must have no line separator. */
+		void search(const tstring &i_lowerName,
+					std::vector<size_t> *io_positions) const;
+
+		///
+		void clear();
+	};
+
+	enum {
+		WINDOW_CACHE_SIZE = 64,			/// windows in m_windowCache
+	};
 
 private:
 	KeymapList m_keymapList;			/** pointer into keymaps may
                                                     exist */
+	WindowCache m_windowCache;			/** results of searchWindow(),
+						    most recently used first */
+	WindowCacheIndex m_windowCacheIndex;		/// index of m_windowCache
+	volatile LONG m_windowCacheHitCount;		/** read by other threads
+						    than searchWindow() */
+	volatile LONG m_windowCacheMissCount;		///
+
+	bool m_isWindowIndexed;			/// are the followings valid ?
+	std::vector<Keymap *> m_windowKeymaps;	/** the window keymaps in the
+						    order of m_keymapList */
+	std::vector<size_t> m_unindexedWindowKeymaps; /** positions in
+						    m_windowKeymaps not in the
+						    indexes below */
+	WindowIndex m_windowClassIndex;		/// window && by class name
+	WindowIndex m_windowTitleIndex;		/** window && of any class by
+						    title name */
+
+private:
+	/// build m_windowKeymaps and the indexes
+	void indexWindows();
 
 public:
 	///
@@ -363,6 +591,21 @@ public:
 
 	/// adjust modifier
 	void adjustModifier(Keyboard &i_keyboard);
+
+	/// compile key assignments
+	void compile(const Keyboard &i_keyboard);
+
+	/// get all keymaps
+	void getKeymaps(KeymapPtrList *o_keymapPtrList);
+
+	/// number of searchWindow() answered by the cache
+	LONG getWindowCacheHitCount() const {
+		return m_windowCacheHitCount;
+	}
+	/// number of searchWindow() that matched all keymaps
+	LONG getWindowCacheMissCount() const {
+		return m_windowCacheMissCount;
+	}
 };
 
 
@@ -371,14 +614,41 @@ class KeySeqs
 {
 private:
 	typedef std::list<KeySeq> KeySeqList;		///
+	typedef std::multimap<size_t, KeySeq *> Anonymous; /// by getHash()
 
 private:
 	KeySeqList m_keySeqList;			///
+	Anonymous m_anonymous;			/// anonymous keyseqs
+	bool m_doesShareAnonymous;			/// share the same anonymous ones ?
+	size_t m_sharedCount;				/// how many adds were shared
 
 public:
-	/// add a named keyseq (name can be empty)
+	///
+	KeySeqs()
+		: m_doesShareAnonymous(true),
+		  m_sharedCount(0) {
+	}
+
+	/** add a named keyseq (name can be empty).  an anonymous keyseq
+	    that is the same as one already added is not added again, the
+	    one already added is returned instead. */
 	KeySeq *add(const KeySeq &i_keySeq);
 
+	/// share the same anonymous keyseqs ? (default: true)
+	void setDoesShareAnonymous(bool i_doesShareAnonymous) {
+		m_doesShareAnonymous = i_doesShareAnonymous;
+	}
+
+	/// number of the keyseqs
+	size_t getSize() const {
+		return m_keySeqList.size();
+	}
+
+	/// number of the adds that returned a keyseq already added
+	size_t getSharedCount() const {
+		return m_sharedCount;
+	}
+
 	/// search by name
 	KeySeq *searchByName(const tstringi &i_name);
 };
@@ -0,0 +1,74 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// keywordtable.h
+
+
+#ifndef _KEYWORDTABLE_H
+#  define _KEYWORDTABLE_H
+
+#  include "misc.h"
+#  include "parser.h"
+#  include <algorithm>
+
+
+/** case insensitive hash table of ASCII keywords.
+    a keyword is found by hashing the token once and comparing it with
+    the entry in that slot, instead of comparing it with every keyword. */
+template <class T> class KeywordTable
+{
+public:
+	///
+	class Entry
+	{
+	public:
+		const _TCHAR *m_name;			///
+		T m_value;				///
+	};
+
+private:
+	enum {
+		SIZE = 128,				/** power of two, enough to
+						    keep the probes short */
+	};
+
+	const Entry *m_slots[SIZE];			///
+
+private:
+	/// hash of i_name (case folded)
+	static size_t hash(const _TCHAR *i_name) {
+		size_t h = 2166136261U;
+		for (; *i_name; ++ i_name) {
+			_TCHAR c = *i_name;
+			if (_T('A') <= c && c <= _T('Z'))
+				c += _T('a') - _T('A');
+			h = (h ^ static_cast<size_t>(c)) * 16777619U;
+		}
+		return h & (SIZE - 1);
+	}
+
+public:
+	///
+	template <size_t N> KeywordTable(const Entry (&i_entries)[N]) {
+		ASSERT(N * 2 <= SIZE);
+		std::fill(m_slots, m_slots + SIZE, static_cast<const Entry *>(NULL));
+		for (size_t i = 0; i < N; ++ i) {
+			size_t h = hash(i_entries[i].m_name);
+			while (m_slots[h])
+				h = (h + 1) & (SIZE - 1);
+			m_slots[h] = &i_entries[i];
+		}
+	}
+
+	/// search i_token (NULL if it is not a keyword)
+	const T *search(const Token &i_token) const {
+		if (!i_token.isString())
+			return NULL;
+		const _TCHAR *name = i_token.getString().c_str();
+		for (size_t h = hash(name); m_slots[h]; h = (h + 1) & (SIZE - 1))
+			if (_tcsicmp(m_slots[h]->m_name, name) == 0)
+				return &m_slots[h]->m_value;
+		return NULL;
+	}
+};
+
+
+#endif // !_KEYWORDTABLE_H
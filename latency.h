@@ -0,0 +1,104 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// latency.h
+
+
+#ifndef _LATENCY_H
+#  define _LATENCY_H
+
+#  include "misc.h"
+#  include <algorithm>
+
+
+/** histogram of latencies with logarithmic buckets (like HdrHistogram).
+    values below SUB_BUCKETS are counted exactly.  larger values keep
+    their SUB_BUCKET_BITS most significant bits, so a percentile is at
+    most about 6% above the real value.  add() does not allocate and is
+    O(1). */
+class LatencyHistogram
+{
+public:
+	enum {
+		SUB_BUCKET_BITS = 5,				///
+		SUB_BUCKETS = 1 << SUB_BUCKET_BITS,		///
+		HALF_SUB_BUCKETS = SUB_BUCKETS / 2,		///
+		/// enough for any u_int32
+		BUCKETS = (32 - SUB_BUCKET_BITS + 2) * HALF_SUB_BUCKETS,
+	};
+
+private:
+	u_int32 m_counts[BUCKETS];			///
+	u_int32 m_count;				/// number of values
+	u_int32 m_max;				/// largest value
+
+private:
+	/// bucket of i_value
+	static int getBucket(u_int32 i_value) {
+		if (i_value < SUB_BUCKETS)
+			return static_cast<int>(i_value);
+		int msb = 0;
+		for (u_int32 v = i_value; v >>= 1; )
+			++ msb;
+		int shift = msb - (SUB_BUCKET_BITS - 1);
+		return shift * HALF_SUB_BUCKETS + static_cast<int>(i_value >> shift);
+	}
+
+	/// largest value of the bucket i_bucket
+	static u_int32 getUpperBound(int i_bucket) {
+		if (i_bucket < SUB_BUCKETS)
+			return static_cast<u_int32>(i_bucket);
+		int shift = i_bucket / HALF_SUB_BUCKETS - 1;
+		u_int64 sub = i_bucket - shift * HALF_SUB_BUCKETS;
+		return static_cast<u_int32>(((sub + 1) << shift) - 1);
+	}
+
+public:
+	///
+	LatencyHistogram() {
+		reset();
+	}
+
+	/// forget all values
+	void reset() {
+		for (int i = 0; i < BUCKETS; ++ i)
+			m_counts[i] = 0;
+		m_count = 0;
+		m_max = 0;
+	}
+
+	/// add a value
+	void add(u_int32 i_value) {
+		++ m_counts[getBucket(i_value)];
+		++ m_count;
+		if (m_max < i_value)
+			m_max = i_value;
+	}
+
+	///
+	u_int32 getCount() const {
+		return m_count;
+	}
+
+	///
+	u_int32 getMax() const {
+		return m_max;
+	}
+
+	/// the value below which i_permille / 1000 of the values are
+	u_int32 getPercentile(int i_permille) const {
+		if (m_count == 0)
+			return 0;
+		u_int64 rank = (static_cast<u_int64>(m_count) * i_permille + 999) / 1000;
+		if (rank == 0)
+			rank = 1;
+		u_int64 sum = 0;
+		for (int i = 0; i < BUCKETS; ++ i) {
+			sum += m_counts[i];
+			if (rank <= sum)
+				return std::min(getUpperBound(i), m_max);
+		}
+		return m_max;
+	}
+};
+
+
+#endif // !_LATENCY_H
@@ -39,6 +39,7 @@ OBJS_1		=					\
 		$(OUT_DIR)\dlgsetting.obj		\
 		$(OUT_DIR)\dlgversion.obj		\
 		$(OUT_DIR)\engine.obj			\
+		$(OUT_DIR)\eventtrace.obj		\
 		$(OUT_DIR)\focus.obj			\
 		$(OUT_DIR)\function.obj			\
 		$(OUT_DIR)\keyboard.obj			\
@@ -47,9 +48,12 @@ OBJS_1		=					\
 		$(OUT_DIR)\mayu.obj			\
 		$(OUT_DIR)\parser.obj			\
 		$(OUT_DIR)\registry.obj			\
+		$(OUT_DIR)\replay.obj			\
 		$(OUT_DIR)\setting.obj			\
+		$(OUT_DIR)\settingwatcher.obj	\
 		$(OUT_DIR)\stringtool.obj		\
 		$(OUT_DIR)\target.obj			\
+		$(OUT_DIR)\textfile.obj		\
 		$(OUT_DIR)\vkeytable.obj		\
 		$(OUT_DIR)\windowstool.obj		\
 
@@ -61,6 +65,7 @@ SRCS_1		=				\
 		dlgsetting.cpp			\
 		dlgversion.cpp			\
 		engine.cpp			\
+		eventtrace.cpp			\
 		focus.cpp			\
 		function.cpp			\
 		keyboard.cpp			\
@@ -69,9 +74,12 @@ SRCS_1		=				\
 		mayu.cpp			\
 		parser.cpp			\
 		registry.cpp			\
+		replay.cpp			\
 		setting.cpp			\
+		settingwatcher.cpp		\
 		stringtool.cpp			\
 		target.cpp			\
+		textfile.cpp			\
 		vkeytable.cpp			\
 		windowstool.cpp			\
 
@@ -195,6 +203,7 @@ UNIX2DOS	= perl tools/unix2dos
 MAKEFUNC	= perl tools/makefunc
 GETCVSFILES	= perl tools/getcvsfiles
 GENIEXPRESS	= perl tools/geniexpress
+REPLAYTEST	= perl tools/replaytest
 
 
 # rules		###############################################################
@@ -218,6 +227,9 @@ clean::
 		-$(RM) *~ $(CLEAN)
 		-$(RMDIR) $(OUT_DIR)
 
+test:		$(TARGET_1)
+		$(REPLAYTEST) $(TARGET_1) test\replay
+
 depend::
 		$(MAKEDEPEND) -fmayu-common.mak \
 		-- $(DEPENDFLAGS) -- $(SRCS_1) $(SRCS_2)
@@ -243,30 +255,33 @@ $(OUT_DIR)\dlgeditsetting.obj: compiler_specific.h dlgeditsetting.h \
 $(OUT_DIR)\dlginvestigate.obj: compiler_specific.h d\ioctl.h \
  dlginvestigate.h driver.h engine.h focus.h function.h functions.h hook.h \
  keyboard.h keymap.h mayurc.h misc.h msgstream.h multithread.h parser.h \
- setting.h stringtool.h target.h vkeytable.h windowstool.h
+ setting.h stringtool.h target.h vkeytable.h windowstool.h inputqueue.h \
+ engineio.h eventtrace.h latency.h
 $(OUT_DIR)\dlglog.obj: compiler_specific.h dlglog.h layoutmanager.h mayu.h \
  mayurc.h misc.h msgstream.h multithread.h registry.h stringtool.h \
  windowstool.h
 $(OUT_DIR)\dlgsetting.obj: compiler_specific.h d\ioctl.h dlgeditsetting.h \
- driver.h function.h functions.h keyboard.h keymap.h layoutmanager.h mayu.h \
- mayurc.h misc.h multithread.h parser.h registry.h setting.h stringtool.h \
- windowstool.h
+ driver.h function.h functions.h hook.h keyboard.h keymap.h \
+ layoutmanager.h mayu.h mayurc.h misc.h multithread.h parser.h registry.h \
+ setting.h stringtool.h windowstool.h
 $(OUT_DIR)\dlgversion.obj: compiler_specific.h compiler_specific_func.h \
  layoutmanager.h mayu.h mayurc.h misc.h stringtool.h windowstool.h
 $(OUT_DIR)\engine.obj: compiler_specific.h d\ioctl.h driver.h engine.h \
  errormessage.h function.h functions.h hook.h keyboard.h keymap.h mayurc.h \
  misc.h msgstream.h multithread.h parser.h setting.h stringtool.h \
- windowstool.h
+ windowstool.h inputqueue.h engineio.h eventtrace.h latency.h
+$(OUT_DIR)\eventtrace.obj: compiler_specific.h d\ioctl.h driver.h \
+ eventtrace.h misc.h stringtool.h
 $(OUT_DIR)\focus.obj: compiler_specific.h focus.h misc.h stringtool.h \
  windowstool.h
 $(OUT_DIR)\function.obj: compiler_specific.h d\ioctl.h driver.h engine.h \
  function.h functions.h hook.h keyboard.h keymap.h mayu.h mayurc.h misc.h \
  msgstream.h multithread.h parser.h registry.h setting.h stringtool.h \
- vkeytable.h windowstool.h
+ vkeytable.h windowstool.h inputqueue.h engineio.h eventtrace.h latency.h
 $(OUT_DIR)\keyboard.obj: compiler_specific.h d\ioctl.h driver.h keyboard.h \
  misc.h stringtool.h
 $(OUT_DIR)\keymap.obj: compiler_specific.h d\ioctl.h driver.h \
- errormessage.h function.h functions.h keyboard.h keymap.h misc.h \
+ errormessage.h function.h functions.h hook.h keyboard.h keymap.h misc.h \
  multithread.h parser.h setting.h stringtool.h
 $(OUT_DIR)\layoutmanager.obj: compiler_specific.h layoutmanager.h misc.h \
  stringtool.h windowstool.h
@@ -274,18 +289,27 @@ $(OUT_DIR)\mayu.obj: compiler_specific.h compiler_specific_func.h d\ioctl.h \
  dlginvestigate.h dlglog.h dlgsetting.h dlgversion.h driver.h engine.h \
  errormessage.h focus.h function.h functions.h hook.h keyboard.h keymap.h \
  mayu.h mayuipc.h mayurc.h misc.h msgstream.h multithread.h parser.h \
- registry.h setting.h stringtool.h target.h windowstool.h vk2tchar.h
+ registry.h replay.h setting.h stringtool.h target.h windowstool.h \
+ vk2tchar.h inputqueue.h engineio.h eventtrace.h latency.h \
+ settingwatcher.h
 $(OUT_DIR)\parser.obj: compiler_specific.h errormessage.h misc.h parser.h \
  stringtool.h
 $(OUT_DIR)\registry.obj: array.h compiler_specific.h misc.h registry.h \
  stringtool.h
+$(OUT_DIR)\replay.obj: compiler_specific.h d\ioctl.h driver.h engine.h \
+ engineio.h errormessage.h function.h functions.h hook.h keyboard.h \
+ keymap.h misc.h msgstream.h multithread.h parser.h replay.h setting.h \
+ stringtool.h inputqueue.h eventtrace.h latency.h
 $(OUT_DIR)\setting.obj: array.h compiler_specific.h d\ioctl.h dlgsetting.h \
- driver.h errormessage.h function.h functions.h keyboard.h keymap.h mayu.h \
- mayurc.h misc.h multithread.h parser.h registry.h setting.h stringtool.h \
- vkeytable.h windowstool.h
+ driver.h errormessage.h function.h functions.h hook.h keyboard.h keymap.h \
+ keywordtable.h mayu.h mayurc.h misc.h multithread.h parser.h registry.h \
+ setting.h stringtool.h textfile.h vkeytable.h windowstool.h
+$(OUT_DIR)\settingwatcher.obj: compiler_specific.h misc.h settingwatcher.h \
+ stringtool.h
 $(OUT_DIR)\stringtool.obj: array.h compiler_specific.h misc.h stringtool.h
 $(OUT_DIR)\target.obj: compiler_specific.h mayurc.h misc.h stringtool.h \
  target.h windowstool.h
+$(OUT_DIR)\textfile.obj: compiler_specific.h misc.h stringtool.h textfile.h
 $(OUT_DIR)\vkeytable.obj: compiler_specific.h misc.h vkeytable.h
 $(OUT_DIR)\windowstool.obj: array.h compiler_specific.h misc.h stringtool.h \
  windowstool.h
@@ -21,7 +21,9 @@
 #include "msgstream.h"
 #include "multithread.h"
 #include "registry.h"
+#include "replay.h"
 #include "setting.h"
+#include "settingwatcher.h"
 #include "target.h"
 #include "windowstool.h"
 #include "fixscancodemap.h"
@@ -81,10 +83,22 @@ class Mayu
 	int m_escapeNlsKeys;
 	FixScancodeMap m_fixScancodeMap;
 
+	/// a replaced setting and the generation that replaced it
+	typedef std::pair<Setting *, LONG> OldSetting;
+	typedef std::list<OldSetting> Settings;	///
+
 	Setting *m_setting;				/// current setting
+	Settings m_oldSettings;			/** replaced settings the engine
+						    may still use */
+	int m_autoReload;				/** reload the setting when its
+						    files are changed ? */
+	SettingWatcher m_settingWatcher;		/// watches the setting files
 	bool m_isSettingDialogOpened;			/// is setting dialog opened ?
 
 	Engine m_engine;				/// engine
+	HWINEVENTHOOK m_hForegroundHook;		/** tells m_engine that the
+						    foreground window changed */
+	static Engine *s_foregroundEngine;		/// m_engine for foregroundProc
 
 	bool m_usingSN;		   /// using WTSRegisterSessionNotification() ?
 	time_t m_startTime;				/// mayu started at ...
@@ -93,6 +107,7 @@ class Mayu
 		WM_APP_taskTrayNotify = WM_APP + 101,	///
 		WM_APP_msgStreamNotify = WM_APP + 102,	///
 		WM_APP_escapeNLSKeysFailed = WM_APP + 121,	///
+		WM_APP_settingChanged = WM_APP + 122,	///
 		ID_TaskTrayIcon = 1,			///
 	};
 
@@ -100,7 +115,27 @@ class Mayu
 		YAMY_TIMER_ESCAPE_NLS_KEYS = 0,	///
 	};
 
+	enum {
+		RELOAD_SETTING_DELAY = 500,		/** ms to wait for the
+						    writes to the setting files
+						    to settle */
+	};
+
 private:
+	/// EVENT_SYSTEM_FOREGROUND handler
+	static void CALLBACK foregroundProc(HWINEVENTHOOK /* i_hook */,
+										DWORD /* i_event */,
+										HWND /* i_hwnd */,
+										LONG /* i_idObject */,
+										LONG /* i_idChild */,
+										DWORD /* i_threadId */,
+										DWORD /* i_time */) {
+		// windows mayu.dll cannot hook (e.g. consoles) do not notify
+		// their focus, so tell the engine to examine it
+		if (s_foregroundEngine)
+			s_foregroundEngine->notifyFocusChanged();
+	}
+
 	static VOID CALLBACK mailslotProc(DWORD i_code, DWORD i_len, LPOVERLAPPED i_ol) {
 		Mayu *pThis;
 
@@ -158,7 +193,7 @@ private:
 				m_engine.setFocus(reinterpret_cast<HWND>(n->m_hwnd), n->m_threadId,
 								  n->m_className, n->m_titleName, false);
 
-			{
+			if (m_log.isLogged(1)) {
 				Acquire a(&m_log, 1);
 				m_log << _T("HWND:\t") << std::hex
 				<< n->m_hwnd
@@ -293,6 +328,8 @@ private:
 				This = reinterpret_cast<Mayu *>(
 						   reinterpret_cast<CREATESTRUCT *>(i_lParam)->lpCreateParams);
 				This->m_fixScancodeMap.init(i_hwnd, WM_APP_escapeNLSKeysFailed);
+				This->m_settingWatcher.init(i_hwnd, WM_APP_settingChanged,
+											RELOAD_SETTING_DELAY);
 				if (This->m_escapeNlsKeys) {
 					This->m_fixScancodeMap.escape(true);
 				}
@@ -491,6 +528,11 @@ private:
 				return 0;
 			}
 
+			case WM_APP_settingChanged:
+				// the writes have settled (see SettingWatcher)
+				This->load(true);
+				return 0;
+
 			case WM_APP_escapeNLSKeysFailed:
 				if (i_lParam) {
 					int ret;
@@ -594,8 +636,29 @@ private:
 							}
 							This->m_log << std::endl;
 						}
+						LONG flushes = This->m_engine.getOutputFlushCount();
+						LONG events = This->m_engine.getOutputEventCount();
+						This->m_log << _T("Output: ") << events
+						<< _T(" events in ") << flushes << _T(" flushes (")
+						<< (flushes ? static_cast<double>(events) / flushes : 0)
+						<< _T(" events/flush, max ")
+						<< This->m_engine.getOutputMaxEventsPerFlush()
+						<< _T(", ") << This->m_engine.getOutputCancelledCount()
+						<< _T(" cancelled)") << std::endl;
+						if (This->m_setting)
+							This->m_log << _T("Window keymap cache: ")
+							<< This->m_setting->m_keymaps.getWindowCacheHitCount()
+							<< _T(" hits, ")
+							<< This->m_setting->m_keymaps.getWindowCacheMissCount()
+							<< _T(" misses") << std::endl;
 						break;
 					}
+					case ID_MENUITEM_latencyReport:
+						This->m_engine.reportLatency();
+						break;
+					case ID_MENUITEM_latencyReset:
+						This->m_engine.resetLatency();
+						break;
 					case ID_MENUITEM_version:
 						ShowWindow(This->m_hwndVersion, SW_SHOW);
 						SetForegroundWindow(This->m_hwndVersion);
@@ -681,6 +744,9 @@ private:
 					SendMessage(This->m_hwndLog, WM_COMMAND,
 								MAKELONG(IDC_BUTTON_clearLog, 0), 0);
 					break;
+				case EngineNotify_settingApplied:
+					This->reclaimSettings();
+					break;
 				default:
 					break;
 				}
@@ -746,8 +812,13 @@ private:
 		return DefWindowProc(i_hwnd, i_message, i_wParam, i_lParam);
 	}
 
-	/// load setting
-	void load() {
+	/** load setting.
+	    if i_isAutomatic (the file watcher has seen a write) and none of
+	    the files has really changed, the reload is a duplicate and the
+	    engine keeps the current setting.  a reload the user asks for is
+	    always applied, because it also resets the lock and modifier
+	    state. */
+	void load(bool i_isAutomatic = false) {
 		Setting *newSetting = new Setting;
 
 		// set symbol
@@ -756,7 +827,17 @@ private:
 				newSetting->m_symbols.insert(__targv[i] + 2);
 		}
 
-		if (!SettingLoader(&m_log, &m_log).load(newSetting)) {
+		SettingLoader loader(&m_log, &m_log);
+		bool isLoaded = loader.load(newSetting, _T(""),
+									i_isAutomatic ? m_setting : NULL);
+
+		// watch the files even if the load failed, so that the fixed
+		// files are loaded
+		if (m_autoReload)
+			watch(loader.isDuplicate() ?
+				  m_setting->m_sources : newSetting->m_sources);
+
+		if (!isLoaded) {
 			ShowWindow(m_hwndLog, SW_SHOW);
 			SetForegroundWindow(m_hwndLog);
 			delete newSetting;
@@ -764,11 +845,47 @@ private:
 			m_log << _T("error: failed to load.") << std::endl;
 			return;
 		}
+		if (loader.isDuplicate()) {
+			// the engine keeps using m_setting
+			delete newSetting;
+			m_log << _T("the setting files have not changed: ")
+			<< _T("the reload is skipped.") << std::endl;
+			return;
+		}
 		m_log << _T("successfully loaded.") << std::endl;
-		while (!m_engine.setSetting(newSetting))
-			Sleep(1000);
-		delete m_setting;
+		LONG generation = m_engine.publishSetting(newSetting);
+		if (m_setting)
+			m_oldSettings.push_back(OldSetting(m_setting, generation));
 		m_setting = newSetting;
+		reclaimSettings();
+	}
+
+	/** watch the files of i_sources: the dot file found by getFilename()
+	    and the included names in every home directory */
+	void watch(const Setting::Sources &i_sources) {
+		std::list<tstringi> paths, names;
+		for (Setting::Sources::const_iterator
+				i = i_sources.begin(); i != i_sources.end(); ++ i)
+			if ((*i).m_name.empty())
+				paths.push_back((*i).m_path);
+			else
+				names.push_back((*i).m_name);
+		HomeDirectories directories;
+		getHomeDirectories(&directories);
+		m_settingWatcher.watch(paths, names, directories);
+	}
+
+	/// delete the old settings the engine no longer uses
+	void reclaimSettings() {
+		for (Settings::iterator i = m_oldSettings.begin();
+				i != m_oldSettings.end(); ) {
+			if (!m_engine.isApplied((*i).second))
+				++ i;
+			else {
+				delete (*i).first;
+				i = m_oldSettings.erase(i);
+			}
+		}
 	}
 
 	// show message (a baloon from the task tray icon)
@@ -1029,9 +1146,11 @@ public:
 			m_setting(NULL),
 			m_isSettingDialogOpened(false),
 			m_sessionState(0),
-			m_engine(m_log) {
+			m_engine(m_log),
+			m_hForegroundHook(NULL) {
 		Registry reg(MAYU_REGISTRY_ROOT);
 		reg.read(_T("escapeNLSKeys"), &m_escapeNlsKeys, 0);
+		reg.read(_T("autoReload"), &m_autoReload, 1);
 		m_hNotifyMailslot = CreateMailslot(NOTIFY_MAILSLOT_NAME, 0, MAILSLOT_WAIT_FOREVER, (SECURITY_ATTRIBUTES *)NULL);
 		ASSERT(m_hNotifyMailslot != INVALID_HANDLE_VALUE);
 		int err;
@@ -1118,6 +1237,10 @@ public:
 		// start keyboard handler thread
 		m_engine.setAssociatedWndow(m_hwndTaskTray);
 		m_engine.start();
+		s_foregroundEngine = &m_engine;
+		m_hForegroundHook =
+			SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+							NULL, foregroundProc, 0, 0, WINEVENT_OUTOFCONTEXT);
 
 		// show tasktray icon
 		m_tasktrayIcon[0] = loadSmallIcon(IDI_ICON_mayu_disabled);
@@ -1189,6 +1312,9 @@ public:
 		// stop notify from mayu.dll
 		g_hookData->m_hwndTaskTray = NULL;
 		CHECK_FALSE( uninstallMessageHook() );
+		if (m_hForegroundHook)
+			UnhookWinEvent(m_hForegroundHook);
+		s_foregroundEngine = NULL;
 
 #ifdef _WIN64
 		ReleaseMutex(m_hMutexYamyd);
@@ -1234,6 +1360,9 @@ public:
 		}
 
 		// remove setting;
+		for (Settings::iterator i = m_oldSettings.begin();
+				i != m_oldSettings.end(); ++ i)
+			delete (*i).first;
 		delete m_setting;
 	}
 
@@ -1282,6 +1411,9 @@ public:
 };
 
 
+Engine *Mayu::s_foregroundEngine = NULL;
+
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Functions
 
@@ -1358,6 +1490,10 @@ int WINAPI _tWinMain(HINSTANCE i_hInstance, HINSTANCE /* i_hPrevInstance */,
 	convertRegistry();
 #endif // !USE_INI
 
+	// replay recorded input instead of hooking the real one
+	if (2 <= __argc && _tcsicmp(__targv[1], _T("-replay")) == 0)
+		return replayMain(__argc, __targv);
+
 	// is another mayu running ?
 	HANDLE mutex = CreateMutex((SECURITY_ATTRIBUTES *)NULL, TRUE,
 							   MUTEX_MAYU_EXCLUSIVE_RUNNING);
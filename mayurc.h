@@ -78,6 +78,8 @@
 #define ID_MENUITEM_disable             40007
 #define ID_MENUITEM_log                 40008
 #define ID_MENUITEM_check               40009
+#define ID_MENUITEM_latencyReport       40010
+#define ID_MENUITEM_latencyReset        40011
 #define IDC_STATIC                      -1
 
 // Next default values for new objects
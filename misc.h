@@ -50,7 +50,7 @@ typedef unsigned short u_int16;			/// unsigned 16bit
 typedef unsigned long u_int32;			/// unsigned 32bit
 #if defined(__BORLANDC__)
 typedef unsigned __int64 u_int64;			/// unsigned 64bit
-#elif _MSC_VER <= 1300
+#elif defined(_MSC_VER) && _MSC_VER <= 1300
 typedef unsigned _int64 u_int64;			/// unsigned 64bit
 #else
 typedef unsigned long long u_int64;			/// unsigned 64bit
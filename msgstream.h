@@ -122,6 +122,13 @@ public:
 		return m_debugLevel;
 	}
 
+	/** is a message of i_msgDebugLevel displayed ?
+	    sync() drops the other messages, so the callers can skip
+	    acquiring the lock and formatting them. */
+	bool isLogged(int i_msgDebugLevel) const {
+		return i_msgDebugLevel <= m_debugLevel;
+	}
+
 	// for stream
 	typename Super::int_type overflow(typename Super::int_type i_c = TR::eof()) {
 		if (sync() == TR::eof()) // sync before new buffer created below
@@ -238,6 +245,11 @@ public:
 		return m_streamBuf.getDebugLevel();
 	}
 
+	/// is a message of i_msgDebugLevel displayed ?
+	bool isLogged(int i_msgDebugLevel) const {
+		return m_streamBuf.isLogged(i_msgDebugLevel);
+	}
+
 	/// acquire string and release the string
 	const String &acquireString() {
 		return m_streamBuf.acquireString();
@@ -6,6 +6,7 @@
 
 #include "errormessage.h"
 #include "parser.h"
+#include <algorithm>
 #include <cassert>
 
 
@@ -13,21 +14,12 @@
 // Token
 
 
-Token::Token(const Token &i_token)
-		: m_type(i_token.m_type),
-		m_isValueQuoted(i_token.m_isValueQuoted),
-		m_numericValue(i_token.m_numericValue),
-		m_stringValue(i_token.m_stringValue),
-		m_data(i_token.m_data)
-{
-}
-
 Token::Token(int i_value, const tstringi &i_display)
 		: m_type(Type_number),
 		m_isValueQuoted(false),
 		m_numericValue(i_value),
 		m_stringValue(i_display),
-		m_data(NULL)
+		m_data(0)
 {
 }
 
@@ -36,7 +28,7 @@ Token::Token(const tstringi &i_value, bool i_isValueQuoted, bool i_isRegexp)
 		m_isValueQuoted(i_isValueQuoted),
 		m_numericValue(0),
 		m_stringValue(i_value),
-		m_data(NULL)
+		m_data(0)
 {
 }
 
@@ -45,7 +37,7 @@ Token::Token(Type i_m_type)
 		m_isValueQuoted(false),
 		m_numericValue(0),
 		m_stringValue(_T("")),
-		m_data(NULL)
+		m_data(0)
 {
 	ASSERT(m_type == Type_openParen || m_type == Type_closeParen ||
 		   m_type == Type_comma);
@@ -63,7 +55,7 @@ int Token::getNumber() const
 }
 
 // get string value
-tstringi Token::getString() const
+const tstringi &Token::getString() const
 {
 	if (m_type == Type_string)
 		return m_stringValue;
@@ -71,7 +63,7 @@ tstringi Token::getString() const
 }
 
 // get regexp value
-tstringi Token::getRegexp() const
+const tstringi &Token::getRegexp() const
 {
 	if (m_type == Type_regexp)
 		return m_stringValue;
@@ -138,6 +130,13 @@ Parser::Parser(const _TCHAR *i_str, size_t i_length)
 		m_ptr(i_str),
 		m_end(i_str + i_length)
 {
+	std::fill(m_prefixRoots, m_prefixRoots + PREFIX_ROOTS, 0);
+}
+
+// lower case of an ASCII character
+static inline _TCHAR toLowerAscii(_TCHAR i_c)
+{
+	return (_T('A') <= i_c && i_c <= _T('Z')) ? i_c - _T('A') + _T('a') : i_c;
 }
 
 // set string that may be prefix of a token.
@@ -145,6 +144,60 @@ Parser::Parser(const _TCHAR *i_str, size_t i_length)
 void Parser::setPrefixes(const Prefixes *i_prefixes)
 {
 	m_prefixes = i_prefixes;
+
+	// build a trie of the prefixes, so that getPrefix() compares each
+	// character of a token only once
+	m_prefixTrie.assign(1, PrefixNode());
+	std::fill(m_prefixRoots, m_prefixRoots + PREFIX_ROOTS, 0);
+	if (!m_prefixes)
+		return;
+	for (size_t i = 0; i < m_prefixes->size(); ++ i) {
+		const tstringi &prefix = (*m_prefixes)[i];
+		if (prefix.empty() ||
+				PREFIX_ROOTS <= static_cast<_TUCHAR>(prefix[0]))
+			continue;				// never matches a token
+		size_t *link =
+			&m_prefixRoots[static_cast<_TUCHAR>(toLowerAscii(prefix[0]))];
+		size_t node = 0;
+		for (size_t j = 0; j < prefix.size(); ++ j) {
+			_TCHAR c = toLowerAscii(prefix[j]);
+			while (*link && m_prefixTrie[*link].m_char != c)
+				link = &m_prefixTrie[*link].m_sibling;
+			if (*link)
+				node = *link;
+			else {
+				PrefixNode n;
+				n.m_char = c;
+				n.m_child = n.m_sibling = n.m_prefix = 0;
+				node = *link = m_prefixTrie.size();
+				m_prefixTrie.push_back(n);	// invalidates link
+			}
+			link = &m_prefixTrie[node].m_child;
+		}
+		if (!m_prefixTrie[node].m_prefix)
+			m_prefixTrie[node].m_prefix = i + 1;
+	}
+}
+
+// get the longest prefix i_str begins with
+const tstringi *Parser::getPrefix(const _TCHAR *i_str) const
+{
+	if (!m_prefixes || PREFIX_ROOTS <= static_cast<_TUCHAR>(*i_str))
+		return NULL;
+	const tstringi *prefix = NULL;
+	size_t node = m_prefixRoots[static_cast<_TUCHAR>(toLowerAscii(*i_str))];
+	while (node) {
+		const PrefixNode &n = m_prefixTrie[node];
+		if (n.m_prefix)
+			prefix = &(*m_prefixes)[n.m_prefix - 1];
+		if (*++ i_str == _T('\0'))
+			break;
+		_TCHAR c = toLowerAscii(*i_str);
+		node = n.m_child;
+		while (node && m_prefixTrie[node].m_char != c)
+			node = m_prefixTrie[node].m_sibling;
+	}
+	return prefix;
 }
 
 // get a line
@@ -187,6 +240,15 @@ got_line_end:
 	return true;
 }
 
+// add a string token
+void Parser::addString(Tokens *o_tokens, tstringi *io_str,
+					   bool i_isQuoted, bool i_isRegexp)
+{
+	// an empty string is copied without allocation
+	o_tokens->push_back(Token(tstringi(), i_isQuoted, i_isRegexp));
+	o_tokens->back().m_stringValue.swap(*io_str);
+}
+
 // symbol test
 static bool isSymbolChar(_TCHAR i_c)
 {
@@ -223,11 +285,10 @@ bool Parser::getLine(std::vector<Token> *o_tokens)
 	o_tokens->clear();
 	m_lineNumber = m_internalLineNumber;
 
-	tstringi line;
 	bool isTokenExist = false;
 continue_getLineLoop:
-	while (getLine(&line)) {
-		const _TCHAR *t = line.c_str();
+	while (getLine(&m_line)) {
+		const _TCHAR *t = m_line.c_str();
 
 continue_getTokenLoop:
 		while (true) {
@@ -270,14 +331,11 @@ continue_getTokenLoop:
 			isTokenExist = true;
 
 			// prefix
-			if (m_prefixes)
-				for (size_t i = 0; i < m_prefixes->size(); i ++)
-					if (_tcsnicmp(tokenStart, m_prefixes->at(i).c_str(),
-								  m_prefixes->at(i).size()) == 0) {
-						o_tokens->push_back(Token(m_prefixes->at(i), false));
-						t += m_prefixes->at(i).size();
-						goto continue_getTokenLoop;
-					}
+			if (const tstringi *prefix = getPrefix(tokenStart)) {
+				o_tokens->push_back(Token(*prefix, false));
+				t += prefix->size();
+				goto continue_getTokenLoop;
+			}
 
 			// quoted or regexp
 			if (*t == _T('"') || *t == _T('\'') ||
@@ -291,16 +349,20 @@ continue_getTokenLoop:
 				}
 				tokenStart = t;
 
+				bool hasEscape = false;
 				while (*t != _T('\0') && *t != q[0]) {
 					if (*t == _T('\\') && *(t + 1))
-						t ++;
+						t ++, hasEscape = true;
 					if (_istlead(*t) && *(t + 1))
 						t ++;
 					t ++;
 				}
 
-				tstring str =
-					interpretMetaCharacters(tokenStart, t - tokenStart, q, isRegexp);
+				// most strings have no escapes and need no interpretation
+				tstringi str = hasEscape ?
+					tstringi(interpretMetaCharacters(tokenStart, t - tokenStart,
+													 q, isRegexp)) :
+					tstringi(tokenStart, t - tokenStart);
 #ifdef _MBCS
 				if (isRegexp)
 					str = guardRegexpFromMbcs(str.c_str());
@@ -311,7 +373,7 @@ continue_getTokenLoop:
 						o_tokens->back().isQuoted())
 					o_tokens->back().add(str);
 				else
-					o_tokens->push_back(Token(str, true, isRegexp));
+					addString(o_tokens, &str, true, isRegexp);
 				if (*t != _T('\0'))
 					t ++;
 				goto continue_getTokenLoop;
@@ -319,12 +381,14 @@ continue_getTokenLoop:
 
 			// not quoted
 			{
+				bool hasEscape = false;
 				while (isSymbolChar(*t)) {
-					if (*t == _T('\\'))
+					if (*t == _T('\\')) {
 						if (*(t + 1))
-							t ++;
+							t ++, hasEscape = true;
 						else
 							break;
+					}
 					if (_istlead(*t) && *(t + 1))
 						t ++;
 					t ++;
@@ -350,8 +414,11 @@ continue_getTokenLoop:
 				_TCHAR *numEnd = NULL;
 				long value = _tcstol(tokenStart, &numEnd, 0);
 				if (tokenStart == numEnd) {
-					tstring str = interpretMetaCharacters(tokenStart, t - tokenStart);
-					o_tokens->push_back(Token(str, false));
+					tstringi str = hasEscape ?
+						tstringi(interpretMetaCharacters(tokenStart,
+														 t - tokenStart)) :
+						tstringi(tokenStart, t - tokenStart);
+					addString(o_tokens, &str, false);
 				} else {
 					o_tokens->push_back(
 						Token(value, tstringi(tokenStart, numEnd - tokenStart)));
@@ -13,6 +13,8 @@
 ///
 class Token
 {
+	friend class Parser;
+
 public:
 	///
 	enum Type {
@@ -32,8 +34,6 @@ private:
 	long m_data;					///
 
 public:
-	///
-	Token(const Token &i_token);
 	///
 	Token(int i_value, const tstringi &i_display);
 	///
@@ -80,10 +80,15 @@ public:
 	int getNumber() const;
 
 	/// get string value
-	tstringi getString() const;
+	const tstringi &getString() const;
 
 	/// get regexp value
-	tstringi getRegexp() const;
+	const tstringi &getRegexp() const;
+
+	/// get the string of any type (the display of a number)
+	const tstringi &getRawString() const {
+		return m_stringValue;
+	}
 
 	/// get data
 	long getData() const {
@@ -137,19 +142,47 @@ private:
 	///
 	typedef std::vector<tstringi> Prefixes;
 
+	/// a node of m_prefixTrie
+	class PrefixNode
+	{
+	public:
+		_TCHAR m_char;				/// lower case
+		size_t m_child;				/// first child (0 if none)
+		size_t m_sibling;				/// next sibling (0 if none)
+		size_t m_prefix;				/** index of m_prefixes + 1
+						    (0 if no prefix ends here) */
+	};
+	///
+	typedef std::vector<PrefixNode> PrefixTrie;
+
+	enum {
+		PREFIX_ROOTS = 128,				/// ASCII
+	};
+
 private:
 	size_t m_lineNumber;				/// current line number
 	const Prefixes *m_prefixes;			/** string that may be prefix
                                                     of a token */
+	PrefixTrie m_prefixTrie;			/** m_prefixes case folded (node
+						    0 is not used) */
+	size_t m_prefixRoots[PREFIX_ROOTS];		/** first node of m_prefixTrie
+						    for each character */
 
 	size_t m_internalLineNumber;			/// next line number
 	const _TCHAR *m_ptr;				/// read pointer
 	const _TCHAR *m_end;				/// end pointer
+	tstringi m_line;				/** current line (reused to
+						    avoid an allocation per
+						    line) */
 
 private:
 	/// get a line
 	bool getLine(tstringi *o_line);
 
+	/// add a string token (*io_str is moved into the token)
+	static void addString(Tokens *o_tokens, tstringi *io_str,
+						  bool i_isQuoted, bool i_isRegexp = false);
+
 public:
 	///
 	Parser(const _TCHAR *i_str, size_t i_length);
@@ -165,6 +198,9 @@ public:
 	/** set string that may be prefix of a token.  prefix_ is not
 	    copied, so it must be preserved after setPrefix() */
 	void setPrefixes(const Prefixes *m_prefixes);
+
+	/// get the longest prefix i_str begins with (NULL if none)
+	const tstringi *getPrefix(const _TCHAR *i_str) const;
 };
 
 
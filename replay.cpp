@@ -0,0 +1,552 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// replay.cpp
+
+
+#include "misc.h"
+#include "engine.h"
+#include "engineio.h"
+#include "errormessage.h"
+#include "msgstream.h"
+#include "replay.h"
+#include "setting.h"
+#include <iomanip>
+#include <list>
+#include <set>
+#include <vector>
+#include <process.h>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ReplayFocusProvider
+
+
+/// a focus that never changes
+class ReplayFocusProvider : public FocusProvider
+{
+	tstringi m_className;				///
+	tstringi m_titleName;				///
+
+public:
+	///
+	ReplayFocusProvider(const tstringi &i_className,
+						const tstringi &i_titleName)
+		: m_className(i_className),
+		  m_titleName(i_titleName) {
+	}
+
+	///
+	static HWND getHwnd() {
+		return reinterpret_cast<HWND>(1);
+	}
+
+	///
+	virtual HWND getForegroundWindow(DWORD *o_threadId) {
+		*o_threadId = 1;
+		return getHwnd();
+	}
+
+	///
+	virtual bool getClassName(HWND /* i_hwnd */, tstringi *o_className) {
+		*o_className = m_className;
+		return true;
+	}
+
+	///
+	virtual bool getTitleName(HWND /* i_hwnd */, tstringi *o_titleName) {
+		*o_titleName = m_titleName;
+		return true;
+	}
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Replayer
+
+
+/// reads events from a file and writes what Engine generated for them
+class Replayer : public InputSource, public OutputSink
+{
+	typedef std::vector<KEYBOARD_INPUT_DATA> Events; ///
+
+	tifstream m_ist;				///
+	tofstream m_ost;				///
+	int m_lineNumber;				///
+	bool m_hasCurrent;				/// is m_current being processed ?
+	KEYBOARD_INPUT_DATA m_current;		/// event being processed
+	Events m_injected;				/// generated by m_current
+	LARGE_INTEGER m_frequency;			///
+	LARGE_INTEGER m_start;			/// when m_current was read
+	LONGLONG m_total;				/// total time in ticks
+	LONGLONG m_max;				/// maximum time in ticks
+	int m_count;					/// number of events
+
+private:
+	/// write an event
+	void write(const KEYBOARD_INPUT_DATA &i_kid) {
+		if (i_kid.Flags & KEYBOARD_INPUT_DATA::BREAK)
+			m_ost << _T("U-");
+		else
+			m_ost << _T("D-");
+		if (i_kid.Flags & KEYBOARD_INPUT_DATA::E0)
+			m_ost << _T("E0-");
+		if (i_kid.Flags & KEYBOARD_INPUT_DATA::E1)
+			m_ost << _T("E1-");
+		m_ost << _T("0x") << std::hex << std::setw(2) << std::setfill(_T('0'))
+			  << i_kid.MakeCode << std::dec << std::setfill(_T(' '));
+	}
+
+	/// write the result of m_current
+	void finish() {
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+		if (!m_hasCurrent)
+			return;
+		m_hasCurrent = false;
+
+		LONGLONG ticks = end.QuadPart - m_start.QuadPart;
+		m_total += ticks;
+		if (m_max < ticks)
+			m_max = ticks;
+		++ m_count;
+
+		write(m_current);
+		m_ost << _T("\t");
+		for (Events::iterator i = m_injected.begin(); i != m_injected.end(); ++ i) {
+			if (i != m_injected.begin())
+				m_ost << _T(" ");
+			write(*i);
+		}
+		m_ost << _T("\t") << toMicroseconds(ticks) << std::endl;
+		m_injected.clear();
+	}
+
+	///
+	LONGLONG toMicroseconds(LONGLONG i_ticks) const {
+		return i_ticks * 1000000 / m_frequency.QuadPart;
+	}
+
+	/// parse a line of the input
+	bool parse(const tstringi &i_line, KEYBOARD_INPUT_DATA *o_kid) {
+		const _TCHAR *p = i_line.c_str();
+		o_kid->UnitId = 0;
+		o_kid->Flags = 0;
+		o_kid->Reserved = 0;
+		o_kid->ExtraInformation = 0;
+		while (true) {
+			while (_istspace(*p))
+				++ p;
+			if (_tcsnicmp(p, _T("D-"), 2) == 0)
+				p += 2;
+			else if (_tcsnicmp(p, _T("U-"), 2) == 0)
+				o_kid->Flags |= KEYBOARD_INPUT_DATA::BREAK, p += 2;
+			else if (_tcsnicmp(p, _T("E0-"), 3) == 0)
+				o_kid->Flags |= KEYBOARD_INPUT_DATA::E0, p += 3;
+			else if (_tcsnicmp(p, _T("E1-"), 3) == 0)
+				o_kid->Flags |= KEYBOARD_INPUT_DATA::E1, p += 3;
+			else
+				break;
+		}
+		_TCHAR *end = NULL;
+		long scan = _tcstol(p, &end, 0);
+		if (end == p || scan < 0 || 0xff < scan)
+			throw ErrorMessage() << _T("line ") << m_lineNumber
+			<< _T(": invalid event `") << i_line << _T("'.");
+		o_kid->MakeCode = static_cast<USHORT>(scan);
+		return true;
+	}
+
+public:
+	///
+	Replayer(const char *i_input, const char *i_output)
+		: m_ist(i_input),
+		  m_ost(i_output),
+		  m_lineNumber(0),
+		  m_hasCurrent(false),
+		  m_total(0),
+		  m_max(0),
+		  m_count(0) {
+		if (!m_ist.good())
+			throw ErrorMessage() << _T("cannot open the input.");
+		if (!m_ost.good())
+			throw ErrorMessage() << _T("cannot open the output.");
+		QueryPerformanceFrequency(&m_frequency);
+	}
+
+	/// write the summary
+	void writeSummary(const Engine &i_engine) {
+		m_ost << _T("# events: ") << m_count
+			  << _T(", total: ") << toMicroseconds(m_total) << _T("us")
+			  << _T(", mean: ")
+			  << (m_count ? toMicroseconds(m_total) / m_count : 0) << _T("us")
+			  << _T(", max: ") << toMicroseconds(m_max) << _T("us")
+			  << std::endl;
+		m_ost << _T("# generated: ") << i_engine.getOutputEventCount()
+			  << _T(", flushes: ") << i_engine.getOutputFlushCount()
+			  << _T(", max events/flush: ")
+			  << i_engine.getOutputMaxEventsPerFlush()
+			  << _T(", cancelled: ") << i_engine.getOutputCancelledCount()
+			  << std::endl;
+	}
+
+	/// write a message as a comment
+	void writeComment(const tstring &i_message) {
+		tstringstream ss(i_message);
+		tstring line;
+		while (std::getline(ss, line))
+			m_ost << _T("# ") << line << std::endl;
+	}
+
+	// InputSource
+	virtual bool read(KEYBOARD_INPUT_DATA *o_kid) {
+		finish();
+		tstringi line;
+		while (std::getline(m_ist, line)) {
+			++ m_lineNumber;
+			size_t comment = line.find(_T('#'));
+			if (comment != tstringi::npos)
+				line.resize(comment);
+			if (line.find_first_not_of(_T(" \t\r")) == tstringi::npos)
+				continue;
+			parse(line, o_kid);
+			m_current = *o_kid;
+			m_hasCurrent = true;
+			QueryPerformanceCounter(&m_start);
+			return true;
+		}
+		return false;
+	}
+
+	// OutputSink
+	virtual void inject(const KEYBOARD_INPUT_DATA &i_kid) {
+		m_injected.push_back(i_kid);
+	}
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ReplayReloader
+
+
+/** load a setting file given on the command line.
+    if !i_doesCompile, the keymaps search their lists */
+static bool loadSetting(Setting *io_setting, const tstringi &i_filename,
+						tomsgstream *io_log, bool i_doesCompile)
+{
+	if (!SettingLoader(io_log, io_log).load(io_setting, i_filename))
+		return false;
+	io_setting->m_keymaps.adjustModifier(io_setting->m_keyboard);
+	if (i_doesCompile)
+		io_setting->m_keymaps.compile(io_setting->m_keyboard);
+	return true;
+}
+
+
+/** reloads and publishes the setting over and over while Engine::replay()
+    runs (yamy -replay -reload), and deletes the old settings as soon as
+    Engine::isApplied() allows, as mayu.cpp does.  it sits between
+    the engine and the Replayer, and reports a setting the engine still
+    uses after it has been deleted.  the setting the engine starts with
+    is not its business. */
+class ReplayReloader : public InputSource, public OutputSink
+{
+	/// a replaced setting and the generation that replaced it
+	typedef std::pair<Setting *, LONG> OldSetting;
+	typedef std::list<OldSetting> Settings;	///
+	typedef std::set<const Setting *> DeletedSettings; ///
+
+	enum {
+		WAIT_TIMEOUT_MS = 5000,			/** longest wait for a reload
+							    before each event */
+	};
+
+	Engine *m_engine;				///
+	Replayer *m_replayer;				///
+	tstringi m_filename;				///
+	Setting::Symbols m_symbols;			///
+	bool m_doesCompile;				///
+	Setting *m_setting;				/// last published
+	Settings m_settings;				/// replaced, not deleted yet
+	HANDLE m_published;				/// a setting has been published
+	HANDLE m_thread;				/// reloading thread
+	volatile LONG m_doesStop;			///
+	int m_reloadCount;				///
+	int m_deleteCount;				///
+
+	CriticalSection m_cs;				/// lock for the following
+	DeletedSettings m_deleted;			/** deleted, and the address
+							    is not used again yet */
+	tstring m_error;				/// the first error
+
+private:
+	///
+	void setError(const tstring &i_error) {
+		Acquire a(&m_cs);
+		if (m_error.empty())
+			m_error = i_error;
+	}
+
+	/// the engine must not use a deleted setting (engine thread)
+	void check() {
+		const Setting *setting = m_engine->getSetting();
+		bool isDeleted;
+		{
+			Acquire a(&m_cs);
+			isDeleted = m_deleted.find(setting) != m_deleted.end();
+		}
+		if (isDeleted) {
+			tstringstream ss;
+			ss << _T("the engine uses the deleted setting 0x") << std::hex
+			   << reinterpret_cast<ULONG_PTR>(setting) << _T(".");
+			setError(ss.str());
+		}
+	}
+
+	/// delete the settings the engine no longer uses
+	void reclaim() {
+		for (Settings::iterator i = m_settings.begin();
+				i != m_settings.end(); ) {
+			if (!m_engine->isApplied((*i).second))
+				++ i;
+			else {
+				{
+					Acquire a(&m_cs);
+					m_deleted.insert((*i).first);
+				}
+				delete (*i).first;
+				++ m_deleteCount;
+				i = m_settings.erase(i);
+			}
+		}
+	}
+
+	/// reloading thread
+	void run() {
+		while (!m_doesStop) {
+			Setting *setting = new Setting;
+			{
+				Acquire a(&m_cs);
+				m_deleted.erase(setting);
+			}
+			setting->m_symbols = m_symbols;
+			tomsgstream log(0);
+			if (!loadSetting(setting, m_filename, &log, m_doesCompile)) {
+				delete setting;
+				setError(_T("failed to reload the setting."));
+				break;
+			}
+			LONG generation = m_engine->publishSetting(setting);
+			if (m_setting)
+				m_settings.push_back(OldSetting(m_setting, generation));
+			m_setting = setting;
+			++ m_reloadCount;
+			SetEvent(m_published);
+			reclaim();
+		}
+		SetEvent(m_published);			// do not keep read() waiting
+	}
+
+	///
+	static unsigned int WINAPI run(void *i_this) {
+		reinterpret_cast<ReplayReloader *>(i_this)->run();
+		_endthreadex(0);
+		return 0;
+	}
+
+public:
+	///
+	ReplayReloader(Engine *i_engine, Replayer *i_replayer,
+				   const tstringi &i_filename,
+				   const Setting::Symbols &i_symbols, bool i_doesCompile)
+		: m_engine(i_engine),
+		  m_replayer(i_replayer),
+		  m_filename(i_filename),
+		  m_symbols(i_symbols),
+		  m_doesCompile(i_doesCompile),
+		  m_setting(NULL),
+		  m_published(NULL),
+		  m_thread(NULL),
+		  m_doesStop(0),
+		  m_reloadCount(0),
+		  m_deleteCount(0) {
+	}
+
+	/// the engine no longer runs, but must still exist
+	~ReplayReloader() {
+		stop();
+		for (Settings::iterator i = m_settings.begin();
+				i != m_settings.end(); ++ i)
+			delete (*i).first;
+		delete m_setting;
+	}
+
+	/** start reloading (engine thread).  before Engine::replay() has
+	    made this the engine thread, publishSetting() would change the
+	    setting directly */
+	void start() {
+		CHECK_TRUE( m_published = CreateEvent(NULL, FALSE, FALSE, NULL) );
+		unsigned int threadId;
+		CHECK_TRUE( m_thread = reinterpret_cast<HANDLE>(
+						_beginthreadex(NULL, 0, run, this, 0, &threadId)) );
+	}
+
+	/// stop reloading
+	void stop() {
+		if (!m_thread)
+			return;
+		InterlockedExchange(&m_doesStop, 1);
+		WaitForSingleObject(m_thread, INFINITE);
+		CHECK_TRUE( CloseHandle(m_thread) );
+		CHECK_TRUE( CloseHandle(m_published) );
+		m_thread = m_published = NULL;
+		reclaim();
+	}
+
+	/** write the summary (and the error).
+	    @return false if there was an error */
+	bool writeSummary() {
+		tstringstream ss;
+		ss << _T("reloads: ") << m_reloadCount
+		   << _T(", deleted: ") << m_deleteCount;
+		m_replayer->writeComment(ss.str());
+		Acquire a(&m_cs);
+		if (m_error.empty())
+			return true;
+		m_replayer->writeComment(tstring(_T("error: ")) + m_error);
+		return false;
+	}
+
+	// InputSource
+	virtual bool read(KEYBOARD_INPUT_DATA *o_kid) {
+		if (!m_thread)
+			start();
+		check();
+		if (!m_replayer->read(o_kid)) {
+			stop();			// no publishSetting() after Engine::replay()
+			return false;
+		}
+		// let at least one reload happen before each event
+		WaitForSingleObject(m_published, WAIT_TIMEOUT_MS);
+		return true;
+	}
+
+	// OutputSink
+	virtual void inject(const KEYBOARD_INPUT_DATA &i_kid) {
+		check();
+		m_replayer->inject(i_kid);
+	}
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// replayMain
+
+
+#ifdef UNICODE
+#  define REPLAY_PATH(i_path) to_string(i_path).c_str()
+#  define REPLAY_STRING(i_str) to_string(i_str)
+#else
+#  define REPLAY_PATH(i_path) (i_path)
+#  define REPLAY_STRING(i_str) (i_str)
+#endif
+
+
+/* tell the user why the replay failed.  yamy is not a console program,
+   so the message goes to the redirected stderr or to the console of the
+   parent, and to a message box if there is neither. */
+static void replayError(const tstring &i_message)
+{
+	HANDLE err = GetStdHandle(STD_ERROR_HANDLE);
+	bool doesClose = false;
+	if ((err == NULL || err == INVALID_HANDLE_VALUE) &&
+			AttachConsole(ATTACH_PARENT_PROCESS)) {
+		err = CreateFile(_T("CONOUT$"), GENERIC_WRITE, FILE_SHARE_WRITE,
+						 NULL, OPEN_EXISTING, 0, NULL);
+		doesClose = true;
+	}
+	if (err == NULL || err == INVALID_HANDLE_VALUE) {
+		MessageBox(NULL, i_message.c_str(), _T("yamy -replay"),
+				   MB_OK | MB_ICONSTOP);
+		return;
+	}
+	std::string message = REPLAY_STRING(i_message + _T("\r\n"));
+	DWORD written;
+	WriteFile(err, message.c_str(), static_cast<DWORD>(message.size()),
+			  &written, NULL);
+	if (doesClose)
+		CloseHandle(err);
+}
+
+
+// replay
+int replayMain(int i_argc, _TCHAR **i_argv)
+{
+	// -D options define symbols, the others are positional
+	std::vector<_TCHAR *> args;
+	Setting *setting = new Setting;
+	bool doesReload = false;
+	bool doesCompile = true;
+	for (int i = 1; i < i_argc; ++ i) {
+		if (i_argv[i][0] == _T('-') && i_argv[i][1] == _T('D'))
+			setting->m_symbols.insert(i_argv[i] + 2);
+		else if (_tcsicmp(i_argv[i], _T("-reload")) == 0)
+			doesReload = true;
+		else if (_tcsicmp(i_argv[i], _T("-nocompile")) == 0)
+			doesCompile = false;
+		else
+			args.push_back(i_argv[i]);
+	}
+	if (args.size() < 4) {
+		replayError(_T("usage: yamy -replay SETTING INPUT OUTPUT ")
+					_T("[CLASS [TITLE]] [-DSYMBOL ...] [-reload] ")
+					_T("[-nocompile]"));
+		delete setting;
+		return 2;
+	}
+	tstringi className = 4 < args.size() ? args[4] : _T("");
+	tstringi titleName = 5 < args.size() ? args[5] : _T("");
+
+	tomsgstream log(0);
+	int result = 0;
+	try {
+		Replayer replayer(REPLAY_PATH(tstring(args[2])),
+						  REPLAY_PATH(tstring(args[3])));
+		try {
+			if (!loadSetting(setting, args[1], &log, doesCompile))
+				throw ErrorMessage() << _T("failed to load the setting.");
+			// what the load log shows for the default setting
+			tstringstream ss;
+			ss << _T("key sequences: ") << setting->m_keySeqs.getSize()
+			   << _T(", shared: ") << setting->m_keySeqs.getSharedCount();
+			replayer.writeComment(ss.str());
+
+			ReplayFocusProvider focusProvider(className, titleName);
+			Engine engine(log);
+			engine.setOutputSink(&replayer);
+			engine.setFocusProvider(&focusProvider);
+			CHECK_TRUE( engine.setSetting(setting) );
+			engine.setFocus(ReplayFocusProvider::getHwnd(), 1,
+							className, titleName, false);
+			ReplayReloader reloader(&engine, &replayer, args[1],
+									setting->m_symbols, doesCompile);
+			if (doesReload) {
+				engine.setOutputSink(&reloader);
+				engine.replay(&reloader);
+				reloader.stop();
+			} else
+				engine.replay(&replayer);
+			replayer.writeSummary(engine);
+			if (doesReload && !reloader.writeSummary())
+				result = 1;
+		} catch (ErrorMessage &i_e) {
+			replayer.writeComment(log.rdbuf()->acquireString());
+			log.rdbuf()->releaseString();
+			replayer.writeComment(tstring(_T("error: ")) + i_e.getMessage());
+			result = 1;
+		}
+	} catch (ErrorMessage &i_e) {
+		replayError(tstring(_T("yamy -replay: ")) + i_e.getMessage());
+		result = 1;
+	}
+	delete setting;
+	return result;
+}
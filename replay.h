@@ -0,0 +1,34 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// replay.h
+
+
+#ifndef _REPLAY_H
+#  define _REPLAY_H
+
+#  include "misc.h"
+#  include <tchar.h>
+
+
+/** run Engine on recorded input without hooks or a driver.
+    usage: yamy -replay SETTING INPUT OUTPUT [CLASS [TITLE]] [-DSYMBOL ...]
+    [-reload] [-nocompile]
+    <dl>
+    <dt>SETTING<dd>setting file, searched like <code>include</code>, or
+    a path
+    <dt>INPUT<dd>one event per line: <code>[D-|U-][E0-][E1-]0xNN</code>
+    <dt>OUTPUT<dd>one line per event: input, generated events and the
+    time spent in microseconds.  lines beginning with # are the number
+    of key sequences of SETTING, a summary and errors
+    <dt>CLASS, TITLE<dd>names of the (fake) focused window
+    <dt>-reload<dd>another thread reloads SETTING and publishes it
+    during the replay, at least once before each event, and the replay
+    fails if a setting is deleted while the engine uses it.  the
+    times include the waits for the reloads.
+    <dt>-nocompile<dd>do not build the key assignment tables of the
+    keymaps (Keymaps::compile()), so every lookup searches the lists
+    </dl>
+    @return 0 on success */
+extern int replayMain(int i_argc, _TCHAR **i_argv);
+
+
+#endif // !_REPLAY_H
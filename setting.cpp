@@ -6,18 +6,18 @@
 
 #include "dlgsetting.h"
 #include "errormessage.h"
+#include "keywordtable.h"
 #include "mayu.h"
 #include "mayurc.h"
 #include "registry.h"
 #include "setting.h"
+#include "textfile.h"
 #include "windowstool.h"
 #include "vkeytable.h"
-#include "array.h"
 
 #include <algorithm>
 #include <fstream>
 #include <iomanip>
-#include <sys/stat.h>
 
 
 namespace Event
@@ -186,6 +186,7 @@ void SettingLoader::load_INCLUDE()
 	SettingLoader loader(m_soLog, m_log);
 	loader.m_defaultAssignModifier = m_defaultAssignModifier;
 	loader.m_defaultKeySeqModifier = m_defaultKeySeqModifier;
+	loader.m_isIncluded = true;
 	if (!loader.load(m_setting, (*getToken()).getString()))
 		m_isThereAnyError = true;
 }
@@ -378,6 +379,24 @@ void SettingLoader::load_DEFINE_OPTION()
 
 		load_ARGUMENT(&m_setting->m_dragThreshold);
 
+	} else if (*t == _T("cancel-modifier-toggle")) {
+		if (*getToken() != _T("=")) {
+			throw ErrorMessage()
+			<< _T("there must be `=' after `def option cancel-modifier-toggle'.");
+		}
+
+		load_ARGUMENT(&m_setting->m_cancelModifierToggle);
+
+	} else if (*t == _T("share-keyseq")) {
+		if (*getToken() != _T("=")) {
+			throw ErrorMessage()
+			<< _T("there must be `=' after `def option share-keyseq'.");
+		}
+
+		bool doesShare;
+		load_ARGUMENT(&doesShare);
+		m_setting->m_keySeqs.setDoesShareAnonymous(doesShare);
+
 	} else {
 		throw ErrorMessage() << _T("syntax error `def option ") << *t << _T("'.");
 	}
@@ -429,93 +448,91 @@ Modifier SettingLoader::load_MODIFIER(
 		isModifierSpecified.on(Modifier::Type(i));
 	}
 
+	typedef KeywordTable<Modifier::Type> ModifierTable;
+	static const ModifierTable::Entry entries[] = {
+		// <BASIC_MODIFIER>
+		{ _T("S-"),  Modifier::Type_Shift },
+		{ _T("A-"),  Modifier::Type_Alt },
+		{ _T("M-"),  Modifier::Type_Alt },
+		{ _T("C-"),  Modifier::Type_Control },
+		{ _T("W-"),  Modifier::Type_Windows },
+		// <KEYSEQ_MODIFIER>
+		{ _T("U-"),  Modifier::Type_Up },
+		{ _T("D-"),  Modifier::Type_Down },
+		// <ASSIGN_MODIFIER>
+		{ _T("R-"),  Modifier::Type_Repeat },
+		{ _T("IL-"), Modifier::Type_ImeLock },
+		{ _T("IC-"), Modifier::Type_ImeComp },
+		{ _T("I-"),  Modifier::Type_ImeComp },
+		{ _T("NL-"), Modifier::Type_NumLock },
+		{ _T("CL-"), Modifier::Type_CapsLock },
+		{ _T("SL-"), Modifier::Type_ScrollLock },
+		{ _T("KL-"), Modifier::Type_KanaLock },
+		{ _T("MAX-"), Modifier::Type_Maximized },
+		{ _T("MIN-"), Modifier::Type_Minimized },
+		{ _T("MMAX-"), Modifier::Type_MdiMaximized },
+		{ _T("MMIN-"), Modifier::Type_MdiMinimized },
+		{ _T("T-"), Modifier::Type_Touchpad },
+		{ _T("TS-"), Modifier::Type_TouchpadSticky },
+		{ _T("M0-"), Modifier::Type_Mod0 },
+		{ _T("M1-"), Modifier::Type_Mod1 },
+		{ _T("M2-"), Modifier::Type_Mod2 },
+		{ _T("M3-"), Modifier::Type_Mod3 },
+		{ _T("M4-"), Modifier::Type_Mod4 },
+		{ _T("M5-"), Modifier::Type_Mod5 },
+		{ _T("M6-"), Modifier::Type_Mod6 },
+		{ _T("M7-"), Modifier::Type_Mod7 },
+		{ _T("M8-"), Modifier::Type_Mod8 },
+		{ _T("M9-"), Modifier::Type_Mod9 },
+		{ _T("L0-"), Modifier::Type_Lock0 },
+		{ _T("L1-"), Modifier::Type_Lock1 },
+		{ _T("L2-"), Modifier::Type_Lock2 },
+		{ _T("L3-"), Modifier::Type_Lock3 },
+		{ _T("L4-"), Modifier::Type_Lock4 },
+		{ _T("L5-"), Modifier::Type_Lock5 },
+		{ _T("L6-"), Modifier::Type_Lock6 },
+		{ _T("L7-"), Modifier::Type_Lock7 },
+		{ _T("L8-"), Modifier::Type_Lock8 },
+		{ _T("L9-"), Modifier::Type_Lock9 },
+	};
+	static const ModifierTable modifiers(entries);
+
 	Token *t = NULL;
 
 continue_loop:
 	while (!isEOL()) {
 		t = lookToken();
 
-		const static struct {
-			const _TCHAR *m_s;
-			Modifier::Type m_mt;
-		} map[] = {
-			// <BASIC_MODIFIER>
-			{ _T("S-"),  Modifier::Type_Shift },
-			{ _T("A-"),  Modifier::Type_Alt },
-			{ _T("M-"),  Modifier::Type_Alt },
-			{ _T("C-"),  Modifier::Type_Control },
-			{ _T("W-"),  Modifier::Type_Windows },
-			// <KEYSEQ_MODIFIER>
-			{ _T("U-"),  Modifier::Type_Up },
-			{ _T("D-"),  Modifier::Type_Down },
-			// <ASSIGN_MODIFIER>
-			{ _T("R-"),  Modifier::Type_Repeat },
-			{ _T("IL-"), Modifier::Type_ImeLock },
-			{ _T("IC-"), Modifier::Type_ImeComp },
-			{ _T("I-"),  Modifier::Type_ImeComp },
-			{ _T("NL-"), Modifier::Type_NumLock },
-			{ _T("CL-"), Modifier::Type_CapsLock },
-			{ _T("SL-"), Modifier::Type_ScrollLock },
-			{ _T("KL-"), Modifier::Type_KanaLock },
-			{ _T("MAX-"), Modifier::Type_Maximized },
-			{ _T("MIN-"), Modifier::Type_Minimized },
-			{ _T("MMAX-"), Modifier::Type_MdiMaximized },
-			{ _T("MMIN-"), Modifier::Type_MdiMinimized },
-			{ _T("T-"), Modifier::Type_Touchpad },
-			{ _T("TS-"), Modifier::Type_TouchpadSticky },
-			{ _T("M0-"), Modifier::Type_Mod0 },
-			{ _T("M1-"), Modifier::Type_Mod1 },
-			{ _T("M2-"), Modifier::Type_Mod2 },
-			{ _T("M3-"), Modifier::Type_Mod3 },
-			{ _T("M4-"), Modifier::Type_Mod4 },
-			{ _T("M5-"), Modifier::Type_Mod5 },
-			{ _T("M6-"), Modifier::Type_Mod6 },
-			{ _T("M7-"), Modifier::Type_Mod7 },
-			{ _T("M8-"), Modifier::Type_Mod8 },
-			{ _T("M9-"), Modifier::Type_Mod9 },
-			{ _T("L0-"), Modifier::Type_Lock0 },
-			{ _T("L1-"), Modifier::Type_Lock1 },
-			{ _T("L2-"), Modifier::Type_Lock2 },
-			{ _T("L3-"), Modifier::Type_Lock3 },
-			{ _T("L4-"), Modifier::Type_Lock4 },
-			{ _T("L5-"), Modifier::Type_Lock5 },
-			{ _T("L6-"), Modifier::Type_Lock6 },
-			{ _T("L7-"), Modifier::Type_Lock7 },
-			{ _T("L8-"), Modifier::Type_Lock8 },
-			{ _T("L9-"), Modifier::Type_Lock9 },
-		};
-
-		for (int i = 0; i < NUMBER_OF(map); ++ i)
-			if (*t == map[i].m_s) {
-				getToken();
-				Modifier::Type mt = map[i].m_mt;
-				if (static_cast<int>(i_mode) <= static_cast<int>(mt))
-					throw ErrorMessage() << _T("`") << *t
-					<< _T("': invalid modifier at this context.");
-				switch (flag) {
-				case PRESS:
-					i_modifier.press(mt);
-					break;
-				case RELEASE:
-					i_modifier.release(mt);
-					break;
-				case DONTCARE:
-					i_modifier.dontcare(mt);
-					break;
-				}
-				isModifierSpecified.on(mt);
-				flag = PRESS;
-
-				if (o_mode && *o_mode < mt) {
-					if (mt < Modifier::Type_BASIC)
-						*o_mode = Modifier::Type_BASIC;
-					else if (mt < Modifier::Type_KEYSEQ)
-						*o_mode = Modifier::Type_KEYSEQ;
-					else if (mt < Modifier::Type_ASSIGN)
-						*o_mode = Modifier::Type_ASSIGN;
-				}
-				goto continue_loop;
+		if (const Modifier::Type *type = modifiers.search(*t)) {
+			getToken();
+			Modifier::Type mt = *type;
+			if (static_cast<int>(i_mode) <= static_cast<int>(mt))
+				throw ErrorMessage() << _T("`") << *t
+				<< _T("': invalid modifier at this context.");
+			switch (flag) {
+			case PRESS:
+				i_modifier.press(mt);
+				break;
+			case RELEASE:
+				i_modifier.release(mt);
+				break;
+			case DONTCARE:
+				i_modifier.dontcare(mt);
+				break;
 			}
+			isModifierSpecified.on(mt);
+			flag = PRESS;
+
+			if (o_mode && *o_mode < mt) {
+				if (mt < Modifier::Type_BASIC)
+					*o_mode = Modifier::Type_BASIC;
+				else if (mt < Modifier::Type_KEYSEQ)
+					*o_mode = Modifier::Type_KEYSEQ;
+				else if (mt < Modifier::Type_ASSIGN)
+					*o_mode = Modifier::Type_ASSIGN;
+			}
+			goto continue_loop;
+		}
 
 		if (*t == _T("*")) {
 			getToken();
@@ -626,6 +643,11 @@ void SettingLoader::load_KEYMAP_DEFINITION(const Token *i_which)
 			doesLoadDefaultKeySeq = true;
 	}
 
+	// the keymap compiles its regexps when they are used first
+	if (type != Keymap::Type_keymap) {
+		WindowPattern::validate(windowClassName);
+		WindowPattern::validate(windowTitleName);
+	}
 	m_currentKeymap = m_setting->m_keymaps.add(
 						  Keymap(type, name->getString(), windowClassName, windowTitleName,
 								 NULL, NULL));
@@ -1055,6 +1077,29 @@ void SettingLoader::load_EVENT_ASSIGN()
 // <MODIFIER_ASSIGNMENT>
 void SettingLoader::load_MODIFIER_ASSIGNMENT()
 {
+	typedef KeywordTable<Modifier::Type> ModifierTable;
+	static const ModifierTable::Entry entries[] = {
+		{ _T("shift"), Modifier::Type_Shift },
+		{ _T("alt"), Modifier::Type_Alt },
+		{ _T("meta"), Modifier::Type_Alt },
+		{ _T("menu"), Modifier::Type_Alt },
+		{ _T("control"), Modifier::Type_Control },
+		{ _T("ctrl"), Modifier::Type_Control },
+		{ _T("windows"), Modifier::Type_Windows },
+		{ _T("win"), Modifier::Type_Windows },
+		{ _T("mod0"), Modifier::Type_Mod0 },
+		{ _T("mod1"), Modifier::Type_Mod1 },
+		{ _T("mod2"), Modifier::Type_Mod2 },
+		{ _T("mod3"), Modifier::Type_Mod3 },
+		{ _T("mod4"), Modifier::Type_Mod4 },
+		{ _T("mod5"), Modifier::Type_Mod5 },
+		{ _T("mod6"), Modifier::Type_Mod6 },
+		{ _T("mod7"), Modifier::Type_Mod7 },
+		{ _T("mod8"), Modifier::Type_Mod8 },
+		{ _T("mod9"), Modifier::Type_Mod9 },
+	};
+	static const ModifierTable modifiers(entries);
+
 	// <MODIFIER_NAME>
 	Token *t = getToken();
 	Modifier::Type mt;
@@ -1065,24 +1110,8 @@ void SettingLoader::load_MODIFIER_ASSIGNMENT()
 		else if (*t == _T("!!") ) am = Keymap::AM_oneShot, t = getToken();
 		else if (*t == _T("!!!")) am = Keymap::AM_oneShotRepeatable, t = getToken();
 
-		if      (*t == _T("shift")) mt = Modifier::Type_Shift;
-		else if (*t == _T("alt")  ||
-				 *t == _T("meta") ||
-				 *t == _T("menu") ) mt = Modifier::Type_Alt;
-		else if (*t == _T("control") ||
-				 *t == _T("ctrl") ) mt = Modifier::Type_Control;
-		else if (*t == _T("windows") ||
-				 *t == _T("win")  ) mt = Modifier::Type_Windows;
-		else if (*t == _T("mod0") ) mt = Modifier::Type_Mod0;
-		else if (*t == _T("mod1") ) mt = Modifier::Type_Mod1;
-		else if (*t == _T("mod2") ) mt = Modifier::Type_Mod2;
-		else if (*t == _T("mod3") ) mt = Modifier::Type_Mod3;
-		else if (*t == _T("mod4") ) mt = Modifier::Type_Mod4;
-		else if (*t == _T("mod5") ) mt = Modifier::Type_Mod5;
-		else if (*t == _T("mod6") ) mt = Modifier::Type_Mod6;
-		else if (*t == _T("mod7") ) mt = Modifier::Type_Mod7;
-		else if (*t == _T("mod8") ) mt = Modifier::Type_Mod8;
-		else if (*t == _T("mod9") ) mt = Modifier::Type_Mod9;
+		if (const Modifier::Type *type = modifiers.search(*t))
+			mt = *type;
 		else throw ErrorMessage() << _T("`") << *t
 			<< _T("': invalid modifier name.");
 
@@ -1223,37 +1252,97 @@ void SettingLoader::load_LINE()
 {
 	Token *i_token = getToken();
 
+	enum Statement {
+		Statement_if, Statement_else, Statement_elseif, Statement_endif,
+		Statement_define, Statement_include, Statement_def,
+		Statement_keymap, Statement_key, Statement_event, Statement_mod,
+		Statement_keyseq,
+	};
+	typedef KeywordTable<Statement> Statements;
+	static const Statements::Entry entries[] = {
+		// <COND_SYMBOL>
+		{ _T("if"), Statement_if },
+		{ _T("and"), Statement_if },
+		{ _T("else"), Statement_else },
+		{ _T("elseif"), Statement_elseif },
+		{ _T("elsif"), Statement_elseif },
+		{ _T("elif"), Statement_elseif },
+		{ _T("or"), Statement_elseif },
+		{ _T("endif"), Statement_endif },
+		{ _T("define"), Statement_define },
+		// <INCLUDE>
+		{ _T("include"), Statement_include },
+		// <KEYBOARD_DEFINITION>
+		{ _T("def"), Statement_def },
+		// <KEYMAP_DEFINITION>
+		{ _T("keymap"), Statement_keymap },
+		{ _T("keymap2"), Statement_keymap },
+		{ _T("window"), Statement_keymap },
+		// <KEY_ASSIGN>
+		{ _T("key"), Statement_key },
+		// <EVENT_ASSIGN>
+		{ _T("event"), Statement_event },
+		// <MODIFIER_ASSIGNMENT>
+		{ _T("mod"), Statement_mod },
+		// <KEYSEQ_DEFINITION>
+		{ _T("keyseq"), Statement_keyseq },
+	};
+	static const Statements statements(entries);
+	const Statement *statement = statements.search(*i_token);
+
 	// <COND_SYMBOL>
-	if      (*i_token == _T("if") ||
-			 *i_token == _T("and")) load_IF();
-	else if (*i_token == _T("else")) load_ELSE(false, i_token->getString());
-	else if (*i_token == _T("elseif") ||
-			 *i_token == _T("elsif")  ||
-			 *i_token == _T("elif")   ||
-			 *i_token == _T("or")) load_ELSE(true, i_token->getString());
-	else if (*i_token == _T("endif")) load_ENDIF(_T("endif"));
-	else if (0 < m_canReadStack.size() && !m_canReadStack.back()) {
+	if (statement)
+		switch (*statement) {
+		case Statement_if:
+			load_IF();
+			return;
+		case Statement_else:
+			load_ELSE(false, i_token->getString());
+			return;
+		case Statement_elseif:
+			load_ELSE(true, i_token->getString());
+			return;
+		case Statement_endif:
+			load_ENDIF(_T("endif"));
+			return;
+		default:
+			break;
+		}
+	if (0 < m_canReadStack.size() && !m_canReadStack.back()) {
 		while (!isEOL())
 			getToken();
-	} else if (*i_token == _T("define")) load_DEFINE();
-	// <INCLUDE>
-	else if (*i_token == _T("include")) load_INCLUDE();
-	// <KEYBOARD_DEFINITION>
-	else if (*i_token == _T("def")) load_KEYBOARD_DEFINITION();
-	// <KEYMAP_DEFINITION>
-	else if (*i_token == _T("keymap")  ||
-			 *i_token == _T("keymap2") ||
-			 *i_token == _T("window")) load_KEYMAP_DEFINITION(i_token);
-	// <KEY_ASSIGN>
-	else if (*i_token == _T("key")) load_KEY_ASSIGN();
-	// <EVENT_ASSIGN>
-	else if (*i_token == _T("event")) load_EVENT_ASSIGN();
-	// <MODIFIER_ASSIGNMENT>
-	else if (*i_token == _T("mod")) load_MODIFIER_ASSIGNMENT();
-	// <KEYSEQ_DEFINITION>
-	else if (*i_token == _T("keyseq")) load_KEYSEQ_DEFINITION();
-	else
-		throw ErrorMessage() << _T("syntax error `") << *i_token << _T("'.");
+		return;
+	}
+	if (statement)
+		switch (*statement) {
+		case Statement_define:
+			load_DEFINE();
+			return;
+		case Statement_include:
+			load_INCLUDE();
+			return;
+		case Statement_def:
+			load_KEYBOARD_DEFINITION();
+			return;
+		case Statement_keymap:
+			load_KEYMAP_DEFINITION(i_token);
+			return;
+		case Statement_key:
+			load_KEY_ASSIGN();
+			return;
+		case Statement_event:
+			load_EVENT_ASSIGN();
+			return;
+		case Statement_mod:
+			load_MODIFIER_ASSIGNMENT();
+			return;
+		case Statement_keyseq:
+			load_KEYSEQ_DEFINITION();
+			return;
+		default:
+			break;
+		}
+	throw ErrorMessage() << _T("syntax error `") << *i_token << _T("'.");
 }
 
 
@@ -1264,163 +1353,33 @@ static bool prefixSortPred(const tstringi &i_a, const tstringi &i_b)
 }
 
 
-/*
-  _UNICODE: read file (UTF-16 LE/BE, UTF-8, locale specific multibyte encoding)
-  _MBCS: read file
-*/
-bool readFile(tstring *o_data, const tstringi &i_filename)
+// load m_tokens as a line of m_currentFilename
+void SettingLoader::loadTokens(size_t i_lineNumber)
 {
-	// get size of file
-#if 0
-	// bcc's _wstat cannot obtain file size
-	struct _stat sbuf;
-	if (_tstat(i_filename.c_str(), &sbuf) < 0 || sbuf.st_size == 0)
-		return false;
-#else
-	// so, we use _wstati64 for bcc
-	struct stati64_t sbuf;
-	if (_tstati64(i_filename.c_str(), &sbuf) < 0 || sbuf.st_size == 0)
-		return false;
-	// following check is needed to cast sbuf.st_size to size_t safely
-	// this cast occurs because of above workaround for bcc
-	if (sbuf.st_size > UINT_MAX)
-		return false;
-#endif
-
-	// open
-	FILE *fp = _tfopen(i_filename.c_str(), _T("rb"));
-	if (!fp)
-		return false;
-
-	// read file
-	Array<BYTE> buf(static_cast<size_t>(sbuf.st_size) + 1);
-	if (fread(buf.get(), static_cast<size_t>(sbuf.st_size), 1, fp) != 1) {
-		fclose(fp);
-		return false;
-	}
-	buf.get()[sbuf.st_size] = 0;			// mbstowcs() requires null
-	// terminated string
-
-#ifdef _UNICODE
-	//
-	if (buf.get()[0] == 0xffU && buf.get()[1] == 0xfeU &&
-			sbuf.st_size % 2 == 0)
-		// UTF-16 Little Endien
-	{
-		size_t size = static_cast<size_t>(sbuf.st_size) / 2;
-		o_data->resize(size);
-		BYTE *p = buf.get();
-		for (size_t i = 0; i < size; ++ i) {
-			wchar_t c = static_cast<wchar_t>(*p ++);
-			c |= static_cast<wchar_t>(*p ++) << 8;
-			(*o_data)[i] = c;
-		}
-		fclose(fp);
-		return true;
-	}
-
-	//
-	if (buf.get()[0] == 0xfeU && buf.get()[1] == 0xffU &&
-			sbuf.st_size % 2 == 0)
-		// UTF-16 Big Endien
-	{
-		size_t size = static_cast<size_t>(sbuf.st_size) / 2;
-		o_data->resize(size);
-		BYTE *p = buf.get();
-		for (size_t i = 0; i < size; ++ i) {
-			wchar_t c = static_cast<wchar_t>(*p ++) << 8;
-			c |= static_cast<wchar_t>(*p ++);
-			(*o_data)[i] = c;
+	try {
+		load_LINE();
+		if (!isEOL())
+			throw WarningMessage() << _T("back garbage is ignored.");
+	} catch (WarningMessage &w) {
+		if (m_log && m_soLog) {
+			Acquire a(m_soLog);
+			*m_log << m_currentFilename << _T("(") << i_lineNumber
+			<< _T(") : warning: ") << w << std::endl;
 		}
-		fclose(fp);
-		return true;
-	}
-
-	// try multibyte charset
-	size_t wsize = mbstowcs(NULL, reinterpret_cast<char *>(buf.get()), 0);
-	if (wsize != size_t(-1)) {
-		Array<wchar_t> wbuf(wsize);
-		mbstowcs(wbuf.get(), reinterpret_cast<char *>(buf.get()), wsize);
-		o_data->assign(wbuf.get(), wbuf.get() + wsize);
-		fclose(fp);
-		return true;
-	}
-
-	// try UTF-8
-	{
-		Array<wchar_t> wbuf(static_cast<size_t>(sbuf.st_size));
-		BYTE *f = buf.get();
-		BYTE *end = buf.get() + sbuf.st_size;
-		wchar_t *d = wbuf.get();
-		enum { STATE_1, STATE_2of2, STATE_2of3, STATE_3of3 } state = STATE_1;
-
-		while (f != end) {
-			switch (state) {
-			case STATE_1:
-				if (!(*f & 0x80))			// 0xxxxxxx: 00-7F
-					*d++ = static_cast<wchar_t>(*f++);
-				else if ((*f & 0xe0) == 0xc0) {	// 110xxxxx 10xxxxxx: 0080-07FF
-					*d = ((static_cast<wchar_t>(*f++) & 0x1f) << 6);
-					state = STATE_2of2;
-				} else if ((*f & 0xf0) == 0xe0)		// 1110xxxx 10xxxxxx 10xxxxxx:
-					// 0800 - FFFF
-				{
-					*d = ((static_cast<wchar_t>(*f++) & 0x0f) << 12);
-					state = STATE_2of3;
-				} else
-					goto not_UTF_8;
-				break;
-
-			case STATE_2of2:
-			case STATE_3of3:
-				if ((*f & 0xc0) != 0x80)
-					goto not_UTF_8;
-				*d++ |= (static_cast<wchar_t>(*f++) & 0x3f);
-				state = STATE_1;
-				break;
-
-			case STATE_2of3:
-				if ((*f & 0xc0) != 0x80)
-					goto not_UTF_8;
-				*d |= ((static_cast<wchar_t>(*f++) & 0x3f) << 6);
-				state = STATE_3of3;
-				break;
-			}
+	} catch (ErrorMessage &e) {
+		if (m_log && m_soLog) {
+			Acquire a(m_soLog);
+			*m_log << m_currentFilename << _T("(") << i_lineNumber
+			<< _T(") : error: ") << e << std::endl;
 		}
-		o_data->assign(wbuf.get(), d);
-		fclose(fp);
-		return true;
-
-not_UTF_8:
-		;
+		m_isThereAnyError = true;
 	}
-#endif // _UNICODE
-
-	// assume ascii
-	o_data->resize(static_cast<size_t>(sbuf.st_size));
-	for (off_t i = 0; i < sbuf.st_size; ++ i)
-		(*o_data)[i] = buf.get()[i];
-	fclose(fp);
-	return true;
 }
 
 
-// load (called from load(Setting *, const tstringi &) only)
-void SettingLoader::load(const tstringi &i_filename)
+// parse and load i_data
+size_t SettingLoader::loadData(const tstring &i_data)
 {
-	m_currentFilename = i_filename;
-
-	tstring data;
-	if (!readFile(&data, m_currentFilename)) {
-		Acquire a(m_soLog);
-		*m_log << m_currentFilename << _T(" : error: file not found") << std::endl;
-#if 1
-		*m_log << data << std::endl;
-#endif
-		m_isThereAnyError = true;
-		return;
-	}
-
 	// prefix
 	if (m_prefixesRefCcount == 0) {
 		static const _TCHAR *prefixes[] = {
@@ -1447,7 +1406,7 @@ void SettingLoader::load(const tstringi &i_filename)
 	m_prefixesRefCcount ++;
 
 	// create parser
-	Parser parser(data.c_str(), data.size());
+	Parser parser(i_data.c_str(), i_data.size());
 	parser.setPrefixes(m_prefixes);
 
 	while (true) {
@@ -1465,24 +1424,7 @@ void SettingLoader::load(const tstringi &i_filename)
 			continue;
 		}
 
-		try {
-			load_LINE();
-			if (!isEOL())
-				throw WarningMessage() << _T("back garbage is ignored.");
-		} catch (WarningMessage &w) {
-			if (m_log && m_soLog) {
-				Acquire a(m_soLog);
-				*m_log << i_filename << _T("(") << parser.getLineNumber()
-				<< _T(") : warning: ") << w << std::endl;
-			}
-		} catch (ErrorMessage &e) {
-			if (m_log && m_soLog) {
-				Acquire a(m_soLog);
-				*m_log << i_filename << _T("(") << parser.getLineNumber()
-				<< _T(") : error: ") << e << std::endl;
-			}
-			m_isThereAnyError = true;
-		}
+		loadTokens(parser.getLineNumber());
 	}
 
 	// m_prefixes
@@ -1490,9 +1432,47 @@ void SettingLoader::load(const tstringi &i_filename)
 	if (m_prefixesRefCcount == 0)
 		delete m_prefixes;
 
+	return parser.getLineNumber();
+}
+
+
+// FNV-1a 64 of the decoded text of a file
+static u_int64 getHash(const tstring &i_data)
+{
+	u_int64 hash = 14695981039346656037ULL;
+	const BYTE *p = reinterpret_cast<const BYTE *>(i_data.data());
+	const BYTE *end = p + i_data.size() * sizeof(_TCHAR);
+	for (; p != end; ++ p) {
+		hash ^= *p;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+// load (called from load(Setting *, const tstringi &) only)
+void SettingLoader::load(const tstringi &i_name, const tstringi &i_path)
+{
+	m_currentFilename = i_path;
+
+	tstring data;
+	if (!readFile(&data, m_currentFilename)) {
+		Acquire a(m_soLog);
+		*m_log << m_currentFilename << _T(" : error: file not found") << std::endl;
+#if 1
+		*m_log << data << std::endl;
+#endif
+		m_isThereAnyError = true;
+		return;
+	}
+
+	m_setting->m_sources.push_back(
+		Setting::Source(i_name, i_path, getHash(data)));
+	size_t lastLineNumber = loadData(data);
+
 	if (0 < m_canReadStack.size()) {
 		Acquire a(m_soLog);
-		*m_log << m_currentFilename << _T("(") << parser.getLineNumber()
+		*m_log << m_currentFilename << _T("(") << lastLineNumber
 		<< _T(") : error: unbalanced `if'.  ")
 		<< _T("you forget `endif', didn'i_token you?")
 		<< std::endl;
@@ -1614,6 +1594,14 @@ add_symbols:
 				return true;
 		}
 
+		// a name with a directory may also be a path from the current
+		// directory or an absolute path (e.g. yamy -replay)
+		if (name.find_first_of(_T("\\/:")) != tstringi::npos) {
+			*o_path = name;
+			if (isReadable(*o_path, i_debugLevel))
+				return true;
+		}
+
 		if (!i_name.empty())
 			return false;				// called by 'include'
 
@@ -1630,21 +1618,61 @@ SettingLoader::SettingLoader(SyncObject *i_soLog, tostream *i_log)
 		m_isThereAnyError(false),
 		m_soLog(i_soLog),
 		m_log(i_log),
-		m_currentKeymap(NULL)
+		m_isIncluded(false),
+		m_currentKeymap(NULL),
+		m_isDuplicate(false)
 {
 	m_defaultKeySeqModifier =
 		m_defaultAssignModifier.release(Modifier::Type_ImeComp);
 }
 
 
+// would m_setting be loaded from the same files as i_previous ?
+bool SettingLoader::isDuplicate(const Setting *i_previous,
+								const tstringi &i_path) const
+{
+	// the loading depends on nothing but the symbols and the files
+	if (!i_previous || i_previous->m_sources.empty() ||
+			i_previous->m_givenSymbols != m_setting->m_symbols)
+		return false;
+
+	HomeDirectories pathes;
+	getHomeDirectories(&pathes);
+	for (Setting::Sources::const_iterator i = i_previous->m_sources.begin();
+			i != i_previous->m_sources.end(); ++ i) {
+		// an included file must still be found at the same path
+		tstringi path = i_path;
+		tstring data;
+		if ((*i).m_name.empty()) {
+			if (!readFile(&data, path))
+				return false;
+		} else {
+			HomeDirectories::iterator j = pathes.begin();
+			for (; j != pathes.end(); ++ j) {
+				path = *j + _T("\\") + (*i).m_name;
+				if (readFile(&data, path))
+					break;
+			}
+			if (j == pathes.end())
+				return false;
+		}
+		if (path != (*i).m_path || getHash(data) != (*i).m_hash)
+			return false;
+	}
+	return true;
+}
+
+
 /* load m_setting
    If called by "include", 'filename' describes filename.
    Otherwise the 'filename' is empty.
  */
-bool SettingLoader::load(Setting *i_setting, const tstringi &i_filename)
+bool SettingLoader::load(Setting *i_setting, const tstringi &i_filename,
+						 const Setting *i_previous)
 {
 	m_setting = i_setting;
 	m_isThereAnyError = false;
+	m_isDuplicate = false;
 
 	tstringi path;
 	if (!getFilename(i_filename, &path)) {
@@ -1657,6 +1685,19 @@ bool SettingLoader::load(Setting *i_setting, const tstringi &i_filename)
 			<< _T("': no such file or other error.");
 	}
 
+	LARGE_INTEGER begin, end, frequency;
+	QueryPerformanceFrequency(&frequency);
+	if (!m_isIncluded) {
+		QueryPerformanceCounter(&begin);
+
+		// keep i_previous if none of its files have changed
+		if (isDuplicate(i_previous, path)) {
+			m_isDuplicate = true;
+			return true;
+		}
+		m_setting->m_givenSymbols = m_setting->m_symbols;
+	}
+
 	// create global keymap's default keySeq
 	ActionFunction af(createFunctionData(_T("OtherWindowClass")));
 	KeySeq *globalDefault = m_setting->m_keySeqs.add(KeySeq(_T("")).add(af));
@@ -1682,11 +1723,26 @@ bool SettingLoader::load(Setting *i_setting, const tstringi &i_filename)
 	*/
 
 	// load
-	load(path);
+	load(i_filename, path);
 
 	// finalize
-	if (i_filename.empty())
+	if (i_filename.empty()) {
 		m_setting->m_keymaps.adjustModifier(m_setting->m_keyboard);
+		m_setting->m_keymaps.compile(m_setting->m_keyboard);
+	}
+
+	if (!m_isIncluded) {
+		QueryPerformanceCounter(&end);
+		if (m_log && m_soLog) {
+			Acquire a(m_soLog, 0);
+			*m_log << _T("  loaded in ")
+			<< (end.QuadPart - begin.QuadPart) * 1000 / frequency.QuadPart
+			<< _T("ms") << std::endl;
+			*m_log << _T("  ") << m_setting->m_keySeqs.getSize()
+			<< _T(" key sequences (") << m_setting->m_keySeqs.getSharedCount()
+			<< _T(" more are shared)") << std::endl;
+		}
+	}
 
 	return !m_isThereAnyError;
 }
@@ -19,6 +19,22 @@ public:
 	typedef std::set<tstringi> Symbols;		///
 	typedef std::list<Modifier> Modifiers;	///
 
+	/// a file this setting was loaded from
+	class Source
+	{
+	public:
+		tstringi m_name;				/// name given to include
+		tstringi m_path;				/// found path
+		u_int64 m_hash;				/// hash of the decoded text
+
+	public:
+		///
+		Source(const tstringi &i_name, const tstringi &i_path,
+			   u_int64 i_hash)
+			: m_name(i_name), m_path(i_path), m_hash(i_hash) { }
+	};
+	typedef std::vector<Source> Sources;		///
+
 public:
 	Keyboard m_keyboard;				///
 	Keymaps m_keymaps;				///
@@ -30,6 +46,11 @@ public:
 	bool m_mouseEvent;				///
 	LONG m_dragThreshold;			///
 	unsigned int m_oneShotRepeatableDelay;	///
+	bool m_cancelModifierToggle;			/** remove redundant
+						    modifier events */
+	Sources m_sources;				/// loaded files
+	Symbols m_givenSymbols;			/** m_symbols before the
+						    files are loaded */
 
 public:
 	Setting()
@@ -38,7 +59,8 @@ public:
 			m_cts4mayu(false),
 			m_mouseEvent(false),
 			m_dragThreshold(0),
-			m_oneShotRepeatableDelay(0) { }
+			m_oneShotRepeatableDelay(0),
+			m_cancelModifierToggle(false) { }
 };
 
 
@@ -85,6 +107,8 @@ private:
 	tostream *m_log;				/// log output stream
 
 	tstringi m_currentFilename;			/// current filename
+	bool m_isIncluded;				/** is this the loader of an
+						    included file ? */
 
 	Tokens m_tokens;				/// tokens for current line
 	Tokens::iterator m_ti;			/// current processing token
@@ -101,6 +125,9 @@ private:
 	Modifier m_defaultKeySeqModifier;		/** default
                                                     &lt;KEYSEQ_MODIFIER&gt; */
 
+	bool m_isDuplicate;				/** has the load been skipped
+						    as a duplicate ? */
+
 private:
 	bool isEOL();					/// is there no more tokens ?
 	Token *getToken();				/// get next token
@@ -165,8 +192,19 @@ private:
 	void load_LOCK_ASSIGNMENT();			/// &lt;LOCK_ASSIGN&gt;
 	void load_KEYSEQ_DEFINITION();		/// &lt;KEYSEQ_DEFINITION&gt;
 
+	/// load m_tokens as a line of m_currentFilename
+	void loadTokens(size_t i_lineNumber);
+	/** parse and load i_data (the contents of m_currentFilename).
+	    @return the last line number */
+	size_t loadData(const tstring &i_data);
+
 	/// load
-	void load(const tstringi &i_filename);
+	void load(const tstringi &i_name, const tstringi &i_path);
+
+	/** would m_setting be loaded from the same files with the same
+	    contents and symbols as i_previous ?
+	    (i_path is the found path of the dot file) */
+	bool isDuplicate(const Setting *i_previous, const tstringi &i_path) const;
 
 	/// is the filename readable ?
 	bool isReadable(const tstringi &i_filename, int i_debugLevel = 1) const;
@@ -179,8 +217,19 @@ public:
 	///
 	SettingLoader(SyncObject *i_soLog, tostream *i_log);
 
-	/// load setting
-	bool load(Setting *o_setting, const tstringi &i_filename = _T(""));
+	/** load setting.
+	    i_previous suppresses duplicate reloads: a file watcher may report
+	    a write that left the contents as they were, or report one change
+	    several times.  if i_previous is given and none of its files have
+	    changed, nothing is loaded and isDuplicate() becomes true.  any
+	    change loads every file again. */
+	bool load(Setting *o_setting, const tstringi &i_filename = _T(""),
+			  const Setting *i_previous = NULL);
+
+	/// has the load been skipped as a duplicate of i_previous ?
+	bool isDuplicate() const {
+		return m_isDuplicate;
+	}
 };
 
 
@@ -0,0 +1,418 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// settingwatcher.cpp
+
+
+#include "misc.h"
+#include "settingwatcher.h"
+#include <process.h>
+#ifdef __linux__
+#  include <sys/inotify.h>
+#  include <poll.h>
+#endif
+
+
+#ifdef _UNICODE
+#  define WATCHER_NAME(i_name) std::wstring((i_name).c_str())
+#else
+#  define WATCHER_NAME(i_name) to_wstring(std::string((i_name).c_str()))
+#endif
+
+
+#ifdef __linux__
+static const size_t MAX_DIRECTORIES = 64;
+#else
+// WaitForMultipleObjects() waits for the quit event, too
+static const size_t MAX_DIRECTORIES = MAXIMUM_WAIT_OBJECTS - 1;
+#endif
+
+
+//
+SettingWatcher::SettingWatcher()
+	: m_hwnd(NULL),
+	  m_message(0),
+	  m_settleTime(0),
+	  m_thread(NULL),
+	  m_threadId(0)
+{
+#ifdef __linux__
+	m_inotify = -1;
+	CHECK( 0 ==, pipe(m_quitPipe) );
+#else
+	CHECK_TRUE( m_quitEvent = CreateEvent(NULL, TRUE, FALSE, NULL) );
+#endif
+}
+
+
+//
+SettingWatcher::~SettingWatcher()
+{
+	stop();
+#ifdef __linux__
+	::close(m_quitPipe[0]);
+	::close(m_quitPipe[1]);
+#else
+	CHECK_TRUE( CloseHandle(m_quitEvent) );
+#endif
+}
+
+
+// post i_message to i_hwnd when the files have changed and settled
+void SettingWatcher::init(HWND i_hwnd, UINT i_message, DWORD i_settleTime)
+{
+	m_hwnd = i_hwnd;
+	m_message = i_message;
+	m_settleTime = i_settleTime;
+}
+
+
+// watch i_name in i_path
+void SettingWatcher::add(const tstringi &i_path, const tstringi &i_name)
+{
+	// i_name may be in a subdirectory of i_path
+	tstringi path = i_path + _T("\\") + i_name;
+#ifdef __linux__
+	for (size_t i = 0; i < path.size(); ++ i)
+		if (path[i] == _T('\\'))
+			path[i] = _T('/');
+#endif
+	size_t sep = path.find_last_of(_T("\\/"));
+	tstringi dir = path.substr(0, sep);
+	std::wstring name = WATCHER_NAME(path.substr(sep + 1));
+
+	Directories::iterator i = m_directories.begin();
+	for (; i != m_directories.end(); ++ i)
+		if ((*i)->m_path == dir)
+			break;
+	if (i == m_directories.end()) {
+		if (MAX_DIRECTORIES <= m_directories.size())
+			return;
+		Directory *d = new Directory;
+		d->m_path = dir;
+		m_directories.push_back(d);
+		i = -- m_directories.end();
+	}
+	(*i)->m_names.push_back(name);
+}
+
+
+// watch i_paths and i_names in i_directories
+void SettingWatcher::watch(const std::list<tstringi> &i_paths,
+						   const std::list<tstringi> &i_names,
+						   const std::list<tstringi> &i_directories)
+{
+	stop();
+
+	for (std::list<tstringi>::const_iterator
+			i = i_paths.begin(); i != i_paths.end(); ++ i) {
+		size_t sep = (*i).find_last_of(_T("\\/"));
+		if (sep != tstringi::npos)
+			add((*i).substr(0, sep), (*i).substr(sep + 1));
+	}
+	for (std::list<tstringi>::const_iterator
+			i = i_names.begin(); i != i_names.end(); ++ i)
+		for (std::list<tstringi>::const_iterator
+				j = i_directories.begin(); j != i_directories.end(); ++ j)
+			add(*j, *i);
+	if (m_directories.empty())
+		return;
+
+	CHECK_TRUE( m_thread = (HANDLE)_beginthreadex(NULL, 0, threadLoop, this,
+												  0, &m_threadId) );
+}
+
+
+// stop watching
+void SettingWatcher::stop()
+{
+	if (m_thread) {
+		quit();
+		CHECK( WAIT_OBJECT_0 ==, WaitForSingleObject(m_thread, INFINITE) );
+		CHECK_TRUE( CloseHandle(m_thread) );
+		m_thread = NULL;
+#ifdef __linux__
+		char c;
+		CHECK( 1 ==, read(m_quitPipe[0], &c, 1) );
+#else
+		CHECK_TRUE( ResetEvent(m_quitEvent) );
+#endif
+	}
+	for (Directories::iterator
+			i = m_directories.begin(); i != m_directories.end(); ++ i)
+		delete *i;
+	m_directories.clear();
+}
+
+
+// is i_name one of the watched files of i_directory ?
+bool SettingWatcher::isWatched(const Directory *i_directory,
+							   const std::wstring &i_name) const
+{
+	for (std::list<std::wstring>::const_iterator
+			i = i_directory->m_names.begin();
+			i != i_directory->m_names.end(); ++ i)
+		if (_wcsicmp((*i).c_str(), i_name.c_str()) == 0)
+			return true;
+	return false;
+}
+
+
+// the thread
+void SettingWatcher::loop()
+{
+	// the requests must be issued and cancelled by this thread
+	open();
+
+	// each change restarts the settle time
+	DWORD timeout = INFINITE;
+	while (true) {
+		Wait w = waitForChange(timeout);
+		if (w == Wait_quit)
+			break;
+		if (w == Wait_changed)
+			timeout = m_settleTime;
+		else {
+			PostMessage(m_hwnd, m_message, 0, 0);
+			timeout = INFINITE;
+		}
+	}
+
+	close();
+}
+
+
+//
+unsigned int WINAPI SettingWatcher::threadLoop(void *i_this)
+{
+	reinterpret_cast<SettingWatcher *>(i_this)->loop();
+	return 0;
+}
+
+
+/// the rest of i_milliseconds since i_begin (a GetTickCount() value)
+static DWORD getRest(DWORD i_milliseconds, DWORD i_begin)
+{
+	if (i_milliseconds == INFINITE)
+		return INFINITE;
+	DWORD elapsed = GetTickCount() - i_begin;
+	return elapsed < i_milliseconds ? i_milliseconds - elapsed : 0;
+}
+
+
+#ifdef __linux__
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// inotify
+
+
+// start watching m_directories
+void SettingWatcher::open()
+{
+	CHECK_FALSE( (m_inotify = inotify_init()) < 0 );
+	for (Directories::iterator
+			i = m_directories.begin(); i != m_directories.end(); ++ i) {
+		Directory *d = *i;
+		std::vector<char> path(d->m_path.size() * MB_CUR_MAX + 1);
+		if (wcstombs(&path[0], d->m_path.c_str(), path.size()) ==
+			static_cast<size_t>(-1))
+			d->m_wd = -1;
+		else
+			d->m_wd = inotify_add_watch(
+				m_inotify, &path[0], IN_CREATE | IN_DELETE | IN_MODIFY |
+				IN_MOVED_FROM | IN_MOVED_TO);	// -1: no such directory
+	}
+}
+
+
+// wait until a watched file changes, the time is up or stop() is called
+SettingWatcher::Wait SettingWatcher::waitForChange(DWORD i_milliseconds)
+{
+	DWORD begin = GetTickCount();
+	while (true) {
+		DWORD timeout = getRest(i_milliseconds, begin);
+		struct pollfd fds[2] = {
+			{ m_quitPipe[0], POLLIN, 0 },
+			{ m_inotify, POLLIN, 0 },
+		};
+		int r = poll(fds, 2,
+					 timeout == INFINITE ? -1 : static_cast<int>(timeout));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0 || fds[0].revents)
+			return Wait_quit;			// stop() or an error
+		if (r == 0)
+			return Wait_timeout;
+
+		union {
+			struct inotify_event m_event;		// for the alignment
+			char m_bytes[4096];
+		} buffer;
+		ssize_t size = read(m_inotify, buffer.m_bytes, sizeof(buffer));
+		bool isChanged = false;
+		for (ssize_t offset = 0; 0 < size && offset < size; ) {
+			const struct inotify_event *e =
+				reinterpret_cast<const struct inotify_event *>(
+					buffer.m_bytes + offset);
+			offset += sizeof(*e) + e->len;
+
+			// the queue overflowed, so anything may have changed
+			if (e->mask & IN_Q_OVERFLOW)
+				isChanged = true;
+			for (Directories::iterator
+					i = m_directories.begin(); i != m_directories.end(); ++ i) {
+				Directory *d = *i;
+				if (d->m_wd != e->wd)
+					continue;
+				if (e->mask & IN_IGNORED) {
+					// the directory has been removed
+					d->m_wd = -1;
+					isChanged = true;
+				} else if (e->len) {
+					std::vector<wchar_t> name(e->len + 1);
+					size_t length = mbstowcs(&name[0], e->name, name.size());
+					if (length != static_cast<size_t>(-1) &&
+						isWatched(d, std::wstring(&name[0], length)))
+						isChanged = true;
+				}
+				break;
+			}
+		}
+		if (isChanged)
+			return Wait_changed;
+	}
+}
+
+
+// stop watching m_directories
+void SettingWatcher::close()
+{
+	::close(m_inotify);				// removes the watches
+	m_inotify = -1;
+}
+
+
+// make waitForChange() return Wait_quit
+void SettingWatcher::quit()
+{
+	CHECK( 1 ==, write(m_quitPipe[1], "q", 1) );
+}
+
+
+#else // !__linux__
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// ReadDirectoryChangesW
+
+
+// start (or restart) ReadDirectoryChangesW() on i_handle
+static bool readChanges(HANDLE i_handle, DWORD *o_buffer, DWORD i_size,
+				 OVERLAPPED *io_ol)
+{
+	return !!ReadDirectoryChangesW(
+		i_handle, o_buffer, i_size, FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE |
+		FILE_NOTIFY_CHANGE_SIZE, NULL, io_ol, NULL);
+}
+
+
+// start watching m_directories
+void SettingWatcher::open()
+{
+	m_events.push_back(m_quitEvent);
+	for (Directories::iterator
+			i = m_directories.begin(); i != m_directories.end(); ++ i) {
+		Directory *d = *i;
+		d->m_handle = CreateFile(
+			d->m_path.c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+			NULL);
+		if (d->m_handle == INVALID_HANDLE_VALUE)
+			continue;				// no such directory
+		ZeroMemory(&d->m_ol, sizeof(d->m_ol));
+		CHECK_TRUE( d->m_ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL) );
+		if (!readChanges(d->m_handle, d->m_buffer, sizeof(d->m_buffer), &d->m_ol)) {
+			CHECK_TRUE( CloseHandle(d->m_ol.hEvent) );
+			CHECK_TRUE( CloseHandle(d->m_handle) );
+			d->m_handle = INVALID_HANDLE_VALUE;
+			continue;
+		}
+		m_opened.push_back(d);
+		m_events.push_back(d->m_ol.hEvent);
+	}
+}
+
+
+// wait until a watched file changes, the time is up or stop() is called
+SettingWatcher::Wait SettingWatcher::waitForChange(DWORD i_milliseconds)
+{
+	DWORD begin = GetTickCount();
+	while (true) {
+		DWORD r = WaitForMultipleObjects(static_cast<DWORD>(m_events.size()),
+										 &m_events[0], FALSE,
+										 getRest(i_milliseconds, begin));
+		if (r == WAIT_TIMEOUT)
+			return Wait_timeout;
+		if (r == WAIT_OBJECT_0 || WAIT_OBJECT_0 + m_events.size() <= r)
+			return Wait_quit;			// m_quitEvent or an error
+		size_t n = r - WAIT_OBJECT_0 - 1;
+		Directory *d = m_opened[n];
+
+		DWORD size = 0;
+		bool isOk = !!GetOverlappedResult(d->m_handle, &d->m_ol, &size, FALSE);
+
+		// size is 0 if the buffer overflowed, so anything may have changed
+		bool isChanged = !isOk || size == 0;
+		for (const BYTE *p = reinterpret_cast<const BYTE *>(d->m_buffer);
+			 !isChanged; ) {
+			const FILE_NOTIFY_INFORMATION *fni =
+				reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(p);
+			std::wstring name(fni->FileName,
+							  fni->FileNameLength / sizeof(fni->FileName[0]));
+			isChanged = isWatched(d, name);
+			if (fni->NextEntryOffset == 0)
+				break;
+			p += fni->NextEntryOffset;
+		}
+
+		if (!isOk ||
+			!readChanges(d->m_handle, d->m_buffer, sizeof(d->m_buffer), &d->m_ol)) {
+			// the directory has been removed
+			CHECK_TRUE( CloseHandle(d->m_ol.hEvent) );
+			CHECK_TRUE( CloseHandle(d->m_handle) );
+			d->m_handle = INVALID_HANDLE_VALUE;
+			m_opened.erase(m_opened.begin() + n);
+			m_events.erase(m_events.begin() + n + 1);
+		}
+		if (isChanged)
+			return Wait_changed;
+	}
+}
+
+
+// stop watching m_directories
+void SettingWatcher::close()
+{
+	for (std::vector<Directory *>::iterator
+			i = m_opened.begin(); i != m_opened.end(); ++ i) {
+		Directory *d = *i;
+		DWORD size;
+		CancelIo(d->m_handle);
+		GetOverlappedResult(d->m_handle, &d->m_ol, &size, TRUE);
+		CHECK_TRUE( CloseHandle(d->m_ol.hEvent) );
+		CHECK_TRUE( CloseHandle(d->m_handle) );
+	}
+	m_opened.clear();
+	m_events.clear();
+}
+
+
+// make waitForChange() return Wait_quit
+void SettingWatcher::quit()
+{
+	CHECK_TRUE( SetEvent(m_quitEvent) );
+}
+
+
+#endif // !__linux__
@@ -0,0 +1,106 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// settingwatcher.h
+
+
+#ifndef _SETTINGWATCHER_H
+#  define _SETTINGWATCHER_H
+
+#  include "misc.h"
+#  include "stringtool.h"
+#  include <list>
+#  include <vector>
+
+
+/** watches the files a setting was loaded from.
+    a thread waits for the directories of the files to change and posts a
+    message to a window when one of the files is written, created, renamed
+    or deleted.  an editor writes a file in several steps, so the message
+    is posted once the files have not changed for the settle time.
+    the directories are watched with ReadDirectoryChangesW(), or with
+    inotify on Linux, where the host tests run. */
+class SettingWatcher
+{
+	/// a directory being watched
+	class Directory
+	{
+	public:
+		tstringi m_path;				///
+		std::list<std::wstring> m_names;		/// watched files in m_path
+#ifdef __linux__
+		int m_wd;					/// inotify watch descriptor
+#else
+		HANDLE m_handle;				///
+		OVERLAPPED m_ol;				///
+		DWORD m_buffer[1024];			/** FILE_NOTIFY_INFORMATION
+						    (must be DWORD aligned) */
+#endif
+	};
+	typedef std::list<Directory *> Directories;	///
+
+	/// result of waitForChange()
+	enum Wait {
+		Wait_changed,				/// a watched file changed
+		Wait_timeout,				///
+		Wait_quit,					/// stop() is called
+	};
+
+	HWND m_hwnd;					/// notified window
+	UINT m_message;				/// message to m_hwnd
+	DWORD m_settleTime;				/// ms without changes
+	Directories m_directories;			///
+	HANDLE m_thread;				///
+	unsigned m_threadId;				///
+#ifdef __linux__
+	int m_inotify;				/// while the thread runs
+	int m_quitPipe[2];				/// stops the thread
+#else
+	HANDLE m_quitEvent;				/// stops the thread
+	std::vector<Directory *> m_opened;		/// directories being read
+	std::vector<HANDLE> m_events;			/** m_quitEvent and the events
+						    of m_opened */
+#endif
+
+private:
+	/// watch i_name in i_path
+	void add(const tstringi &i_path, const tstringi &i_name);
+	/// is i_name one of the watched files of i_directory ?
+	bool isWatched(const Directory *i_directory,
+				   const std::wstring &i_name) const;
+	/// the thread
+	void loop();
+	///
+	static unsigned int WINAPI threadLoop(void *i_this);
+
+	// the backend
+	/// start watching m_directories (in the thread)
+	void open();
+	/// wait until a watched file changes, the time is up or stop() is called
+	Wait waitForChange(DWORD i_milliseconds);
+	/// stop watching m_directories (in the thread)
+	void close();
+	/// make waitForChange() return Wait_quit
+	void quit();
+
+public:
+	///
+	SettingWatcher();
+	///
+	~SettingWatcher();
+
+	/** post i_message to i_hwnd when the files have changed and then
+	    not changed for i_settleTime ms */
+	void init(HWND i_hwnd, UINT i_message, DWORD i_settleTime);
+
+	/** watch i_paths (instead of the files watched so far).  each of
+	    i_names is watched in every directory of i_directories, so a new
+	    file that shadows an included file is noticed, too */
+	void watch(const std::list<tstringi> &i_paths,
+			   const std::list<tstringi> &i_names,
+			   const std::list<tstringi> &i_directories);
+
+	/// stop watching.  a change that has not settled is not notified
+	void stop();
+};
+
+
+#endif // !_SETTINGWATCHER_H
@@ -376,7 +376,8 @@ case_default:
 					*d++ = *i_str++;
 					break;
 				}
-		}
+		} else
+			*d++ = *i_str++;		// a backslash at the end
 	}
 	*d =_T('\0');
 	return result.get();
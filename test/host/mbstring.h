@@ -0,0 +1,12 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// mbstring.h - for stringtool.cpp in the host tests (_ismbblead() is in
+// tchar.h)
+
+
+#ifndef _TEST_HOST_MBSTRING_H
+#  define _TEST_HOST_MBSTRING_H
+
+#  include <tchar.h>
+
+
+#endif // !_TEST_HOST_MBSTRING_H
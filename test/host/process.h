@@ -0,0 +1,23 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// process.h - _beginthreadex() for the host tests
+
+
+#ifndef _TEST_HOST_PROCESS_H
+#  define _TEST_HOST_PROCESS_H
+
+#  include <windows.h>
+
+
+/// the thread is a CreateThread() thread, and its id is always 0
+inline uintptr_t _beginthreadex(void *, unsigned,
+								unsigned (WINAPI *i_start)(void *),
+								void *i_param, unsigned, unsigned *o_id)
+{
+	if (o_id)
+		*o_id = 0;
+	return reinterpret_cast<uintptr_t>(
+		CreateThread(NULL, 0, i_start, i_param, 0, NULL));
+}
+
+
+#endif // !_TEST_HOST_PROCESS_H
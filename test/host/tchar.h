@@ -0,0 +1,57 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// tchar.h - _UNICODE generic text mappings for the host tests
+
+
+#ifndef _TEST_HOST_TCHAR_H
+#  define _TEST_HOST_TCHAR_H
+
+#  include <cwchar>
+#  include <cwctype>
+#  include <cstdlib>
+
+#  ifndef _UNICODE
+#    error "the host tests are _UNICODE only"
+#  endif
+
+typedef wchar_t _TCHAR;				///
+typedef wchar_t _TUCHAR;			///
+typedef wchar_t TCHAR;				///
+typedef wchar_t *LPTSTR;			///
+typedef const wchar_t *LPCTSTR;			///
+
+#  define __T(x)	L ## x
+#  define _T(x)		__T(x)
+#  define _TEXT(x)	__T(x)
+
+#  define _tcslen	wcslen
+#  define _tcschr	wcschr
+#  define _tcsrchr	wcsrchr
+#  define _tcscmp	wcscmp
+#  define _tcsncmp	wcsncmp
+#  define _tcsicmp	wcscasecmp
+#  define _tcsnicmp	wcsncasecmp
+#  define _tcstol	wcstol
+#  define _tcstoul	wcstoul
+#  define _tcstoi64	wcstoll
+#  define _tcstoui64	wcstoull
+#  define _sntprintf	swprintf
+#  define _totlower	towlower
+#  define _totupper	towupper
+#  define _istalpha	iswalpha
+#  define _istalnum	iswalnum
+#  define _istdigit	iswdigit
+#  define _istxdigit	iswxdigit
+#  define _istspace	iswspace
+#  define _istpunct	iswpunct
+#  define _istgraph	iswgraph
+#  define _istprint	iswprint
+#  define _istcntrl	iswcntrl
+#  define _istlower	iswlower
+#  define _istupper	iswupper
+#  define _istlead(c)	0
+#  define _ismbblead(c)	0
+
+#  define _wcsicmp	wcscasecmp
+
+
+#endif // !_TEST_HOST_TCHAR_H
@@ -0,0 +1,28 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// windef.h - for hook.h in the host tests
+
+
+#ifndef _TEST_HOST_WINDEF_H
+#  define _TEST_HOST_WINDEF_H
+
+#  include <windows.h>
+
+///
+struct POINT {
+	LONG x;					///
+	LONG y;					///
+};
+
+///
+struct RECT {
+	LONG left;					///
+	LONG top;					///
+	LONG right;					///
+	LONG bottom;				///
+};
+
+/// the DLL of the hooks is not built on the host
+#  define __declspec(i_attribute)
+
+
+#endif // !_TEST_HOST_WINDEF_H
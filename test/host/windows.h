@@ -0,0 +1,434 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// windows.h - the part of Win32 the portable modules use, for the host tests
+
+
+#ifndef _TEST_HOST_WINDOWS_H
+#  define _TEST_HOST_WINDOWS_H
+
+#  include <pthread.h>
+#  include <sched.h>
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/time.h>
+#  include <stdint.h>
+#  include <cerrno>
+#  include <cstddef>
+#  include <cstring>
+#  include <string>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// types
+
+
+typedef int BOOL;				///
+typedef unsigned char BYTE;			///
+typedef unsigned short WORD;			///
+typedef unsigned short USHORT;			///
+/// a macro, not a typedef: also used as <code>unsigned __int64</code>, and
+/// not int64_t, which is long and so would collide with an overload on long
+#  define __int64 long long
+typedef uint32_t DWORD;				///
+typedef uint32_t UINT;				///
+typedef uint32_t ULONG;				///
+typedef int32_t LONG;				///
+typedef intptr_t LONG_PTR;			///
+typedef uintptr_t ULONG_PTR;			///
+typedef uintptr_t WPARAM;			///
+typedef intptr_t LPARAM;			///
+typedef int64_t LONGLONG;			///
+typedef wchar_t WCHAR;				///
+typedef void *HANDLE;				///
+typedef void *HWND;				///
+typedef void *HINSTANCE;			///
+typedef void *LPVOID;				///
+typedef void *PVOID;				///
+typedef const char *LPCSTR;			///
+typedef wchar_t *LPWSTR;			///
+typedef const wchar_t *LPCWSTR;			///
+
+#  define TRUE	1
+#  define FALSE	0
+#  define WINAPI
+#  define MAX_PATH	260
+#  define INFINITE	0xffffffff
+#  define WAIT_OBJECT_0	0
+#  define WAIT_TIMEOUT	258
+#  define INVALID_HANDLE_VALUE	((HANDLE)(intptr_t)-1)
+#  define INVALID_FILE_SIZE	0xffffffff
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// interlocked
+
+
+inline LONG InterlockedCompareExchange(volatile LONG *io_p, LONG i_exchange,
+									   LONG i_comperand)
+{
+	return __sync_val_compare_and_swap(io_p, i_comperand, i_exchange);
+}
+
+inline LONG InterlockedExchange(volatile LONG *io_p, LONG i_value)
+{
+	__sync_synchronize();
+	LONG prev = __sync_lock_test_and_set(io_p, i_value);
+	__sync_synchronize();
+	return prev;
+}
+
+inline LONG InterlockedExchangeAdd(volatile LONG *io_p, LONG i_value)
+{
+	return __sync_fetch_and_add(io_p, i_value);
+}
+
+inline LONG InterlockedIncrement(volatile LONG *io_p)
+{
+	return __sync_add_and_fetch(io_p, 1);
+}
+
+inline LONG InterlockedDecrement(volatile LONG *io_p)
+{
+	return __sync_sub_and_fetch(io_p, 1);
+}
+
+inline PVOID InterlockedExchangePointer(PVOID volatile *io_p, PVOID i_value)
+{
+	__sync_synchronize();
+	PVOID prev = __sync_lock_test_and_set(io_p, i_value);
+	__sync_synchronize();
+	return prev;
+}
+
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile *io_p,
+											   PVOID i_exchange,
+											   PVOID i_comperand)
+{
+	return __sync_val_compare_and_swap(io_p, i_comperand, i_exchange);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// critical section
+
+
+typedef pthread_mutex_t CRITICAL_SECTION;	///
+
+inline void InitializeCriticalSection(CRITICAL_SECTION *o_cs)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(o_cs, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+inline void DeleteCriticalSection(CRITICAL_SECTION *io_cs)
+{
+	pthread_mutex_destroy(io_cs);
+}
+
+inline void EnterCriticalSection(CRITICAL_SECTION *io_cs)
+{
+	pthread_mutex_lock(io_cs);
+}
+
+inline void LeaveCriticalSection(CRITICAL_SECTION *io_cs)
+{
+	pthread_mutex_unlock(io_cs);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// events, threads and files share one handle type
+
+
+/// what a HANDLE points to
+class HostHandle
+{
+public:
+	enum Type { Type_event, Type_thread, Type_file, Type_mapping };
+
+	Type m_type;				///
+	pthread_mutex_t m_mutex;			/// guards m_isSignaled
+	pthread_cond_t m_cond;			///
+	bool m_isSignaled;				///
+	bool m_isManualReset;			///
+	pthread_t m_thread;				/// Type_thread
+	DWORD (WINAPI *m_start)(LPVOID);		/// Type_thread
+	LPVOID m_param;				/// Type_thread
+	int m_fd;					/// Type_file, Type_mapping
+
+	///
+	HostHandle(Type i_type)
+		: m_type(i_type), m_isSignaled(false), m_isManualReset(true),
+		  m_start(NULL), m_param(NULL), m_fd(-1) {
+		pthread_mutex_init(&m_mutex, NULL);
+		pthread_cond_init(&m_cond, NULL);
+	}
+	///
+	~HostHandle() {
+		pthread_cond_destroy(&m_cond);
+		pthread_mutex_destroy(&m_mutex);
+	}
+	///
+	void signal() {
+		pthread_mutex_lock(&m_mutex);
+		m_isSignaled = true;
+		pthread_cond_broadcast(&m_cond);
+		pthread_mutex_unlock(&m_mutex);
+	}
+	///
+	DWORD wait(DWORD i_milliseconds) {
+		pthread_mutex_lock(&m_mutex);
+		if (!m_isSignaled && i_milliseconds != INFINITE) {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += i_milliseconds / 1000;
+			ts.tv_nsec += (i_milliseconds % 1000) * 1000000L;
+			if (1000000000L <= ts.tv_nsec) {
+				ts.tv_sec ++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			while (!m_isSignaled)
+				if (pthread_cond_timedwait(&m_cond, &m_mutex, &ts) == ETIMEDOUT)
+					break;
+		} else
+			while (!m_isSignaled)
+				pthread_cond_wait(&m_cond, &m_mutex);
+		bool isSignaled = m_isSignaled;
+		if (isSignaled && !m_isManualReset)
+			m_isSignaled = false;
+		pthread_mutex_unlock(&m_mutex);
+		return isSignaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+	}
+	///
+	static void *run(void *i_this) {
+		HostHandle *h = static_cast<HostHandle *>(i_this);
+		h->m_start(h->m_param);
+		h->signal();
+		return NULL;
+	}
+};
+
+inline HANDLE CreateEvent(void *, BOOL i_isManualReset, BOOL i_isSignaled,
+						  const void *)
+{
+	HostHandle *h = new HostHandle(HostHandle::Type_event);
+	h->m_isManualReset = !!i_isManualReset;
+	h->m_isSignaled = !!i_isSignaled;
+	return h;
+}
+
+inline BOOL SetEvent(HANDLE i_event)
+{
+	static_cast<HostHandle *>(i_event)->signal();
+	return TRUE;
+}
+
+inline BOOL ResetEvent(HANDLE i_event)
+{
+	HostHandle *h = static_cast<HostHandle *>(i_event);
+	pthread_mutex_lock(&h->m_mutex);
+	h->m_isSignaled = false;
+	pthread_mutex_unlock(&h->m_mutex);
+	return TRUE;
+}
+
+/// APCs are not emulated: an alertable wait is an ordinary wait
+inline DWORD WaitForSingleObjectEx(HANDLE i_handle, DWORD i_milliseconds,
+								   BOOL)
+{
+	return static_cast<HostHandle *>(i_handle)->wait(i_milliseconds);
+}
+
+inline DWORD WaitForSingleObject(HANDLE i_handle, DWORD i_milliseconds)
+{
+	return WaitForSingleObjectEx(i_handle, i_milliseconds, FALSE);
+}
+
+inline HANDLE CreateThread(void *, size_t, DWORD (WINAPI *i_start)(LPVOID),
+						   LPVOID i_param, DWORD, DWORD *)
+{
+	HostHandle *h = new HostHandle(HostHandle::Type_thread);
+	h->m_start = i_start;
+	h->m_param = i_param;
+	if (pthread_create(&h->m_thread, NULL, HostHandle::run, h) != 0) {
+		delete h;
+		return NULL;
+	}
+	return h;
+}
+
+inline BOOL CloseHandle(HANDLE i_handle)
+{
+	HostHandle *h = static_cast<HostHandle *>(i_handle);
+	switch (h->m_type) {
+		case HostHandle::Type_thread:
+			pthread_join(h->m_thread, NULL);
+			break;
+		case HostHandle::Type_file:
+			close(h->m_fd);
+			break;
+		default:
+			break;
+	}
+	delete h;
+	return TRUE;
+}
+
+inline DWORD GetCurrentProcessId()
+{
+	return static_cast<DWORD>(getpid());
+}
+
+/// the host has no sessions
+inline BOOL ProcessIdToSessionId(DWORD, DWORD *o_sessionId)
+{
+	*o_sessionId = 0;
+	return TRUE;
+}
+
+inline void Sleep(DWORD i_milliseconds)
+{
+	if (i_milliseconds == 0)
+		sched_yield();
+	else
+		usleep(i_milliseconds * 1000);
+}
+
+///
+union LARGE_INTEGER
+{
+	LONGLONG QuadPart;				///
+};
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER *o_frequency)
+{
+	o_frequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER *o_count)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	o_count->QuadPart = LONGLONG(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	return TRUE;
+}
+
+inline DWORD GetTickCount()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<DWORD>(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// file mapping (read only)
+
+
+#  define GENERIC_READ			0x80000000
+#  define FILE_SHARE_READ		1
+#  define FILE_SHARE_WRITE		2
+#  define OPEN_EXISTING			3
+#  define FILE_ATTRIBUTE_NORMAL		0x80
+#  define PAGE_READONLY			2
+#  define FILE_MAP_READ			4
+
+inline HANDLE CreateFile(LPCWSTR i_name, DWORD, DWORD, void *, DWORD, DWORD,
+						 HANDLE)
+{
+	std::string name;
+	for (; *i_name; ++ i_name)
+		name += static_cast<char>(*i_name);
+	int fd = open(name.c_str(), O_RDONLY);
+	if (fd < 0)
+		return INVALID_HANDLE_VALUE;
+	HostHandle *h = new HostHandle(HostHandle::Type_file);
+	h->m_fd = fd;
+	return h;
+}
+
+inline DWORD GetFileSize(HANDLE i_file, DWORD *o_sizeHigh)
+{
+	struct stat st;
+	if (fstat(static_cast<HostHandle *>(i_file)->m_fd, &st) != 0)
+		return INVALID_FILE_SIZE;
+	*o_sizeHigh = static_cast<DWORD>(static_cast<uint64_t>(st.st_size) >> 32);
+	return static_cast<DWORD>(st.st_size);
+}
+
+inline HANDLE CreateFileMapping(HANDLE i_file, void *, DWORD, DWORD, DWORD,
+								LPCWSTR)
+{
+	HostHandle *h = new HostHandle(HostHandle::Type_mapping);
+	h->m_fd = static_cast<HostHandle *>(i_file)->m_fd;
+	return h;
+}
+
+/// the whole file is mapped whatever the offset and size are
+inline LPVOID MapViewOfFile(HANDLE i_mapping, DWORD, DWORD, DWORD, size_t)
+{
+	int fd = static_cast<HostHandle *>(i_mapping)->m_fd;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+		return NULL;
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+/// the host tests are short lived, so the view is left to the exit
+inline BOOL UnmapViewOfFile(const void *)
+{
+	return TRUE;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// messages
+
+
+/// there are no windows: the test that posts messages defines this
+extern BOOL PostMessage(HWND i_hwnd, UINT i_message, WPARAM i_wParam,
+						LPARAM i_lParam);
+
+// ShowWindow() commands, for ShowCommandType of function.h
+#  define SW_HIDE		0
+#  define SW_SHOWNORMAL		1
+#  define SW_SHOWMINIMIZED	2
+#  define SW_SHOWMAXIMIZED	3
+#  define SW_MAXIMIZE		3
+#  define SW_SHOWNOACTIVATE	4
+#  define SW_SHOW		5
+#  define SW_MINIMIZE		6
+#  define SW_SHOWMINNOACTIVE	7
+#  define SW_SHOWNA		8
+#  define SW_RESTORE		9
+#  define SW_SHOWDEFAULT	10
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// code page
+
+
+#  define CP_ACP			0
+#  define MB_ERR_INVALID_CHARS	8
+
+/// the host has no ANSI code page: each byte is a Latin-1 character
+inline int MultiByteToWideChar(UINT, DWORD, LPCSTR i_str, int i_size,
+							   LPWSTR o_str, int i_wsize)
+{
+	if (o_str) {
+		if (i_wsize < i_size)
+			return 0;
+		for (int i = 0; i < i_size; ++ i)
+			o_str[i] = static_cast<unsigned char>(i_str[i]);
+	}
+	return i_size;
+}
+
+
+#endif // !_TEST_HOST_WINDOWS_H
@@ -0,0 +1,16 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// winioctl.h - for driver.h in the host tests
+
+
+#ifndef _TEST_HOST_WINIOCTL_H
+#  define _TEST_HOST_WINIOCTL_H
+
+#  define FILE_DEVICE_KEYBOARD	0x0000000b
+#  define METHOD_BUFFERED	0
+#  define FILE_ANY_ACCESS	0
+#  define FILE_WRITE_ACCESS	2
+#  define CTL_CODE(i_type, i_function, i_method, i_access)		\
+	(((i_type) << 16) | ((i_access) << 14) | ((i_function) << 2) | (i_method))
+
+
+#endif // !_TEST_HOST_WINIOCTL_H
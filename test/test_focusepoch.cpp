@@ -0,0 +1,207 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_focusepoch.cpp - when Engine::processInput() asks a FocusProvider for
+// the focus, driven by FocusEpoch with a fake provider and a fake clock
+
+
+#include "misc.h"
+#include "engineio.h"
+#include <cstdio>
+
+
+enum {
+	FOCUS_CHECK_INTERVAL = 200,		/// ms, as in engine.h
+	NOTIFICATIONS = 200000,			/// of the notifying thread
+};
+
+
+/// a foreground window that the test switches
+class FakeFocusProvider : public FocusProvider
+{
+	PVOID volatile m_hwnd;			///
+
+public:
+	volatile LONG m_callCount;			/// getForegroundWindow() calls
+
+public:
+	///
+	FakeFocusProvider() : m_hwnd(NULL), m_callCount(0) { }
+
+	/// switch the foreground window
+	void setForegroundWindow(HWND i_hwnd) {
+		InterlockedExchangePointer(&m_hwnd, i_hwnd);
+	}
+
+	///
+	HWND getForegroundWindow(DWORD *o_threadId) {
+		InterlockedIncrement(&m_callCount);
+		*o_threadId = 1;
+		return static_cast<HWND>(
+			InterlockedCompareExchangePointer(&m_hwnd, NULL, NULL));
+	}
+	///
+	bool getClassName(HWND, tstringi *o_className) {
+		*o_className = _T("Fake");
+		return true;
+	}
+	///
+	bool getTitleName(HWND, tstringi *o_titleName) {
+		*o_titleName = _T("");
+		return true;
+	}
+};
+
+
+/// the focus handling of Engine
+class FakeEngine
+{
+	FocusEpoch m_focusEpoch;			///
+	FocusProvider *m_focusProvider;		///
+
+public:
+	HWND m_hwndFocus;				/// the focus the engine knows
+
+public:
+	///
+	FakeEngine(FocusProvider *i_focusProvider)
+		: m_focusEpoch(FOCUS_CHECK_INTERVAL),
+		  m_focusProvider(i_focusProvider),
+		  m_hwndFocus(NULL) {
+	}
+
+	/// Engine::notifyFocusChanged()
+	void notifyFocusChanged() {
+		m_focusEpoch.notify();
+	}
+
+	/// Engine::processInput() at i_now, checkFocusWindow() reduced to its
+	/// question to the provider
+	void processInput(DWORD i_now) {
+		if (m_focusEpoch.isDue(i_now)) {
+			DWORD threadId;
+			m_hwndFocus = m_focusProvider->getForegroundWindow(&threadId);
+		}
+	}
+};
+
+
+///
+static HWND getHwnd(size_t i_n)
+{
+	return reinterpret_cast<HWND>(i_n * 16);
+}
+
+
+static int s_failures;				///
+
+
+/// report a case
+static void check(const char *i_name, bool i_isOk, LONG i_callCount)
+{
+	printf("%-40s %s, %ld focus check(s)\n", i_name, i_isOk ? "ok" : "FAILED",
+		   static_cast<long>(i_callCount));
+	if (!i_isOk)
+		++ s_failures;
+}
+
+
+/// notification, no notification, and the interval from i_start
+static void testClock(const char *i_name, DWORD i_start)
+{
+	FakeFocusProvider fp;
+	FakeEngine engine(&fp);
+	DWORD now = i_start;
+
+	fp.setForegroundWindow(getHwnd(1));
+	engine.processInput(now);
+	bool isOk = fp.m_callCount == 1 && engine.m_hwndFocus == getHwnd(1);
+
+	// events without notification within the interval
+	for (int i = 0; i < 100; ++ i)
+		engine.processInput(now + i * 2);
+	isOk = isOk && fp.m_callCount == 1;
+
+	// a hooked window notifies: the next event sees it, once
+	fp.setForegroundWindow(getHwnd(2));
+	for (int i = 0; i < 1000; ++ i)
+		engine.notifyFocusChanged();
+	engine.processInput(now + 199);
+	engine.processInput(now + 199);
+	isOk = isOk && fp.m_callCount == 2 && engine.m_hwndFocus == getHwnd(2);
+
+	// a console does not notify: seen within the interval
+	now += 199;
+	fp.setForegroundWindow(getHwnd(3));
+	DWORD seen = 0;
+	for (DWORD t = 10; t <= 1000 && !seen; t += 10) {
+		engine.processInput(now + t);
+		if (engine.m_hwndFocus == getHwnd(3))
+			seen = t;
+	}
+	isOk = isOk && seen == FOCUS_CHECK_INTERVAL && fp.m_callCount == 3;
+
+	// no event, no check; then once per interval
+	now += seen;
+	LONG callCount = fp.m_callCount;
+	for (DWORD t = 1; t <= 10 * FOCUS_CHECK_INTERVAL; ++ t)
+		engine.processInput(now + t);
+	isOk = isOk && fp.m_callCount - callCount == 10;
+	check(i_name, isOk, fp.m_callCount);
+}
+
+
+/// the argument of notifier()
+class Notifier
+{
+public:
+	FakeFocusProvider *m_focusProvider;		///
+	FakeEngine *m_engine;				///
+};
+
+
+/// switch the foreground window, then notify, like the hook of mayu.dll
+static DWORD WINAPI notifier(void *i_param)
+{
+	Notifier *n = static_cast<Notifier *>(i_param);
+	for (size_t i = 1; i <= NOTIFICATIONS; ++ i) {
+		n->m_focusProvider->setForegroundWindow(getHwnd(i));
+		n->m_engine->notifyFocusChanged();
+	}
+	return 0;
+}
+
+
+/// notifications from another thread are never lost
+static void testThread()
+{
+	FakeFocusProvider fp;
+	FakeEngine engine(&fp);
+	Notifier n = { &fp, &engine };
+	HANDLE thread;
+	CHECK_TRUE( thread = CreateThread(NULL, 0, notifier, &n, 0, NULL) );
+
+	// the clock stops, so only the notifications make the engine look
+	size_t events = 0;
+	while (WaitForSingleObject(thread, 0) == WAIT_TIMEOUT) {
+		engine.processInput(0);
+		++ events;
+	}
+	CHECK_TRUE( CloseHandle(thread) );
+	engine.processInput(0);
+	bool isOk = engine.m_hwndFocus == getHwnd(NOTIFICATIONS) &&
+		fp.m_callCount <= static_cast<LONG>(events) + 1;
+	check("another thread notifies", isOk, fp.m_callCount);
+}
+
+
+int main()
+{
+	testClock("notification and interval", 1000);
+	testClock("GetTickCount() wraps around", 0xffffff00);
+	testThread();
+	if (s_failures) {
+		printf("FAILED: %d\n", s_failures);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,240 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_inputqueue.cpp - InputQueue against the former deque + lock queue
+
+
+#include "misc.h"
+#include "driver.h"
+#include "inputqueue.h"
+#include "multithread.h"
+#include <deque>
+#include <cstdio>
+
+
+enum {
+	PRODUCERS = 4,				/// hook threads
+	EVENTS = 250000,				/// per producer
+};
+
+
+/// the queue yamy used before InputQueue: a deque guarded by a lock and an
+/// event that wakes the keyboard handler up for each event
+class LockedQueue
+{
+	std::deque<KEYBOARD_INPUT_DATA> m_queue;	///
+	CriticalSection m_cs;				///
+	HANDLE m_event;				///
+
+public:
+	///
+	LockedQueue() {
+		CHECK_TRUE( m_event = CreateEvent(NULL, TRUE, FALSE, NULL) );
+	}
+	///
+	~LockedQueue() {
+		CHECK_TRUE( CloseHandle(m_event) );
+	}
+	///
+	bool push(const KEYBOARD_INPUT_DATA *i_data, LONG i_count = 1) {
+		Acquire a(&m_cs);
+		for (LONG i = 0; i < i_count; ++ i)
+			m_queue.push_back(i_data[i]);
+		SetEvent(m_event);
+		return true;
+	}
+	///
+	bool pop(KEYBOARD_INPUT_DATA *o_data) {
+		while (true) {
+			{
+				Acquire a(&m_cs);
+				if (!m_queue.empty()) {
+					*o_data = m_queue.front();
+					m_queue.pop_front();
+					if (m_queue.empty())
+						ResetEvent(m_event);
+					return true;
+				}
+			}
+			WaitForSingleObject(m_event, INFINITE);
+		}
+	}
+};
+
+
+typedef InputQueue<KEYBOARD_INPUT_DATA, 1024> RingQueue;	///
+
+
+/// the producers tag each event with their id and a sequence number
+template <class Q>
+class Producer
+{
+public:
+	Q *m_queue;					///
+	USHORT m_id;					///
+	LONG m_retryCount;				/// pushes refused by a full queue
+	LONGLONG m_pushTime;				/// total time spent in push()
+	LONGLONG m_maxPushTime;			/// the longest push()
+
+	///
+	static DWORD WINAPI run(LPVOID i_this) {
+		Producer *p = static_cast<Producer *>(i_this);
+		KEYBOARD_INPUT_DATA kids[2];
+		for (ULONG seq = 0; seq < EVENTS; ) {
+			// every 16th message is a pair, as a wheel message is
+			LONG count = (seq % 16 == 15 && seq + 1 < EVENTS) ? 2 : 1;
+			for (LONG i = 0; i < count; ++ i) {
+				kids[i].UnitId = p->m_id;
+				kids[i].MakeCode = 0;
+				kids[i].Flags = 0;
+				kids[i].Reserved = 0;
+				kids[i].ExtraInformation = seq + i;
+			}
+			LARGE_INTEGER begin, end;
+			QueryPerformanceCounter(&begin);
+			bool isPushed = p->m_queue->push(kids, count);
+			QueryPerformanceCounter(&end);
+			LONGLONG t = end.QuadPart - begin.QuadPart;
+			p->m_pushTime += t;
+			if (p->m_maxPushTime < t)
+				p->m_maxPushTime = t;
+			if (isPushed)
+				seq += count;
+			else {
+				++ p->m_retryCount;
+				Sleep(0);
+			}
+		}
+		return 0;
+	}
+};
+
+
+/// pop everything in the order of each producer
+static bool consume(RingQueue *io_queue, KEYBOARD_INPUT_DATA *o_kid)
+{
+	while (!io_queue->pop(o_kid))
+		io_queue->wait();
+	return true;
+}
+
+
+///
+static bool consume(LockedQueue *io_queue, KEYBOARD_INPUT_DATA *o_kid)
+{
+	return io_queue->pop(o_kid);
+}
+
+
+/// run the producers against one consumer. @return the failure count
+template <class Q>
+static int run(const char *i_name, Q *io_queue)
+{
+	Producer<Q> producers[PRODUCERS];
+	HANDLE threads[PRODUCERS];
+	DWORD start = GetTickCount();
+	for (int i = 0; i < PRODUCERS; ++ i) {
+		producers[i].m_queue = io_queue;
+		producers[i].m_id = static_cast<USHORT>(i);
+		producers[i].m_retryCount = 0;
+		producers[i].m_pushTime = 0;
+		producers[i].m_maxPushTime = 0;
+		CHECK_TRUE( threads[i] = CreateThread(NULL, 0, Producer<Q>::run,
+											  &producers[i], 0, NULL) );
+	}
+
+	int failures = 0;
+	ULONG next[PRODUCERS] = { 0 };
+	for (long n = 0; n < long(PRODUCERS) * EVENTS; ++ n) {
+		KEYBOARD_INPUT_DATA kid;
+		consume(io_queue, &kid);
+		if (PRODUCERS <= kid.UnitId ||
+				kid.ExtraInformation != next[kid.UnitId]) {
+			if (failures ++ < 10)
+				printf("%s: producer %u sent %lu, expected %lu\n", i_name,
+					   kid.UnitId, (unsigned long)kid.ExtraInformation,
+					   PRODUCERS <= kid.UnitId ? 0 :
+					   (unsigned long)next[kid.UnitId]);
+			continue;
+		}
+		++ next[kid.UnitId];
+	}
+	DWORD elapsed = GetTickCount() - start;
+
+	LONG retryCount = 0;
+	LONGLONG pushTime = 0, maxPushTime = 0;
+	for (int i = 0; i < PRODUCERS; ++ i) {
+		CHECK_TRUE( CloseHandle(threads[i]) );
+		retryCount += producers[i].m_retryCount;
+		pushTime += producers[i].m_pushTime;
+		maxPushTime = MAX(maxPushTime, producers[i].m_maxPushTime);
+	}
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	printf("%-7s %d producers x %d events: %5lu ms, %8.0f events/ms, "
+		   "push %6.0f ns avg %8.0f ns max, %ld refused pushes\n",
+		   i_name, PRODUCERS, EVENTS, (unsigned long)elapsed,
+		   double(PRODUCERS) * EVENTS / (elapsed ? elapsed : 1),
+		   1e9 * pushTime / frequency.QuadPart /
+		   (double(PRODUCERS) * EVENTS + retryCount),
+		   1e9 * maxPushTime / frequency.QuadPart, (long)retryCount);
+	return failures;
+}
+
+
+/// boundary behaviour of a single threaded ring
+static int testRing()
+{
+	int failures = 0;
+	InputQueue<int, 4> q;
+	int data[4] = { 1, 2, 3, 4 }, out = 0;
+
+	if (q.push(data[0]))
+		printf("ring: push before open() succeeded\n"), ++ failures;
+	q.open();
+	if (!q.push(data, 3))
+		printf("ring: push of 3 into an empty ring of 4 failed\n"), ++ failures;
+	if (q.push(data, 2))
+		printf("ring: push of 2 into 1 free slot succeeded\n"), ++ failures;
+	if (q.getOverflowCount() != 2)
+		printf("ring: overflow count %ld, expected 2\n",
+			   (long)q.getOverflowCount()), ++ failures;
+	if (!q.push(data[3]))
+		printf("ring: push into the last slot failed\n"), ++ failures;
+	for (int i = 0; i < 4; ++ i)
+		if (!q.pop(&out) || out != i + 1)
+			printf("ring: pop %d returned %d\n", i, out), ++ failures;
+	if (q.pop(&out))
+		printf("ring: pop from an empty ring succeeded\n"), ++ failures;
+	if (q.getHighWater() != 4)
+		printf("ring: high water %ld, expected 4\n",
+			   (long)q.getHighWater()), ++ failures;
+	// wrap around many times
+	for (int i = 0; i < 1000; ++ i)
+		if (!q.push(data, 3) || !q.pop(&out) || !q.pop(&out) ||
+				!q.pop(&out) || out != 3) {
+			printf("ring: wrap around failed at %d\n", i), ++ failures;
+			break;
+		}
+	// a wakeUp() before wait() is not lost (it would block otherwise)
+	q.wakeUp();
+	if (!q.wait() || q.pop(&out))
+		printf("ring: wait() after wakeUp() failed\n"), ++ failures;
+	q.close();
+	if (q.push(data[0]) || q.wait())
+		printf("ring: closed ring accepts data\n"), ++ failures;
+	return failures;
+}
+
+
+int main()
+{
+	int failures = testRing();
+	LockedQueue locked;
+	failures += run("locked", &locked);
+	RingQueue ring;
+	ring.open();
+	failures += run("ring", &ring);
+	printf("ring high water: %ld/%ld\n", (long)ring.getHighWater(),
+		   (long)ring.getCapacity());
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_keyboard.cpp - Keyboard::searchKey() against the former hashed lists
+
+
+#include "misc.h"
+#include "keyboard.h"
+#include <cstdio>
+#include <cstdlib>
+
+
+enum {
+	ROUNDS = 200,					/// random keyboards
+	QUERIES = 500,				/// random searches per keyboard
+	LOOKUPS = 10000000,				/// searches of the benchmark
+};
+
+
+/// the key search yamy used before the scan code table: keys hashed by
+/// their first scan code, the last added key first
+class HashedKeys
+{
+	enum {
+		HASHED_KEYS_SIZE = 128,			///
+	};
+	typedef std::list<Key> Keys;			///
+
+	Keys m_hashedKeys[HASHED_KEYS_SIZE];		///
+
+	///
+	Keys &getKeys(const Key &i_key) {
+		return m_hashedKeys[i_key.getScanCodes()->m_scan % HASHED_KEYS_SIZE];
+	}
+
+public:
+	///
+	void addKey(const Key &i_key) {
+		getKeys(i_key).push_front(i_key);
+	}
+
+	///
+	const Key *searchKey(const Key &i_key, bool i_isPrefix) {
+		Keys &keys = getKeys(i_key);
+		for (Keys::iterator i = keys.begin(); i != keys.end(); ++ i)
+			if (i_isPrefix ? (*i).isPrefixScanCode(i_key) :
+					(*i).isSameScanCode(i_key))
+				return &*i;
+		return NULL;
+	}
+};
+
+
+/// a random scan code; few of them, so that keys share scan codes
+static ScanCode randomScanCode(bool i_isInput)
+{
+	USHORT scan = static_cast<USHORT>(rand() % 6);
+	if (rand() % 20 == 0)
+		scan += 300;				// out of the table
+	USHORT flags = static_cast<USHORT>((rand() % 3) * 2);	// none, E0, E1
+	if (i_isInput && rand() % 2)
+		flags |= ScanCode::BREAK;
+	return ScanCode(scan, flags);
+}
+
+
+///
+static Key randomKey(bool i_isInput)
+{
+	Key key;
+	size_t size = 1;
+	if (i_isInput)
+		size = rand() % 3 + 1;
+	else if (rand() % 3 == 0)
+		size = rand() % 3 + 1;
+	for (size_t i = 0; i < size; ++ i)
+		key.addScanCode(randomScanCode(i_isInput));
+	return key;
+}
+
+
+///
+static const _TCHAR *getName(const Key *i_key)
+{
+	return i_key ? i_key->getName().c_str() : _T("(none)");
+}
+
+
+/// random keyboards: both searches must find the same key
+static int testSearch()
+{
+	srand(1);
+	int failures = 0;
+	for (int round = 0; round < ROUNDS; ++ round) {
+		Keyboard keyboard;
+		HashedKeys hashedKeys;
+		int keysSize = rand() % 60 + 1;
+		for (int i = 0; i < keysSize; ++ i) {
+			Key key = randomKey(false);
+			tstringstream name;
+			name << _T("key") << i;
+			key.addName(name.str());
+			keyboard.addKey(key);
+			hashedKeys.addKey(key);
+		}
+		for (int i = 0; i < QUERIES; ++ i) {
+			Key in = randomKey(true);
+			for (int isPrefix = 0; isPrefix < 2; ++ isPrefix) {
+				const Key *expected = hashedKeys.searchKey(in, !!isPrefix);
+				const Key *found = isPrefix ?
+					keyboard.searchPrefixKey(in) : keyboard.searchKey(in);
+				if ((expected ? expected->getName() : _T("")) !=
+						(found ? found->getName() : _T(""))) {
+					if (failures ++ < 10)
+						printf("round %d: %s found %ls, expected %ls\n", round,
+							   isPrefix ? "searchPrefixKey" : "searchKey",
+							   getName(found), getName(expected));
+				}
+			}
+		}
+	}
+	return failures;
+}
+
+
+/// the keys of a 109 keyboard: 0x01-0x7f, E0- keys and two multi scan
+/// code keys (Pause, PrintScreen)
+template <class K>
+static void add109Keys(K *o_keyboard)
+{
+	static const USHORT e0Scans[] = {
+		0x1c, 0x1d, 0x35, 0x37, 0x38, 0x47, 0x48, 0x49, 0x4b, 0x4d,
+		0x4f, 0x50, 0x51, 0x52, 0x53, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+	};
+	for (USHORT scan = 0x01; scan < 0x80; ++ scan) {
+		Key key;
+		key.addScanCode(ScanCode(scan, 0));
+		o_keyboard->addKey(key);
+	}
+	for (size_t i = 0; i < NUMBER_OF(e0Scans); ++ i) {
+		Key key;
+		key.addScanCode(ScanCode(e0Scans[i], ScanCode::E0));
+		o_keyboard->addKey(key);
+	}
+	Key pause;
+	pause.addScanCode(ScanCode(0x1d, ScanCode::E1));
+	pause.addScanCode(ScanCode(0x45, 0));
+	o_keyboard->addKey(pause);
+	Key printScreen;
+	printScreen.addScanCode(ScanCode(0x2a, ScanCode::E0));
+	printScreen.addScanCode(ScanCode(0x37, ScanCode::E0));
+	o_keyboard->addKey(printScreen);
+}
+
+
+/// time LOOKUPS searches of the single scan code events a hook delivers
+template <class F>
+static double measure(const Key *i_inputs, size_t i_inputsSize, F i_search)
+{
+	LARGE_INTEGER begin, end, frequency;
+	size_t found = 0;
+	QueryPerformanceCounter(&begin);
+	for (size_t i = 0; i < LOOKUPS; ++ i)
+		if (i_search(i_inputs[i % i_inputsSize]))
+			++ found;
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+	if (found == 0)
+		printf("nothing found\n");
+	return 1e9 * (end.QuadPart - begin.QuadPart) / frequency.QuadPart /
+		LOOKUPS;
+}
+
+
+static Keyboard *s_keyboard;			///
+static HashedKeys *s_hashedKeys;		///
+
+///
+static bool searchTable(const Key &i_key)
+{
+	return !!s_keyboard->searchKey(i_key);
+}
+
+///
+static bool searchLists(const Key &i_key)
+{
+	return !!s_hashedKeys->searchKey(i_key, false);
+}
+
+
+///
+static void benchmark()
+{
+	Keyboard keyboard;
+	HashedKeys hashedKeys;
+	add109Keys(&keyboard);
+	add109Keys(&hashedKeys);
+	s_keyboard = &keyboard;
+	s_hashedKeys = &hashedKeys;
+
+	// typing: mostly the letters, sometimes an E0- key
+	enum { INPUTS_SIZE = 4096 };
+	static Key inputs[INPUTS_SIZE];
+	srand(2);
+	for (size_t i = 0; i < INPUTS_SIZE; ++ i) {
+		if (rand() % 8 == 0)
+			inputs[i].addScanCode(ScanCode(0x48 + rand() % 8, ScanCode::E0));
+		else
+			inputs[i].addScanCode(ScanCode(0x10 + rand() % 0x2c,
+										   rand() % 2 ? ScanCode::BREAK : 0));
+	}
+	printf("searchKey: lists %6.1f ns, table %6.1f ns\n",
+		   measure(inputs, INPUTS_SIZE, searchLists),
+		   measure(inputs, INPUTS_SIZE, searchTable));
+}
+
+
+int main()
+{
+	int failures = testSearch();
+	benchmark();
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_keymap.cpp - Keymap::searchAssignment() of a compiled keymap against
+// the same keymap searching its assignment lists
+
+
+#include "misc.h"
+#include "keymap.h"
+#include "setting.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+
+enum {
+	ROUNDS = 100,					/// random keymaps
+	QUERIES = 5000,				/// random searches per keymap
+	KEYS_SIZE = 150,				/// keys of a keyboard
+	LOOKUPS = 10000000,				/// searches of the benchmark
+};
+
+
+// the modules of the setting are not built on the host
+namespace Event
+{
+Key *events[] = { NULL };
+}
+tostream &operator<<(tostream &i_ost, const FunctionData *)
+{
+	return i_ost;
+}
+
+
+/// a keyboard of KEYS_SIZE keys; some share the first scan code, so that
+/// they are in the same assignment list
+static void addKeys(Keyboard *o_keyboard)
+{
+	for (int i = 0; i < KEYS_SIZE; ++ i) {
+		Key key;
+		key.addScanCode(ScanCode(static_cast<USHORT>(i % 100 + 1), 0));
+		if (100 <= i)
+			key.addScanCode(ScanCode(static_cast<USHORT>(i), 0));
+		tstringstream name;
+		name << _T("key") << i;
+		key.addName(name.str());
+		o_keyboard->addKey(key);
+	}
+}
+
+
+/// a random modifier of an assignment, mostly dontcare like in a setting
+static Modifier randomModifier()
+{
+	Modifier m;
+	for (int i = 0; i < Modifier::Type_end; ++ i) {
+		Modifier::Type mt = static_cast<Modifier::Type>(i);
+		if (rand() % 6 == 0)
+			m.press(mt, !!(rand() % 2));
+	}
+	return m;
+}
+
+
+/// a random modifier of an input event: few modifiers pressed
+static Modifier randomInputModifier()
+{
+	Modifier m;
+	for (int i = 0; i < Modifier::Type_end; ++ i) {
+		Modifier::Type mt = static_cast<Modifier::Type>(i);
+		m.press(mt, rand() % 5 == 0);
+	}
+	return m;
+}
+
+
+/// a random keymap twice: o_compiled is compiled, o_lists is not
+static void addAssignments(Keyboard *i_keyboard, std::vector<Key *> *o_keys,
+						   std::vector<KeySeq *> *o_keySeqs,
+						   Keymap *o_compiled, Keymap *o_lists)
+{
+	o_keys->clear();
+	for (Keyboard::KeyIterator i = i_keyboard->getKeyIterator(); *i; ++ i)
+		o_keys->push_back(*i);
+	int size = rand() % 600 + 1;
+	for (int i = 0; i < size; ++ i) {
+		tstringstream name;
+		name << _T("keyseq") << o_keySeqs->size();
+		KeySeq *keySeq = new KeySeq(name.str());
+		o_keySeqs->push_back(keySeq);
+		// a few keys get most of the assignments
+		Key *key = (*o_keys)[rand() % 2 ? rand() % 10 : rand() % KEYS_SIZE];
+		ModifiedKey mk(randomModifier(), key);
+		o_compiled->addAssignment(mk, keySeq);
+		o_lists->addAssignment(mk, keySeq);
+	}
+	o_compiled->compile(*i_keyboard);
+}
+
+
+///
+static const KeySeq *getKeySeq(const Keymap::KeyAssignment *i_ka)
+{
+	return i_ka ? i_ka->m_keySeq : NULL;
+}
+
+
+/// random keymaps: both searches must find the same assignment
+static int testSearch()
+{
+	srand(1);
+	int failures = 0;
+	for (int round = 0; round < ROUNDS; ++ round) {
+		Keyboard keyboard;
+		addKeys(&keyboard);
+		std::vector<Key *> keys;
+		std::vector<KeySeq *> keySeqs;
+		Keymap compiled(Keymap::Type_keymap, _T("compiled"), _T(""), _T(""),
+						NULL, NULL);
+		Keymap lists(Keymap::Type_keymap, _T("lists"), _T(""), _T(""),
+					 NULL, NULL);
+		addAssignments(&keyboard, &keys, &keySeqs, &compiled, &lists);
+
+		for (int i = 0; i < QUERIES; ++ i) {
+			ModifiedKey mk(randomInputModifier(),
+						   keys[rand() % 2 ? rand() % 10 : rand() % KEYS_SIZE]);
+			const KeySeq *expected = getKeySeq(lists.searchAssignment(mk));
+			const KeySeq *found = getKeySeq(compiled.searchAssignment(mk));
+			if (found != expected && failures ++ < 10) {
+				tstringstream ss;
+				ss << mk << _T(": ")
+				   << (found ? found->getName() : _T("(none)"))
+				   << _T(", expected ")
+				   << (expected ? expected->getName() : _T("(none)"));
+				printf("round %d: %ls\n", round, ss.str().c_str());
+			}
+		}
+		for (size_t i = 0; i < keySeqs.size(); ++ i)
+			delete keySeqs[i];
+	}
+	return failures;
+}
+
+
+/// the time of LOOKUPS searches in i_keymap
+static double benchmark(const Keymap &i_keymap,
+						const std::vector<ModifiedKey> &i_mks,
+						size_t *io_found)
+{
+	clock_t start = clock();
+	for (int i = 0; i < LOOKUPS; ++ i)
+		if (i_keymap.searchAssignment(i_mks[i % i_mks.size()]))
+			++ *io_found;
+	return double(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+/// searches in a keymap of 500 assignments, 50 on each of ten keys
+static void benchmark()
+{
+	srand(3);
+	Keyboard keyboard;
+	addKeys(&keyboard);
+	std::vector<Key *> keys;
+	for (Keyboard::KeyIterator i = keyboard.getKeyIterator(); *i; ++ i)
+		keys.push_back(*i);
+	std::vector<KeySeq *> keySeqs;
+	Keymap compiled(Keymap::Type_keymap, _T("compiled"), _T(""), _T(""),
+					NULL, NULL);
+	Keymap lists(Keymap::Type_keymap, _T("lists"), _T(""), _T(""),
+				 NULL, NULL);
+	for (int i = 0; i < 500; ++ i) {
+		KeySeq *keySeq = new KeySeq(_T("keyseq"));
+		keySeqs.push_back(keySeq);
+		ModifiedKey mk(randomModifier(), keys[i % 10]);
+		compiled.addAssignment(mk, keySeq);
+		lists.addAssignment(mk, keySeq);
+	}
+	compiled.compile(keyboard);
+
+	std::vector<ModifiedKey> mks;
+	for (int i = 0; i < 1024; ++ i)
+		mks.push_back(ModifiedKey(randomInputModifier(), keys[rand() % 20]));
+	size_t found = 0;
+	double listTime = benchmark(lists, mks, &found);
+	double compiledTime = benchmark(compiled, mks, &found);
+	printf("searchAssignment: lists %5.1f ns, compiled %5.1f ns "
+		   "(%lu found)\n",
+		   listTime * 1e9 / LOOKUPS, compiledTime * 1e9 / LOOKUPS,
+		   static_cast<unsigned long>(found));
+	for (size_t i = 0; i < keySeqs.size(); ++ i)
+		delete keySeqs[i];
+}
+
+
+int main()
+{
+	int failures = testSearch();
+	if (failures) {
+		printf("FAILED: %d\n", failures);
+		return 1;
+	}
+	benchmark();
+	printf("ok\n");
+	return 0;
+}
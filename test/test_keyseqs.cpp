@@ -0,0 +1,264 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_keyseqs.cpp - KeySeqs::add() with share-keyseq on and off, for the
+// right hand sides of the key and event lines of the shipped settings
+
+
+#include "misc.h"
+#include "errormessage.h"
+#include "keymap.h"
+#include "parser.h"
+#include "setting.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <glob.h>
+#include <new>
+#include <set>
+
+
+enum {
+	ROUNDS = 2000,				/// loads of the benchmark
+};
+
+
+static size_t s_allocatedSize;			/// bytes operator new gave so far
+
+
+///
+void *operator new(size_t i_size)
+{
+	s_allocatedSize += i_size;
+	if (void *p = malloc(i_size ? i_size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+///
+void operator delete(void *i_p) throw()
+{
+	free(i_p);
+}
+
+///
+void operator delete(void *i_p, size_t) throw()
+{
+	free(i_p);
+}
+
+
+// the modules of the setting are not built on the host
+namespace Event
+{
+Key *events[] = { NULL };
+}
+tostream &operator<<(tostream &i_ost, const FunctionData *)
+{
+	return i_ost;
+}
+
+
+/// the prefixes of SettingLoader::loadData()
+static const _TCHAR *s_prefixNames[] = {
+	_T("="), _T("=>"), _T("&&"), _T("||"), _T(":"), _T("$"), _T("&"),
+	_T("-="), _T("+="), _T("!!!"), _T("!!"), _T("!"),
+	_T("E0-"), _T("E1-"),
+	_T("S-"), _T("A-"), _T("M-"), _T("C-"),
+	_T("W-"), _T("*"), _T("~"),
+	_T("U-"), _T("D-"),
+	_T("R-"), _T("IL-"), _T("IC-"), _T("I-"),
+	_T("NL-"), _T("CL-"), _T("SL-"), _T("KL-"),
+	_T("MAX-"), _T("MIN-"), _T("MMAX-"), _T("MMIN-"),
+	_T("T-"), _T("TS-"),
+	_T("M0-"), _T("M1-"), _T("M2-"), _T("M3-"), _T("M4-"),
+	_T("M5-"), _T("M6-"), _T("M7-"), _T("M8-"), _T("M9-"),
+	_T("L0-"), _T("L1-"), _T("L2-"), _T("L3-"), _T("L4-"),
+	_T("L5-"), _T("L6-"), _T("L7-"), _T("L8-"), _T("L9-"),
+};
+
+
+/// prefixSortPred() of setting.cpp
+static bool prefixSortPred(const tstringi &i_a, const tstringi &i_b)
+{
+	return i_b.size() < i_a.size();
+}
+
+
+/// read a setting file.  the bytes are widened one by one, which is enough
+/// for the ASCII symbols
+static tstring readFile(const char *i_path)
+{
+	tstring contents;
+	FILE *fp = fopen(i_path, "rb");
+	if (!fp)
+		return contents;
+	int c;
+	while ((c = getc(fp)) != EOF)
+		contents += static_cast<_TCHAR>(static_cast<unsigned char>(c));
+	fclose(fp);
+	return contents;
+}
+
+
+typedef std::vector<tstring> RightHandSide;	/// the tokens after =
+
+
+/** the right hand sides of the key and event lines of the shipped
+    settings, in all the branches of if and else */
+static std::vector<RightHandSide> readRightHandSides()
+{
+	std::vector<tstringi> prefixes;
+	for (size_t i = 0; i < NUMBER_OF(s_prefixNames); ++ i)
+		prefixes.push_back(s_prefixNames[i]);
+	std::sort(prefixes.begin(), prefixes.end(), prefixSortPred);
+
+	std::vector<RightHandSide> rhss;
+	glob_t g;
+	if (glob("../*.mayu", 0, NULL, &g) != 0)
+		return rhss;
+	for (size_t j = 0; j < g.gl_pathc; ++ j) {
+		tstring contents = readFile(g.gl_pathv[j]);
+		Parser parser(contents.c_str(), contents.size());
+		parser.setPrefixes(&prefixes);
+		std::vector<Token> tokens;
+		while (true) {
+			try {
+				if (!parser.getLine(&tokens))
+					break;
+			} catch (ErrorMessage &) {
+				continue;				// the Shift_JIS strings
+			}
+			if (tokens.empty() ||
+					!(tokens[0] == _T("key") || tokens[0] == _T("event")))
+				continue;
+			size_t i = 1;
+			while (i < tokens.size() &&
+					!(tokens[i] == _T("=") || tokens[i] == _T("=>")))
+				++ i;
+			if (i == tokens.size())
+				continue;
+			RightHandSide rhs;
+			for (++ i; i < tokens.size(); ++ i)
+				rhs.push_back(tokens[i].getRawString().c_str());
+			rhss.push_back(rhs);
+		}
+	}
+	globfree(&g);
+	return rhss;
+}
+
+
+/** anonymous keyseqs for i_rhss.  each token is a key action, so that
+    two keyseqs are the same if their tokens are.  a function with
+    arguments is never shared by KeySeqs, so such a keyseq gets an
+    action of its own. */
+static void makeKeySeqs(const std::vector<RightHandSide> &i_rhss,
+						std::list<Key> *o_keys, std::vector<KeySeq> *o_keySeqs,
+						size_t *o_distinctSize)
+{
+	std::map<tstring, Key *> keys;
+	std::set<RightHandSide> distinct;
+	for (size_t i = 0; i < i_rhss.size(); ++ i) {
+		RightHandSide rhs = i_rhss[i];
+		if (std::find(rhs.begin(), rhs.end(), _T("(")) != rhs.end()) {
+			tstringstream unique;
+			unique << _T("(") << i;
+			rhs.push_back(unique.str());
+		}
+		distinct.insert(rhs);
+		KeySeq keySeq(_T(""));
+		for (size_t j = 0; j < rhs.size(); ++ j) {
+			Key *&key = keys[rhs[j]];
+			if (!key) {
+				o_keys->push_back(Key());
+				key = &o_keys->back();
+				key->addName(rhs[j].c_str());
+			}
+			keySeq.add(ActionKey(ModifiedKey(Modifier(), key)));
+		}
+		o_keySeqs->push_back(keySeq);
+	}
+	*o_distinctSize = distinct.size();
+}
+
+
+/// add i_keySeqs to o_keySeqs; o_size is the bytes it allocated
+static bool addKeySeqs(const std::vector<KeySeq> &i_keySeqs,
+					   KeySeqs *o_keySeqs, size_t *o_size)
+{
+	bool isOk = true;
+	size_t size = s_allocatedSize;
+	for (size_t i = 0; i < i_keySeqs.size(); ++ i)
+		if (!o_keySeqs->add(i_keySeqs[i])->isSame(i_keySeqs[i]))
+			isOk = false;
+	*o_size = s_allocatedSize - size;
+	return isOk;
+}
+
+
+/// the time of ROUNDS times adding i_keySeqs
+static double benchmark(const std::vector<KeySeq> &i_keySeqs,
+						bool i_doesShare)
+{
+	LARGE_INTEGER begin, end, frequency;
+	QueryPerformanceCounter(&begin);
+	for (int round = 0; round < ROUNDS; ++ round) {
+		KeySeqs keySeqs;
+		keySeqs.setDoesShareAnonymous(i_doesShare);
+		for (size_t i = 0; i < i_keySeqs.size(); ++ i)
+			keySeqs.add(i_keySeqs[i]);
+	}
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+	return 1e6 * (end.QuadPart - begin.QuadPart) / frequency.QuadPart /
+		ROUNDS;
+}
+
+
+int main()
+{
+	std::list<Key> keys;
+	std::vector<KeySeq> input;
+	size_t distinctSize;
+	makeKeySeqs(readRightHandSides(), &keys, &input, &distinctSize);
+	if (input.empty()) {
+		printf("FAILED: no key lines in ../*.mayu\n");
+		return 1;
+	}
+
+	int failures = 0;
+	KeySeqs shared, copied;
+	copied.setDoesShareAnonymous(false);
+	size_t sharedSize, copiedSize;
+	if (!addKeySeqs(input, &shared, &sharedSize) ||
+			!addKeySeqs(input, &copied, &copiedSize)) {
+		printf("add() returned a keyseq that is not the same\n");
+		++ failures;
+	}
+	if (shared.getSize() != distinctSize ||
+			shared.getSize() + shared.getSharedCount() != input.size() ||
+			copied.getSize() != input.size()) {
+		printf("%lu and %lu keyseqs, expected %lu and %lu\n",
+			   static_cast<unsigned long>(shared.getSize()),
+			   static_cast<unsigned long>(copied.getSize()),
+			   static_cast<unsigned long>(distinctSize),
+			   static_cast<unsigned long>(input.size()));
+		++ failures;
+	}
+	if (failures) {
+		printf("FAILED: %d\n", failures);
+		return 1;
+	}
+
+	double sharedTime = benchmark(input, true);
+	double copiedTime = benchmark(input, false);
+	printf("../*.mayu: %lu key and event lines\n",
+		   static_cast<unsigned long>(input.size()));
+	printf("share-keyseq = true:  %4lu keyseqs, %6lu bytes, %5.1f us\n",
+		   static_cast<unsigned long>(shared.getSize()),
+		   static_cast<unsigned long>(sharedSize), sharedTime);
+	printf("share-keyseq = false: %4lu keyseqs, %6lu bytes, %5.1f us\n",
+		   static_cast<unsigned long>(copied.getSize()),
+		   static_cast<unsigned long>(copiedSize), copiedTime);
+	printf("ok\n");
+	return 0;
+}
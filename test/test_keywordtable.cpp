@@ -0,0 +1,364 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_keywordtable.cpp - KeywordTable against the former comparisons with
+// every keyword.  setting.cpp does not build on the host, so the entries
+// below are the ones of SettingLoader::load_LINE(), load_MODIFIER() and
+// load_MODIFIER_ASSIGNMENT()
+
+
+#include "misc.h"
+#include "errormessage.h"
+#include "keyboard.h"
+#include "keywordtable.h"
+#include <cstdio>
+#include <cstdlib>
+#include <glob.h>
+
+
+enum {
+	RANDOM_STRINGS = 1000000,			/// random searches of each table
+	BENCHMARK_ROUNDS = 200,			/// searches of each token
+};
+
+
+/// the statements of load_LINE()
+enum Statement {
+	Statement_if, Statement_else, Statement_elseif, Statement_endif,
+	Statement_define, Statement_include, Statement_def,
+	Statement_keymap, Statement_key, Statement_event, Statement_mod,
+	Statement_keyseq,
+};
+typedef KeywordTable<Statement> Statements;	///
+static const Statements::Entry s_statements[] = {
+	{ _T("if"), Statement_if },
+	{ _T("and"), Statement_if },
+	{ _T("else"), Statement_else },
+	{ _T("elseif"), Statement_elseif },
+	{ _T("elsif"), Statement_elseif },
+	{ _T("elif"), Statement_elseif },
+	{ _T("or"), Statement_elseif },
+	{ _T("endif"), Statement_endif },
+	{ _T("define"), Statement_define },
+	{ _T("include"), Statement_include },
+	{ _T("def"), Statement_def },
+	{ _T("keymap"), Statement_keymap },
+	{ _T("keymap2"), Statement_keymap },
+	{ _T("window"), Statement_keymap },
+	{ _T("key"), Statement_key },
+	{ _T("event"), Statement_event },
+	{ _T("mod"), Statement_mod },
+	{ _T("keyseq"), Statement_keyseq },
+};
+
+typedef KeywordTable<Modifier::Type> ModifierTable;	///
+/// the modifiers of load_MODIFIER()
+static const ModifierTable::Entry s_modifiers[] = {
+	{ _T("S-"),  Modifier::Type_Shift },
+	{ _T("A-"),  Modifier::Type_Alt },
+	{ _T("M-"),  Modifier::Type_Alt },
+	{ _T("C-"),  Modifier::Type_Control },
+	{ _T("W-"),  Modifier::Type_Windows },
+	{ _T("U-"),  Modifier::Type_Up },
+	{ _T("D-"),  Modifier::Type_Down },
+	{ _T("R-"),  Modifier::Type_Repeat },
+	{ _T("IL-"), Modifier::Type_ImeLock },
+	{ _T("IC-"), Modifier::Type_ImeComp },
+	{ _T("I-"),  Modifier::Type_ImeComp },
+	{ _T("NL-"), Modifier::Type_NumLock },
+	{ _T("CL-"), Modifier::Type_CapsLock },
+	{ _T("SL-"), Modifier::Type_ScrollLock },
+	{ _T("KL-"), Modifier::Type_KanaLock },
+	{ _T("MAX-"), Modifier::Type_Maximized },
+	{ _T("MIN-"), Modifier::Type_Minimized },
+	{ _T("MMAX-"), Modifier::Type_MdiMaximized },
+	{ _T("MMIN-"), Modifier::Type_MdiMinimized },
+	{ _T("T-"), Modifier::Type_Touchpad },
+	{ _T("TS-"), Modifier::Type_TouchpadSticky },
+	{ _T("M0-"), Modifier::Type_Mod0 },
+	{ _T("M1-"), Modifier::Type_Mod1 },
+	{ _T("M2-"), Modifier::Type_Mod2 },
+	{ _T("M3-"), Modifier::Type_Mod3 },
+	{ _T("M4-"), Modifier::Type_Mod4 },
+	{ _T("M5-"), Modifier::Type_Mod5 },
+	{ _T("M6-"), Modifier::Type_Mod6 },
+	{ _T("M7-"), Modifier::Type_Mod7 },
+	{ _T("M8-"), Modifier::Type_Mod8 },
+	{ _T("M9-"), Modifier::Type_Mod9 },
+	{ _T("L0-"), Modifier::Type_Lock0 },
+	{ _T("L1-"), Modifier::Type_Lock1 },
+	{ _T("L2-"), Modifier::Type_Lock2 },
+	{ _T("L3-"), Modifier::Type_Lock3 },
+	{ _T("L4-"), Modifier::Type_Lock4 },
+	{ _T("L5-"), Modifier::Type_Lock5 },
+	{ _T("L6-"), Modifier::Type_Lock6 },
+	{ _T("L7-"), Modifier::Type_Lock7 },
+	{ _T("L8-"), Modifier::Type_Lock8 },
+	{ _T("L9-"), Modifier::Type_Lock9 },
+};
+
+/// the modifier names of load_MODIFIER_ASSIGNMENT()
+static const ModifierTable::Entry s_modifierNames[] = {
+	{ _T("shift"), Modifier::Type_Shift },
+	{ _T("alt"), Modifier::Type_Alt },
+	{ _T("meta"), Modifier::Type_Alt },
+	{ _T("menu"), Modifier::Type_Alt },
+	{ _T("control"), Modifier::Type_Control },
+	{ _T("ctrl"), Modifier::Type_Control },
+	{ _T("windows"), Modifier::Type_Windows },
+	{ _T("win"), Modifier::Type_Windows },
+	{ _T("mod0"), Modifier::Type_Mod0 },
+	{ _T("mod1"), Modifier::Type_Mod1 },
+	{ _T("mod2"), Modifier::Type_Mod2 },
+	{ _T("mod3"), Modifier::Type_Mod3 },
+	{ _T("mod4"), Modifier::Type_Mod4 },
+	{ _T("mod5"), Modifier::Type_Mod5 },
+	{ _T("mod6"), Modifier::Type_Mod6 },
+	{ _T("mod7"), Modifier::Type_Mod7 },
+	{ _T("mod8"), Modifier::Type_Mod8 },
+	{ _T("mod9"), Modifier::Type_Mod9 },
+};
+
+
+/// the prefixes of SettingLoader::loadData()
+static const _TCHAR *s_prefixNames[] = {
+	_T("="), _T("=>"), _T("&&"), _T("||"), _T(":"), _T("$"), _T("&"),
+	_T("-="), _T("+="), _T("!!!"), _T("!!"), _T("!"),
+	_T("E0-"), _T("E1-"),
+	_T("S-"), _T("A-"), _T("M-"), _T("C-"),
+	_T("W-"), _T("*"), _T("~"),
+	_T("U-"), _T("D-"),
+	_T("R-"), _T("IL-"), _T("IC-"), _T("I-"),
+	_T("NL-"), _T("CL-"), _T("SL-"), _T("KL-"),
+	_T("MAX-"), _T("MIN-"), _T("MMAX-"), _T("MMIN-"),
+	_T("T-"), _T("TS-"),
+	_T("M0-"), _T("M1-"), _T("M2-"), _T("M3-"), _T("M4-"),
+	_T("M5-"), _T("M6-"), _T("M7-"), _T("M8-"), _T("M9-"),
+	_T("L0-"), _T("L1-"), _T("L2-"), _T("L3-"), _T("L4-"),
+	_T("L5-"), _T("L6-"), _T("L7-"), _T("L8-"), _T("L9-"),
+};
+
+
+/// the search before KeywordTable: compare i_token with every keyword
+template <class T, size_t N>
+static const T *searchLinear(const typename KeywordTable<T>::Entry
+							 (&i_entries)[N], const Token &i_token)
+{
+	for (size_t i = 0; i < N; ++ i)
+		if (i_token == i_entries[i].m_name)
+			return &i_entries[i].m_value;
+	return NULL;
+}
+
+
+/// a keyword table and its entries
+template <class T, size_t N> class Table
+{
+public:
+	const char *m_name;				///
+	const typename KeywordTable<T>::Entry (&m_entries)[N];	///
+	KeywordTable<T> m_table;			///
+
+public:
+	///
+	Table(const char *i_name,
+		  const typename KeywordTable<T>::Entry (&i_entries)[N])
+		: m_name(i_name), m_entries(i_entries), m_table(i_entries) { }
+
+	/// both searches must find the same entry for i_token
+	bool compare(const Token &i_token, int *io_failures) const {
+		const T *expected = searchLinear<T, N>(m_entries, i_token);
+		const T *found = m_table.search(i_token);
+		if (expected == found)
+			return true;
+		if ((*io_failures) ++ < 10) {
+			tstringstream ss;
+			ss << i_token;
+			printf("%s: `%ls': found %s, expected %s\n", m_name,
+				   ss.str().c_str(), found ? "a keyword" : "none",
+				   expected ? "a keyword" : "none");
+		}
+		return false;
+	}
+
+	/// every keyword in both cases, quoted, cut and with a suffix, and
+	/// the tokens that are not strings
+	int testKeywords() const {
+		int failures = 0;
+		for (size_t i = 0; i < N; ++ i) {
+			tstring name = m_entries[i].m_name, upper = name, lower = name;
+			for (size_t j = 0; j < name.size(); ++ j) {
+				upper[j] = _totupper(name[j]);
+				lower[j] = _totlower(name[j]);
+			}
+			const tstring variants[] = {
+				name, upper, lower, name.substr(0, name.size() - 1),
+				name + _T("x"), name + _T("-"), _T("x") + name,
+				name.substr(1),
+			};
+			for (size_t j = 0; j < NUMBER_OF(variants); ++ j)
+				for (int isQuoted = 0; isQuoted < 2; ++ isQuoted)
+					compare(Token(variants[j].c_str(), !!isQuoted),
+							&failures);
+			// "if" must not be the number 1 nor a regexp
+			compare(Token(1, name.c_str()), &failures);
+			compare(Token(name.c_str(), false, true), &failures);
+			if (!m_table.search(Token(name.c_str(), false))) {
+				printf("%s: `%ls' is not found\n", m_name, name.c_str());
+				++ failures;
+			}
+		}
+		compare(Token(_T(""), false), &failures);
+		compare(Token(Token::Type_openParen), &failures);
+		compare(Token(Token::Type_comma), &failures);
+		return failures;
+	}
+
+	/// random strings of the characters of the keywords, in both cases
+	int testRandom() const {
+		static const _TCHAR chars[] =
+			_T("AaBbCcDdEeFfIiKkLlMmNnOoPpQqRrSsTtUuWwXxYy0129-");
+		int failures = 0;
+		for (int i = 0; i < RANDOM_STRINGS; ++ i) {
+			_TCHAR str[8];
+			size_t length = rand() % (NUMBER_OF(str) - 1);
+			for (size_t j = 0; j < length; ++ j)
+				str[j] = chars[rand() % (NUMBER_OF(chars) - 1)];
+			str[length] = _T('\0');
+			compare(Token(str, false), &failures);
+		}
+		return failures;
+	}
+
+	/// the tokens of the setting files
+	int testTokens(const std::vector<Token> &i_tokens) const {
+		int failures = 0;
+		for (size_t i = 0; i < i_tokens.size(); ++ i)
+			compare(i_tokens[i], &failures);
+		return failures;
+	}
+
+	///
+	int test(const std::vector<Token> &i_tokens) const {
+		int failures = testKeywords() + testRandom() + testTokens(i_tokens);
+		printf("%-12s %2lu keywords: %s\n", m_name,
+			   static_cast<unsigned long>(N), failures ? "FAILED" : "ok");
+		return failures;
+	}
+
+	/// time BENCHMARK_ROUNDS searches of each of i_tokens
+	void benchmark(const std::vector<Token> &i_tokens) const {
+		LARGE_INTEGER begin, end, frequency;
+		QueryPerformanceFrequency(&frequency);
+		size_t found[2] = { 0, 0 };
+		double ns[2];
+		for (int k = 0; k < 2; ++ k) {
+			QueryPerformanceCounter(&begin);
+			for (int round = 0; round < BENCHMARK_ROUNDS; ++ round)
+				for (size_t i = 0; i < i_tokens.size(); ++ i)
+					if (k == 0 ? !!searchLinear<T, N>(m_entries, i_tokens[i])
+						: !!m_table.search(i_tokens[i]))
+						++ found[k];
+			QueryPerformanceCounter(&end);
+			ns[k] = 1e9 * (end.QuadPart - begin.QuadPart) / frequency.QuadPart
+				/ BENCHMARK_ROUNDS / i_tokens.size();
+		}
+		if (found[0] != found[1])
+			printf("the benchmarks disagree\n");
+		printf("%-12s linear %6.1f ns, hashed %6.1f ns\n",
+			   m_name, ns[0], ns[1]);
+	}
+};
+
+
+/// read a setting file.  the bytes are widened one by one, which is enough
+/// for the keywords
+static tstring readFile(const char *i_path)
+{
+	tstring contents;
+	FILE *fp = fopen(i_path, "rb");
+	if (!fp)
+		return contents;
+	int c;
+	while ((c = getc(fp)) != EOF)
+		contents += static_cast<_TCHAR>(static_cast<unsigned char>(c));
+	fclose(fp);
+	return contents;
+}
+
+
+/// the string tokens of the setting files of the tree, as the setting
+/// loader gets them
+static std::vector<Token> readSettingTokens(size_t *o_files)
+{
+	std::vector<tstringi> prefixes;
+	for (size_t i = 0; i < NUMBER_OF(s_prefixNames); ++ i)
+		prefixes.push_back(s_prefixNames[i]);
+	// longest first, as prefixSortPred() of setting.cpp sorts them
+	for (size_t i = 1; i < prefixes.size(); ++ i)
+		for (size_t j = i; 0 < j &&
+				 prefixes[j - 1].size() < prefixes[j].size(); -- j)
+			std::swap(prefixes[j - 1], prefixes[j]);
+
+	static const char *patterns[] = {
+		"../*.mayu", "../contrib/*.mayu", "../ts4mayu/*.mayu", "replay/*.mayu",
+	};
+	std::vector<Token> tokens;
+	*o_files = 0;
+	for (size_t i = 0; i < NUMBER_OF(patterns); ++ i) {
+		glob_t g;
+		if (glob(patterns[i], 0, NULL, &g) != 0)
+			continue;
+		for (size_t j = 0; j < g.gl_pathc; ++ j) {
+			tstring contents = readFile(g.gl_pathv[j]);
+			Parser parser(contents.c_str(), contents.size());
+			parser.setPrefixes(&prefixes);
+			std::vector<Token> line;
+			while (true) {
+				try {
+					if (!parser.getLine(&line))
+						break;
+					for (size_t k = 0; k < line.size(); ++ k)
+						if (line[k].isString())
+							tokens.push_back(line[k]);
+				} catch (ErrorMessage &) {
+					// the Shift_JIS strings widened as Latin-1
+				}
+			}
+			++ *o_files;
+		}
+		globfree(&g);
+	}
+	return tokens;
+}
+
+
+int main()
+{
+	size_t files;
+	std::vector<Token> tokens = readSettingTokens(&files);
+	printf("%lu setting files, %lu string tokens\n",
+		   static_cast<unsigned long>(files),
+		   static_cast<unsigned long>(tokens.size()));
+	int failures = 0;
+	if (tokens.empty()) {
+		printf("no setting files\n");
+		++ failures;
+	}
+
+	srand(1);
+	Table<Statement, NUMBER_OF(s_statements)>
+		statements("load_LINE", s_statements);
+	Table<Modifier::Type, NUMBER_OF(s_modifiers)>
+		modifiers("MODIFIER", s_modifiers);
+	Table<Modifier::Type, NUMBER_OF(s_modifierNames)>
+		modifierNames("mod", s_modifierNames);
+	failures += statements.test(tokens) + modifiers.test(tokens) +
+		modifierNames.test(tokens);
+	if (!tokens.empty()) {
+		statements.benchmark(tokens);
+		modifiers.benchmark(tokens);
+		modifierNames.benchmark(tokens);
+	}
+
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_modifier.cpp - the pressed modifier word against rebuilding the
+// modifiers on every event.  Engine and Keymap do not build on the host, so
+// setPressed() below is Engine::setPressed() over the tables of
+// Keymap::compile()
+
+
+#include "misc.h"
+#include "keyboard.h"
+#include <cstdio>
+#include <cstdlib>
+
+
+enum {
+	ROUNDS = 200,					/// random keymaps
+	EVENTS = 2000,				/// random key events per keymap
+	KEYS_SIZE = 150,				/// keys of a keymap
+	BENCHMARK_EVENTS = 10000000,			/// events of the benchmark
+};
+
+
+/// the modifiers Engine takes from the modifier keys (engine.cpp)
+static const Modifier::MODIFIERS KEY_MODIFIERS =
+	Modifier::getMask(Modifier::Type_Shift) |
+	Modifier::getMask(Modifier::Type_Alt) |
+	Modifier::getMask(Modifier::Type_Control) |
+	Modifier::getMask(Modifier::Type_Windows) |
+	((Modifier::getMask(Modifier::Type_Mod9) << 1) -
+	 Modifier::getMask(Modifier::Type_Mod0));
+
+
+/// Modifier::add() before the masks: one modifier type at a time
+static void addBits(Modifier *io_m, const Modifier &i_m)
+{
+	for (int i = 0; i < Modifier::Type_end; ++ i) {
+		Modifier::Type mt = static_cast<Modifier::Type>(i);
+		if (io_m->isDontcare(mt) && !i_m.isDontcare(mt))
+			io_m->press(mt, i_m.isPressed(mt));
+	}
+}
+
+
+/// a random modifier, mostly dontcare like the ones of a setting
+static Modifier randomModifier()
+{
+	Modifier m;
+	for (int i = 0; i < Modifier::Type_end; ++ i) {
+		Modifier::Type mt = static_cast<Modifier::Type>(i);
+		if (rand() % 4 == 0)
+			m.press(mt, !!(rand() % 2));
+	}
+	return m;
+}
+
+
+/// Modifier::add() and press(MODIFIERS, MODIFIERS) against the bit loops
+static int testModifier()
+{
+	srand(1);
+	int failures = 0;
+	for (int i = 0; i < ROUNDS * 100; ++ i) {
+		Modifier m = randomModifier(), other = randomModifier();
+		Modifier expected = m, added = m;
+		addBits(&expected, other);
+		added.add(other);
+		if (!(expected == added) && failures ++ < 10) {
+			tstringstream ss;
+			ss << m << _T(" + ") << other << _T(": ") << added
+			   << _T(", expected ") << expected;
+			printf("add: %ls\n", ss.str().c_str());
+		}
+
+		Modifier::MODIFIERS pressed =
+			Modifier::MODIFIERS(rand()) << 16 ^ Modifier::MODIFIERS(rand());
+		expected = m;
+		Modifier pressedMask = m;
+		for (int j = 0; j < Modifier::Type_end; ++ j) {
+			Modifier::Type mt = static_cast<Modifier::Type>(j);
+			if (KEY_MODIFIERS & Modifier::getMask(mt))
+				expected.press(mt, !!(pressed & Modifier::getMask(mt)));
+		}
+		pressedMask.press(KEY_MODIFIERS, pressed);
+		if (!(expected == pressedMask) && failures ++ < 10) {
+			tstringstream ss;
+			ss << m << _T(": ") << pressedMask << _T(", expected ") << expected;
+			printf("press: %ls\n", ss.str().c_str());
+		}
+	}
+	return failures;
+}
+
+
+/// the modifier keys of a keymap, stored as Keymap::compile() does
+class ModifierKeys
+{
+public:
+	KeyIdSet m_modifierKeys[Modifier::Type_ASSIGN]; /// keys of each modifier
+	Modifier::MODIFIERS m_masks[KEYS_SIZE];	/// modifiers of each key
+
+public:
+	/// assign each modifier to a few random keys
+	ModifierKeys() {
+		for (int i = 0; i < Modifier::Type_ASSIGN; ++ i)
+			m_modifierKeys[i].reset(KEYS_SIZE);
+		for (int id = 0; id < KEYS_SIZE; ++ id)
+			m_masks[id] = 0;
+		for (int i = 0; i < Modifier::Type_ASSIGN; ++ i) {
+			Modifier::Type mt = static_cast<Modifier::Type>(i);
+			if (!(KEY_MODIFIERS & Modifier::getMask(mt)))
+				continue;
+			for (int n = rand() % 4; 0 < n; -- n) {
+				int id = rand() % KEYS_SIZE;
+				m_modifierKeys[mt].set(id, true);
+				m_masks[id] |= Modifier::getMask(mt);
+			}
+		}
+	}
+
+	/// Keymap::isModifierPressed()
+	bool isModifierPressed(Modifier::Type i_mt,
+						   const KeyIdSet &i_pressedKeys) const {
+		return m_modifierKeys[i_mt].intersects(i_pressedKeys);
+	}
+
+	/// the modifiers of the pressed keys, as Engine got them before
+	Modifier::MODIFIERS rebuild(const KeyIdSet &i_pressedKeys) const {
+		Modifier::MODIFIERS pressed = 0;
+		for (int i = Modifier::Type_begin; i != Modifier::Type_end; ++ i) {
+			Modifier::Type mt = static_cast<Modifier::Type>(i);
+			if ((KEY_MODIFIERS & Modifier::getMask(mt)) &&
+				isModifierPressed(mt, i_pressedKeys))
+				pressed |= Modifier::getMask(mt);
+		}
+		return pressed;
+	}
+};
+
+
+/// Engine::setPressed(): keep the word of the pressed modifiers up to date
+static void setPressed(const ModifierKeys &i_mk, KeyIdSet *io_pressedKeys,
+					   Modifier::MODIFIERS *io_pressedModifiers,
+					   int i_id, bool i_isPressed)
+{
+	bool wasPressed = io_pressedKeys->test(i_id);
+	io_pressedKeys->set(i_id, i_isPressed);
+	if (wasPressed == i_isPressed)
+		return;
+	Modifier::MODIFIERS mask = i_mk.m_masks[i_id] & KEY_MODIFIERS;
+	if (i_isPressed) {
+		*io_pressedModifiers |= mask;
+		return;
+	}
+	// another key of the modifier may still be pressed
+	for (int i = Modifier::Type_begin; mask; ++ i) {
+		Modifier::Type mt = static_cast<Modifier::Type>(i);
+		if (!(mask & Modifier::getMask(mt)))
+			continue;
+		mask &= ~Modifier::getMask(mt);
+		if (!i_mk.isModifierPressed(mt, *io_pressedKeys))
+			*io_pressedModifiers &= ~Modifier::getMask(mt);
+	}
+}
+
+
+/// a random key event, mostly on the modifier keys so that several keys of
+/// a modifier are down at once
+static void randomEvent(const ModifierKeys &i_mk, int *o_id, bool *o_isPressed)
+{
+	do
+		*o_id = rand() % KEYS_SIZE;
+	while (!i_mk.m_masks[*o_id] && rand() % 4);
+	*o_isPressed = !!(rand() % 2);
+}
+
+
+/// random key events: the word must equal the rebuilt modifiers
+static int testPressedModifiers()
+{
+	srand(2);
+	int failures = 0;
+	for (int round = 0; round < ROUNDS; ++ round) {
+		ModifierKeys mk;
+		KeyIdSet pressedKeys;
+		pressedKeys.reset(KEYS_SIZE);
+		Modifier::MODIFIERS pressedModifiers = 0;
+		for (int i = 0; i < EVENTS; ++ i) {
+			int id;
+			bool isPressed;
+			randomEvent(mk, &id, &isPressed);
+			setPressed(mk, &pressedKeys, &pressedModifiers, id, isPressed);
+			Modifier::MODIFIERS expected = mk.rebuild(pressedKeys);
+			if (pressedModifiers != expected && failures ++ < 10)
+				printf("round %d event %d: %s key %d: %llx, expected %llx\n",
+					   round, i, isPressed ? "press" : "release", id,
+					   static_cast<unsigned long long>(pressedModifiers),
+					   static_cast<unsigned long long>(expected));
+		}
+	}
+	return failures;
+}
+
+
+///
+static double elapsed(const LARGE_INTEGER &i_begin)
+{
+	LARGE_INTEGER end, frequency;
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+	return 1e9 * (end.QuadPart - i_begin.QuadPart) / frequency.QuadPart /
+		BENCHMARK_EVENTS;
+}
+
+
+/// time the modifiers of getCurrentModifiers() per key event
+static void benchmark()
+{
+	srand(3);
+	ModifierKeys mk;
+	enum { EVENTS_SIZE = 4096 };
+	static int ids[EVENTS_SIZE];
+	static bool isPressed[EVENTS_SIZE];
+	for (size_t i = 0; i < EVENTS_SIZE; ++ i)
+		randomEvent(mk, &ids[i], &isPressed[i]);
+	Modifier lock = randomModifier();
+	Modifier::MODIFIERS check[2] = { 0, 0 };
+
+	// before: ask every modifier, then add it one bit at a time
+	KeyIdSet pressedKeys;
+	pressedKeys.reset(KEYS_SIZE);
+	LARGE_INTEGER begin;
+	QueryPerformanceCounter(&begin);
+	for (size_t i = 0; i < BENCHMARK_EVENTS; ++ i) {
+		pressedKeys.set(ids[i % EVENTS_SIZE], isPressed[i % EVENTS_SIZE]);
+		Modifier cmods;
+		addBits(&cmods, lock);
+		for (int j = Modifier::Type_begin; j != Modifier::Type_end; ++ j) {
+			Modifier::Type mt = static_cast<Modifier::Type>(j);
+			if (KEY_MODIFIERS & Modifier::getMask(mt))
+				cmods.press(mt, mk.isModifierPressed(mt, pressedKeys));
+		}
+		check[0] += cmods.isPressed(Modifier::Type_Shift);
+	}
+	double rebuilt = elapsed(begin);
+
+	// now: the word kept by setPressed() and two mask operations
+	pressedKeys.reset(KEYS_SIZE);
+	Modifier::MODIFIERS pressedModifiers = 0;
+	QueryPerformanceCounter(&begin);
+	for (size_t i = 0; i < BENCHMARK_EVENTS; ++ i) {
+		setPressed(mk, &pressedKeys, &pressedModifiers, ids[i % EVENTS_SIZE],
+				   isPressed[i % EVENTS_SIZE]);
+		Modifier cmods;
+		cmods.add(lock);
+		cmods.press(KEY_MODIFIERS, pressedModifiers);
+		check[1] += cmods.isPressed(Modifier::Type_Shift);
+	}
+	double kept = elapsed(begin);
+
+	if (check[0] != check[1])
+		printf("the benchmarks disagree\n");
+	printf("modifiers per event: rebuilt %6.1f ns, kept %6.1f ns\n",
+		   rebuilt, kept);
+}
+
+
+int main()
+{
+	int failures = testModifier() + testPressedModifiers();
+	benchmark();
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,377 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_parser.cpp - Parser::getPrefix() against the former linear search,
+// and the tokens of Parser::getLine()
+
+
+#include "misc.h"
+#include "errormessage.h"
+#include "parser.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <glob.h>
+#include <new>
+
+
+enum {
+	RANDOM_STRINGS = 2000000,			/// random prefix searches
+	BENCHMARK_ROUNDS = 200,			/// searches of each token start
+	TOKENIZE_ROUNDS = 200,			/// passes over the setting files
+};
+
+
+static long s_allocations;			/// operator new calls so far
+
+
+///
+void *operator new(size_t i_size)
+{
+	++ s_allocations;
+	if (void *p = malloc(i_size ? i_size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+///
+void operator delete(void *i_p) throw()
+{
+	free(i_p);
+}
+
+
+/// the prefixes of SettingLoader::loadData()
+static const _TCHAR *s_prefixNames[] = {
+	_T("="), _T("=>"), _T("&&"), _T("||"), _T(":"), _T("$"), _T("&"),
+	_T("-="), _T("+="), _T("!!!"), _T("!!"), _T("!"),
+	_T("E0-"), _T("E1-"),
+	_T("S-"), _T("A-"), _T("M-"), _T("C-"),
+	_T("W-"), _T("*"), _T("~"),
+	_T("U-"), _T("D-"),
+	_T("R-"), _T("IL-"), _T("IC-"), _T("I-"),
+	_T("NL-"), _T("CL-"), _T("SL-"), _T("KL-"),
+	_T("MAX-"), _T("MIN-"), _T("MMAX-"), _T("MMIN-"),
+	_T("T-"), _T("TS-"),
+	_T("M0-"), _T("M1-"), _T("M2-"), _T("M3-"), _T("M4-"),
+	_T("M5-"), _T("M6-"), _T("M7-"), _T("M8-"), _T("M9-"),
+	_T("L0-"), _T("L1-"), _T("L2-"), _T("L3-"), _T("L4-"),
+	_T("L5-"), _T("L6-"), _T("L7-"), _T("L8-"), _T("L9-"),
+};
+
+typedef std::vector<tstringi> Prefixes;	///
+static Prefixes s_prefixes;			/// sorted as SettingLoader does
+
+
+/// prefixSortPred() of setting.cpp
+static bool prefixSortPred(const tstringi &i_a, const tstringi &i_b)
+{
+	return i_b.size() < i_a.size();
+}
+
+
+/// the prefix search of Parser::getLine() before the trie
+static const tstringi *getPrefixLinear(const _TCHAR *i_str)
+{
+	for (size_t i = 0; i < s_prefixes.size(); i ++)
+		if (_tcsnicmp(i_str, s_prefixes.at(i).c_str(),
+					  s_prefixes.at(i).size()) == 0)
+			return &s_prefixes.at(i);
+	return NULL;
+}
+
+
+///
+static const _TCHAR *getName(const tstringi *i_prefix)
+{
+	return i_prefix ? i_prefix->c_str() : _T("(none)");
+}
+
+
+/// both searches must find the same prefix of i_str
+static bool compare(const Parser &i_parser, const _TCHAR *i_str,
+					int *io_failures)
+{
+	const tstringi *expected = getPrefixLinear(i_str);
+	const tstringi *found = i_parser.getPrefix(i_str);
+	if (expected == found)
+		return true;
+	if ((*io_failures) ++ < 10)
+		printf("\"%ls\": found %ls, expected %ls\n",
+			   i_str, getName(found), getName(expected));
+	return false;
+}
+
+
+/// random strings of the characters of the prefixes, in both cases
+static int testRandom(const Parser &i_parser)
+{
+	static const _TCHAR chars[] =
+		_T("=>&|:$-+!*~EeSsAaMmCcWwUuDdRrIiLlNnKkXxTt0123456789 ");
+	srand(1);
+	int failures = 0;
+	for (int i = 0; i < RANDOM_STRINGS; ++ i) {
+		_TCHAR str[8];
+		size_t length = rand() % (NUMBER_OF(str) - 1);
+		for (size_t j = 0; j < length; ++ j)
+			str[j] = chars[rand() % (NUMBER_OF(chars) - 1)];
+		str[length] = _T('\0');
+		compare(i_parser, str, &failures);
+	}
+	return failures;
+}
+
+
+/// read a setting file.  the bytes are widened one by one, which is enough
+/// for the prefixes and the ASCII symbols
+static tstring readFile(const char *i_path)
+{
+	tstring contents;
+	FILE *fp = fopen(i_path, "rb");
+	if (!fp)
+		return contents;
+	int c;
+	while ((c = getc(fp)) != EOF)
+		contents += static_cast<_TCHAR>(static_cast<unsigned char>(c));
+	fclose(fp);
+	return contents;
+}
+
+
+/// the setting files of the tree
+static std::vector<tstring> readSettingFiles()
+{
+	static const char *patterns[] = {
+		"../*.mayu", "../contrib/*.mayu", "../ts4mayu/*.mayu", "replay/*.mayu",
+	};
+	std::vector<tstring> files;
+	for (size_t i = 0; i < NUMBER_OF(patterns); ++ i) {
+		glob_t g;
+		if (glob(patterns[i], 0, NULL, &g) != 0)
+			continue;
+		for (size_t j = 0; j < g.gl_pathc; ++ j)
+			files.push_back(readFile(g.gl_pathv[j]));
+		globfree(&g);
+	}
+	return files;
+}
+
+
+/** the strings getLine() searches for a prefix in i_file: each word,
+    and the rest of the word after a prefix */
+static void getTokenStarts(const tstring &i_file,
+						   std::vector<tstring> *o_starts)
+{
+	size_t i = 0;
+	while (i < i_file.size()) {
+		size_t eol = i_file.find_first_of(_T("\r\n"), i);
+		if (eol == tstring::npos)
+			eol = i_file.size();
+		tstring line = i_file.substr(i, eol - i);
+		i = eol + 1;
+		line = line.substr(0, line.find(_T('#')));
+		for (size_t j = 0; j < line.size(); ) {
+			if (_istspace(line[j]) || line[j] == _T('(') ||
+				line[j] == _T(')') || line[j] == _T(',')) {
+				++ j;
+				continue;
+			}
+			size_t end = line.find_first_of(_T(" \t(),"), j);
+			if (end == tstring::npos)
+				end = line.size();
+			tstring word = line.substr(j, end - j);
+			j = end;
+			for (size_t k = 0; k < word.size(); ) {
+				o_starts->push_back(word.substr(k));
+				const tstringi *prefix = getPrefixLinear(word.c_str() + k);
+				if (!prefix)
+					break;
+				k += prefix->size();
+			}
+		}
+	}
+}
+
+
+/// one line per token: line number, type and value.  characters beyond
+/// ASCII are written as \xNN
+static std::string dumpTokens(const tstring &i_contents)
+{
+	std::string dump;
+	Parser parser(i_contents.c_str(), i_contents.size());
+	parser.setPrefixes(&s_prefixes);
+	std::vector<Token> tokens;
+	while (true) {
+		tstring line;
+		try {
+			if (!parser.getLine(&tokens))
+				break;
+			for (size_t i = 0; i < tokens.size(); ++ i) {
+				const Token &t = tokens[i];
+				static const _TCHAR *types[] = {
+					_T("string"), _T("number"), _T("regexp"), _T("("),
+					_T(")"), _T(","),
+				};
+				tstringstream ss;
+				ss << _T(" ") << types[t.getType()];
+				if (t.isQuoted())
+					ss << _T(" quoted");
+				if (t.isNumber())
+					ss << _T(" ") << t.getNumber();
+				if (t.isString() || t.isNumber() || t.isRegexp())
+					ss << _T(" [") << t.getRawString() << _T("]");
+				line += ss.str();
+			}
+		} catch (ErrorMessage &e) {
+			line = _T(" error: ") + e.getMessage();
+		}
+		char number[16];
+		snprintf(number, sizeof(number), "%lu:",
+				 static_cast<unsigned long>(parser.getLineNumber()));
+		dump += number;
+		for (size_t i = 0; i < line.size(); ++ i)
+			if (0x20 <= line[i] && line[i] < 0x7f)
+				dump += static_cast<char>(line[i]);
+			else {
+				char hex[16];
+				snprintf(hex, sizeof(hex), "\\x%02x",
+						 static_cast<unsigned>(line[i]));
+				dump += hex;
+			}
+		dump += '\n';
+	}
+	return dump;
+}
+
+
+/// tokens.mayu must give the tokens of tokens.out
+static int testTokens()
+{
+	std::string dump = dumpTokens(readFile("parser/tokens.mayu"));
+	std::string expected;
+	if (FILE *fp = fopen("parser/tokens.out", "rb")) {
+		int c;
+		while ((c = getc(fp)) != EOF)
+			expected += static_cast<char>(c);
+		fclose(fp);
+	}
+	if (!dump.empty() && dump == expected)
+		return 0;
+	printf("parser/tokens.mayu: the tokens differ from parser/tokens.out\n");
+	for (size_t i = 0; i < dump.size() && i < expected.size(); ++ i)
+		if (dump[i] != expected[i]) {
+			size_t line = dump.rfind('\n', i) + 1;	// 0 if none
+			printf("  got:      %s\n",
+				   dump.substr(line, dump.find('\n', line) - line).c_str());
+			break;
+		}
+	return 1;
+}
+
+
+/// time the tokenizing of 109.mayu and emacsedit.mayu, and count the
+/// allocations it makes
+static void benchmarkTokenize()
+{
+	tstring files[] = {
+		readFile("../109.mayu"), readFile("../emacsedit.mayu"),
+	};
+	std::vector<Token> tokens;
+	size_t tokensSize = 0;
+	long allocations = s_allocations;
+	LARGE_INTEGER begin, end, frequency;
+	QueryPerformanceCounter(&begin);
+	for (int round = 0; round < TOKENIZE_ROUNDS; ++ round)
+		for (size_t i = 0; i < NUMBER_OF(files); ++ i) {
+			Parser parser(files[i].c_str(), files[i].size());
+			parser.setPrefixes(&s_prefixes);
+			while (true) {
+				try {
+					if (!parser.getLine(&tokens))
+						break;
+					tokensSize += tokens.size();
+				} catch (ErrorMessage &) {
+					// the Shift_JIS strings widened as Latin-1
+				}
+			}
+		}
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+	printf("109.mayu + emacsedit.mayu: %lu tokens, %ld allocations, "
+		   "%.0f us per pass\n",
+		   static_cast<unsigned long>(tokensSize / TOKENIZE_ROUNDS),
+		   (s_allocations - allocations) / TOKENIZE_ROUNDS,
+		   1e6 * (end.QuadPart - begin.QuadPart) / frequency.QuadPart /
+		   TOKENIZE_ROUNDS);
+}
+
+
+/// time BENCHMARK_ROUNDS searches of each of i_starts
+template <class F>
+static double measure(const std::vector<tstring> &i_starts, F i_search)
+{
+	LARGE_INTEGER begin, end, frequency;
+	size_t found = 0;
+	QueryPerformanceCounter(&begin);
+	for (int round = 0; round < BENCHMARK_ROUNDS; ++ round)
+		for (size_t i = 0; i < i_starts.size(); ++ i)
+			if (i_search(i_starts[i].c_str()))
+				++ found;
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+	if (found == 0)
+		printf("nothing found\n");
+	return 1e9 * (end.QuadPart - begin.QuadPart) / frequency.QuadPart /
+		BENCHMARK_ROUNDS / i_starts.size();
+}
+
+
+static const Parser *s_parser;			///
+
+///
+static bool searchTrie(const _TCHAR *i_str)
+{
+	return !!s_parser->getPrefix(i_str);
+}
+
+///
+static bool searchLinear(const _TCHAR *i_str)
+{
+	return !!getPrefixLinear(i_str);
+}
+
+
+int main()
+{
+	for (size_t i = 0; i < NUMBER_OF(s_prefixNames); ++ i)
+		s_prefixes.push_back(s_prefixNames[i]);
+	std::sort(s_prefixes.begin(), s_prefixes.end(), prefixSortPred);
+	Parser parser(_T(""), 0);
+	parser.setPrefixes(&s_prefixes);
+	s_parser = &parser;
+
+	int failures = testRandom(parser) + testTokens();
+
+	std::vector<tstring> files = readSettingFiles();
+	std::vector<tstring> starts;
+	for (size_t i = 0; i < files.size(); ++ i)
+		getTokenStarts(files[i], &starts);
+	size_t prefixed = 0;
+	for (size_t i = 0; i < starts.size(); ++ i) {
+		compare(parser, starts[i].c_str(), &failures);
+		if (getPrefixLinear(starts[i].c_str()))
+			++ prefixed;
+	}
+	printf("%lu setting files, %lu token starts, %lu with a prefix\n",
+		   static_cast<unsigned long>(files.size()),
+		   static_cast<unsigned long>(starts.size()),
+		   static_cast<unsigned long>(prefixed));
+	if (starts.empty()) {
+		printf("no setting files\n");
+		++ failures;
+	} else
+		printf("getPrefix: linear %6.1f ns, trie %6.1f ns\n",
+			   measure(starts, searchLinear), measure(starts, searchTrie));
+	benchmarkTokenize();
+
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
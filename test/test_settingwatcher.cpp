@@ -0,0 +1,195 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_settingwatcher.cpp - SettingWatcher on real file writes (inotify)
+
+
+#include "misc.h"
+#include "settingwatcher.h"
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+
+enum {
+	SETTLE_TIME = 200,				/// ms
+	WM_APP_settingChanged = 0x8000 + 122,	/// as in mayu.cpp
+};
+
+
+static volatile LONG s_posted;			/// messages posted so far
+static volatile LONG s_postedTime;		/// GetTickCount() of the last
+
+
+/// what the task tray window gets
+BOOL PostMessage(HWND, UINT i_message, WPARAM, LPARAM)
+{
+	if (i_message == WM_APP_settingChanged) {
+		InterlockedExchange(&s_postedTime, static_cast<LONG>(GetTickCount()));
+		InterlockedIncrement(&s_posted);
+	}
+	return TRUE;
+}
+
+
+static std::string s_directory;			/// a temporary directory
+
+
+///
+static std::string getPath(const char *i_name)
+{
+	return s_directory + "/" + i_name;
+}
+
+
+///
+static tstringi toTstringi(const std::string &i_str)
+{
+	return tstringi(std::wstring(i_str.begin(), i_str.end()).c_str());
+}
+
+
+/// write the whole file at once, as a small setting file is written
+static void writeFile(const char *i_name, const char *i_contents)
+{
+	FILE *fp = fopen(getPath(i_name).c_str(), "w");
+	fputs(i_contents, fp);
+	fclose(fp);
+}
+
+
+/// count the messages of a test case
+class Case
+{
+	const char *m_name;				///
+	LONG m_posted;				/// s_posted at the beginning
+	int *m_failures;				///
+
+public:
+	///
+	Case(const char *i_name, int *io_failures)
+		: m_name(i_name), m_posted(s_posted), m_failures(io_failures) { }
+
+	/// wait for the changes to settle and check the number of messages
+	void check(LONG i_expected, DWORD i_lastChange = 0) {
+		Sleep(SETTLE_TIME * 3);
+		LONG posted = s_posted - m_posted;
+		bool isOk = posted == i_expected;
+		// the message must wait for the settle time after the last change
+		DWORD wait = static_cast<DWORD>(s_postedTime) - i_lastChange;
+		if (i_lastChange && posted && wait < SETTLE_TIME - 20)
+			isOk = false;
+		printf("%-36s %ld message(s)", m_name, static_cast<long>(posted));
+		if (i_lastChange && posted)
+			printf(", %3lu ms after the last change",
+				   static_cast<unsigned long>(wait));
+		printf("%s\n", isOk ? "" : ", FAILED");
+		if (!isOk)
+			++ *m_failures;
+		m_posted = s_posted;
+	}
+};
+
+
+int main()
+{
+	char directory[] = "/tmp/test_settingwatcher.XXXXXX";
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	s_directory = directory;
+	mkdir(getPath("home").c_str(), 0700);
+	writeFile("dot.mayu", "include \"109.mayu\"\n");
+	writeFile("home/109.mayu", "def key A = 0x1e\n");
+
+	// the dot file by its path, an included file in the home directories
+	std::list<tstringi> paths, names, directories;
+	paths.push_back(toTstringi(getPath("dot.mayu")));
+	names.push_back(_T("109.mayu"));
+	directories.push_back(toTstringi(s_directory));
+	directories.push_back(toTstringi(getPath("home")));
+	directories.push_back(toTstringi(getPath("no-such-directory")));
+
+	int failures = 0;
+	SettingWatcher watcher;
+	watcher.init(NULL, WM_APP_settingChanged, SETTLE_TIME);
+	watcher.watch(paths, names, directories);
+	Sleep(50);
+
+	{
+		Case c("a write", &failures);
+		writeFile("dot.mayu", "include \"109.mayu\"\n# changed\n");
+		c.check(1, GetTickCount());
+	}
+	{
+		// more changes than a settle time apart would notify twice
+		Case c("10 writes 50 ms apart", &failures);
+		for (int i = 0; i < 10; ++ i) {
+			writeFile("home/109.mayu", "def key A = 0x1e\n");
+			Sleep(50);
+		}
+		c.check(1, GetTickCount() - 50);
+	}
+	{
+		Case c("two files at once", &failures);
+		writeFile("dot.mayu", "include \"109.mayu\"\n");
+		writeFile("home/109.mayu", "def key A = 0x1e\n# changed\n");
+		c.check(1, GetTickCount());
+	}
+	{
+		Case c("save by rename", &failures);
+		writeFile("home/109.mayu.tmp", "def key A = 0x1e\n");
+		rename(getPath("home/109.mayu.tmp").c_str(),
+			   getPath("home/109.mayu").c_str());
+		c.check(1, GetTickCount());
+	}
+	{
+		Case c("a file that shadows an include", &failures);
+		writeFile("109.mayu", "def key A = 0x1e\n");
+		c.check(1, GetTickCount());
+	}
+	{
+		Case c("delete", &failures);
+		remove(getPath("109.mayu").c_str());
+		c.check(1, GetTickCount());
+	}
+	{
+		Case c("other files", &failures);
+		writeFile("other.mayu", "\n");
+		writeFile("home/dot.mayu", "\n");
+		remove(getPath("other.mayu").c_str());
+		remove(getPath("home/dot.mayu").c_str());
+		c.check(0);
+	}
+	{
+		// stop() drops a change that has not settled
+		Case c("a write, then stop", &failures);
+		writeFile("dot.mayu", "include \"109.mayu\"\n");
+		Sleep(SETTLE_TIME / 4);
+		watcher.stop();
+		writeFile("dot.mayu", "include \"109.mayu\"\n");
+		c.check(0);
+	}
+	{
+		// the reload watches the files of the new setting
+		Case c("a new include after a reload", &failures);
+		writeFile("home/104.mayu", "def key A = 0x1e\n");
+		names.push_back(_T("104.mayu"));
+		watcher.watch(paths, names, directories);
+		Sleep(50);
+		writeFile("home/104.mayu", "def key A = 0x1e\n# changed\n");
+		c.check(1, GetTickCount());
+	}
+	{
+		Case c("a removed directory", &failures);
+		remove(getPath("home/104.mayu").c_str());
+		remove(getPath("home/109.mayu").c_str());
+		rmdir(getPath("home").c_str());
+		c.check(1, GetTickCount());
+	}
+	watcher.stop();
+
+	remove(getPath("dot.mayu").c_str());
+	rmdir(directory);
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
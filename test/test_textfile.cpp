@@ -0,0 +1,372 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_textfile.cpp - decodeText() against a strict one character at a time
+// UTF-8 decoder, and the throughput of readFile() on large synthetic
+// settings
+
+
+#include "misc.h"
+#include "textfile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+
+enum {
+	RANDOM_INPUTS = 200000,			/// random byte strings
+	BENCHMARK_SIZE = 32 << 20,			/// bytes of a synthetic setting
+	BENCHMARK_ROUNDS = 5,				/// reads of each setting
+};
+
+
+typedef std::basic_string<BYTE> Bytes;		///
+
+
+/// append the UTF-8 of i_c (which may be a surrogate, to make invalid input)
+static void encodeUtf8(Bytes *io_bytes, u_int32 i_c)
+{
+	if (i_c < 0x80)
+		*io_bytes += static_cast<BYTE>(i_c);
+	else if (i_c < 0x800) {
+		*io_bytes += static_cast<BYTE>(0xc0 | (i_c >> 6));
+		*io_bytes += static_cast<BYTE>(0x80 | (i_c & 0x3f));
+	} else if (i_c < 0x10000) {
+		*io_bytes += static_cast<BYTE>(0xe0 | (i_c >> 12));
+		*io_bytes += static_cast<BYTE>(0x80 | ((i_c >> 6) & 0x3f));
+		*io_bytes += static_cast<BYTE>(0x80 | (i_c & 0x3f));
+	} else {
+		*io_bytes += static_cast<BYTE>(0xf0 | (i_c >> 18));
+		*io_bytes += static_cast<BYTE>(0x80 | ((i_c >> 12) & 0x3f));
+		*io_bytes += static_cast<BYTE>(0x80 | ((i_c >> 6) & 0x3f));
+		*io_bytes += static_cast<BYTE>(0x80 | (i_c & 0x3f));
+	}
+}
+
+
+/// append i_c to a wide string, as a surrogate pair if wchar_t is 16 bits
+static void appendCodePoint(tstring *io_text, u_int32 i_c)
+{
+	if (0x10000 <= i_c && sizeof(wchar_t) == 2) {
+		i_c -= 0x10000;
+		*io_text += static_cast<wchar_t>(0xd800 | (i_c >> 10));
+		*io_text += static_cast<wchar_t>(0xdc00 | (i_c & 0x3ff));
+	} else
+		*io_text += static_cast<wchar_t>(i_c);
+}
+
+
+/// decode strict UTF-8 after an optional BOM, one character at a time
+/// (false if i_bytes is not UTF-8)
+static bool decodeUtf8Reference(tstring *o_text, const Bytes &i_bytes)
+{
+	o_text->clear();
+	size_t i = 0, size = i_bytes.size();
+	if (3 <= size &&
+		i_bytes[0] == 0xef && i_bytes[1] == 0xbb && i_bytes[2] == 0xbf)
+		i = 3;
+	while (i < size) {
+		u_int32 c = i_bytes[i];
+		size_t length;
+		u_int32 min;
+		if (c < 0x80)
+			length = 1, min = 0;
+		else if (0xc2 <= c && c <= 0xdf)
+			length = 2, min = 0x80, c &= 0x1f;
+		else if (0xe0 <= c && c <= 0xef)
+			length = 3, min = 0x800, c &= 0x0f;
+		else if (0xf0 <= c && c <= 0xf4)
+			length = 4, min = 0x10000, c &= 0x07;
+		else
+			return false;
+		if (size - i < length)
+			return false;
+		for (size_t j = 1; j < length; ++ j) {
+			if (i_bytes[i + j] < 0x80 || 0xbf < i_bytes[i + j])
+				return false;
+			c = (c << 6) | (i_bytes[i + j] & 0x3f);
+		}
+		if (c < min || (0xd800 <= c && c <= 0xdfff) || 0x10ffff < c)
+			return false;
+		appendCodePoint(o_text, c);
+		i += length;
+	}
+	return true;
+}
+
+
+/// what decodeText() must give: UTF-16 after its BOM, UTF-8, or else one
+/// character per byte (the host MultiByteToWideChar() is Latin-1)
+static tstring expectedText(const Bytes &i_bytes)
+{
+	tstring text;
+	size_t size = i_bytes.size();
+	if (2 <= size && size % 2 == 0 &&
+		((i_bytes[0] == 0xff && i_bytes[1] == 0xfe) ||
+		 (i_bytes[0] == 0xfe && i_bytes[1] == 0xff))) {
+		int high = i_bytes[0] == 0xfe ? 0 : 1;
+		for (size_t i = 2; i < size; i += 2)
+			text += static_cast<wchar_t>((i_bytes[i + high] << 8) |
+										 i_bytes[i + 1 - high]);
+		return text;
+	}
+	if (decodeUtf8Reference(&text, i_bytes))
+		return text;
+	text.clear();
+	for (size_t i = 0; i < size; ++ i)
+		text += static_cast<wchar_t>(i_bytes[i]);
+	return text;
+}
+
+
+///
+static tstring decode(const Bytes &i_bytes)
+{
+	tstring text;
+	decodeText(&text, i_bytes.data(), i_bytes.size());
+	return text;
+}
+
+
+/// decodeText() must give expectedText()
+static bool check(const char *i_name, const Bytes &i_bytes, int *io_failures)
+{
+	tstring text = decode(i_bytes);
+	if (text == expectedText(i_bytes))
+		return true;
+	if ((*io_failures) ++ < 10) {
+		printf("%s:", i_name);
+		for (size_t i = 0; i < i_bytes.size() && i < 32; ++ i)
+			printf(" %02x", i_bytes[i]);
+		printf("%s\n", 32 < i_bytes.size() ? " ..." : "");
+	}
+	return false;
+}
+
+
+///
+static Bytes toBytes(const char *i_str)
+{
+	return Bytes(reinterpret_cast<const BYTE *>(i_str), strlen(i_str));
+}
+
+
+/// i_bytes must decode to i_expected
+static void checkText(const char *i_name, const Bytes &i_bytes,
+					  const tstring &i_expected, int *io_failures)
+{
+	if (decode(i_bytes) == i_expected &&
+		expectedText(i_bytes) == i_expected)
+		return;
+	if ((*io_failures) ++ < 10)
+		printf("%s: wrong text\n", i_name);
+}
+
+
+/// the encodings, the BOMs and the ill-formed sequences
+static int testCases()
+{
+	int failures = 0;
+	// each of these is not UTF-8, so it is taken one byte at a time
+	static const char *illFormed[] = {
+		"\xc0\x80",			// overlong NUL
+		"\xc1\xbf",			// overlong U+007F
+		"\xe0\x80\x80",			// overlong 3 bytes
+		"\xe0\x9f\xbf",			// overlong U+07FF
+		"\xf0\x80\x80\x80",		// overlong 4 bytes
+		"\xf0\x8f\xbf\xbf",		// overlong U+FFFF
+		"\xed\xa0\x80",			// U+D800
+		"\xed\xbf\xbf",			// U+DFFF
+		"\xed\xa0\xbd\xed\xb8\x80",	// a surrogate pair in CESU-8
+		"\xf4\x90\x80\x80",		// U+110000
+		"\xf5\x80\x80\x80",		//
+		"\xf8\x88\x80\x80\x80",		// 5 bytes
+		"\xfc\x84\x80\x80\x80\x80",	// 6 bytes
+		"\x80",				// a continuation byte alone
+		"a\xbf",			//
+		"\xe3\x81",			// cut at the end
+		"\xe3\x81" "a",			// cut by ASCII
+		"\xf0\x9f\x98",			//
+		"\xfe",				//
+		"\xff",				//
+		"key A = B # \x82\xa0",		// Shift_JIS
+		"# caf\xe9\n",			// Latin-1
+	};
+	for (size_t i = 0; i < NUMBER_OF(illFormed); ++ i) {
+		Bytes bytes = toBytes(illFormed[i]);
+		tstring latin1;
+		for (size_t j = 0; j < bytes.size(); ++ j)
+			latin1 += static_cast<wchar_t>(bytes[j]);
+		checkText("ill-formed", bytes, latin1, &failures);
+	}
+
+	tstring text;
+	checkText("empty", Bytes(), text, &failures);
+	checkText("UTF-8 BOM only", toBytes("\xef\xbb\xbf"), text, &failures);
+
+	text = _T("key A = B");
+	checkText("ASCII", toBytes("key A = B"), text, &failures);
+	checkText("UTF-8 BOM", toBytes("\xef\xbb\xbfkey A = B"), text, &failures);
+
+	text = _T("#");
+	appendCodePoint(&text, 0xe9);
+	appendCodePoint(&text, 0x3042);
+	appendCodePoint(&text, 0xffff);
+	appendCodePoint(&text, 0x1f600);
+	appendCodePoint(&text, 0x10ffff);
+	checkText("UTF-8 2, 3 and 4 bytes",
+			  toBytes("#\xc3\xa9\xe3\x81\x82\xef\xbf\xbf\xf0\x9f\x98\x80"
+					  "\xf4\x8f\xbf\xbf"), text, &failures);
+
+	// UTF-16 is taken as it is, with its surrogate pairs
+	static const BYTE le[] = { 0xff, 0xfe, 'a', 0, 0x3d, 0xd8, 0x00, 0xde };
+	static const BYTE be[] = { 0xfe, 0xff, 0, 'a', 0x30, 0x42 };
+	text = _T("a");
+	text += static_cast<wchar_t>(0xd83d);
+	text += static_cast<wchar_t>(0xde00);
+	checkText("UTF-16 LE", Bytes(le, sizeof(le)), text, &failures);
+	text = _T("a");
+	text += static_cast<wchar_t>(0x3042);
+	checkText("UTF-16 BE", Bytes(be, sizeof(be)), text, &failures);
+	// an odd size is not UTF-16
+	text = _T("");
+	text += static_cast<wchar_t>(0xff);
+	text += static_cast<wchar_t>(0xfe);
+	text += _T('a');
+	checkText("UTF-16 BOM, odd size", toBytes("\xff\xfe" "a"), text,
+			  &failures);
+
+	// a non-ASCII character at each place of the 16 byte blocks
+	for (size_t i = 0; i < 48; ++ i)
+		for (int j = 0; j < 2; ++ j) {
+			Bytes bytes(i, 'x');
+			bytes += toBytes(j ? "\xe3\x81\x82" : "\xe3\x81");
+			bytes += Bytes(40, 'y');
+			check("around a block", bytes, &failures);
+		}
+	return failures;
+}
+
+
+/// random bytes, random well-formed UTF-8 and UTF-8 with a few bits flipped
+static int testRandom()
+{
+	srand(1);
+	int failures = 0;
+	int valid = 0;
+	for (int i = 0; i < RANDOM_INPUTS; ++ i) {
+		Bytes bytes;
+		if (rand() % 10 == 0)
+			bytes = toBytes("\xef\xbb\xbf");
+		int length = rand() % 80;
+		int mode = rand() % 3;
+		for (int j = 0; j < length; ++ j) {
+			if (mode == 0) {
+				bytes += static_cast<BYTE>(rand() % 256);
+				continue;
+			}
+			int r = rand() % 10;
+			u_int32 c =
+				r < 6 ? rand() % 0x80 :
+				r < 7 ? 0x80 + rand() % 0x780 :
+				r < 8 ? 0x800 + rand() % 0xf800 :
+				r < 9 ? 0x10000 + rand() % 0x100000 : rand() % 0x110000;
+			encodeUtf8(&bytes, c);
+			if (mode == 2 && rand() % 40 == 0)
+				bytes[rand() % bytes.size()] ^= 1 << (rand() % 8);
+		}
+		tstring text;
+		if (decodeUtf8Reference(&text, bytes))
+			++ valid;
+		check("random", bytes, &failures);
+	}
+	printf("%d random inputs, %d of them UTF-8: %s\n",
+		   RANDOM_INPUTS, valid, failures ? "FAILED" : "ok");
+	return failures;
+}
+
+
+/// a synthetic setting of about BENCHMARK_SIZE bytes made of i_line
+static Bytes makeSetting(const char *i_line)
+{
+	Bytes line = toBytes(i_line), setting;
+	setting.reserve(BENCHMARK_SIZE + line.size());
+	while (setting.size() < BENCHMARK_SIZE)
+		setting += line;
+	return setting;
+}
+
+
+///
+static double getTime()
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return static_cast<double>(counter.QuadPart) / frequency.QuadPart;
+}
+
+
+/** MB/s of readFile() and of decodeText() on the setting in memory, and of
+    the one character at a time decoder for comparison */
+static int benchmark(const char *i_name, const Bytes &i_setting)
+{
+	char path[] = "/tmp/test_textfile.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	bool isWritten = write(fd, i_setting.data(), i_setting.size()) ==
+		static_cast<ssize_t>(i_setting.size());
+	close(fd);
+	std::wstring wpath(path, path + strlen(path));
+	tstringi filename(wpath.c_str());
+	const double mb = i_setting.size() / 1e6 * BENCHMARK_ROUNDS;
+
+	int failures = 0;
+	tstring text, expected;
+	decodeUtf8Reference(&expected, i_setting);
+	double begin = getTime();
+	for (int i = 0; i < BENCHMARK_ROUNDS; ++ i)
+		if (!isWritten || !readFile(&text, filename))
+			++ failures;
+	double read = mb / (getTime() - begin);
+	if (text != expected)
+		++ failures;
+
+	begin = getTime();
+	for (int i = 0; i < BENCHMARK_ROUNDS; ++ i)
+		decodeText(&text, i_setting.data(), i_setting.size());
+	double decoded = mb / (getTime() - begin);
+	if (text != expected)
+		++ failures;
+
+	begin = getTime();
+	for (int i = 0; i < BENCHMARK_ROUNDS; ++ i)
+		decodeUtf8Reference(&text, i_setting);
+	double reference = mb / (getTime() - begin);
+
+	unlink(path);
+	printf("%-6s %lu MB: readFile %5.0f MB/s, decodeText %5.0f MB/s, "
+		   "one at a time %5.0f MB/s%s\n",
+		   i_name, static_cast<unsigned long>(i_setting.size() >> 20),
+		   read, decoded, reference, failures ? ", FAILED" : "");
+	return failures;
+}
+
+
+int main()
+{
+	int failures = testCases();
+	printf("ill-formed sequences, BOMs and block boundaries: %s\n",
+		   failures ? "FAILED" : "ok");
+	failures += testRandom();
+	failures += benchmark(
+		"ASCII", makeSetting("key C-x C-f = &ShellExecute(\"open\", "
+							 "\"notepad\", \"\", \"\", ShowNormal)\n"));
+	failures += benchmark(
+		"UTF-8", makeSetting("key C-x C-f = &ShellExecute(\"open\", "
+							 "\"notepad\", \"\", \"\", ShowNormal) "
+							 "# \xe3\x83\xa1\xe3\x83\xa2\xe5\xb8\xb3\n"));
+	printf("%s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
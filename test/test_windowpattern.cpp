@@ -0,0 +1,321 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// test_windowpattern.cpp - WindowPattern::match() against boost::regex_search
+// and the indexed Keymaps::searchWindow() against a scan of all keymaps
+
+
+#include "misc.h"
+#include "keymap.h"
+#include "setting.h"
+#include "errormessage.h"
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+
+enum {
+	RANDOM_PATTERNS = 20000,		/// random patterns of testRandom()
+	ROUNDS = 50,					/// random keymaps of testSearchWindow()
+	QUERIES = 2000,				/// random windows per keymaps
+	KEYMAPS = 500,				/// window keymaps of the benchmark
+	LOOKUPS = 200000,				/// searches of the benchmark
+};
+
+
+// the modules of the setting are not built on the host
+namespace Event
+{
+Key *events[] = { NULL };
+}
+tostream &operator<<(tostream &i_ost, const FunctionData *)
+{
+	return i_ost;
+}
+
+
+/// the patterns of a setting: literals, anchors, escapes and regexps
+static const _TCHAR *s_patterns[] = {
+	_T(".*"), _T(""), _T("^"), _T("$"), _T("^$"),
+	_T("Edit"), _T("^Edit"), _T("Edit$"), _T("^Edit$"), _T(":Edit$"),
+	_T("^Emacs:"), _T("edit"), _T("EDIT"), _T("^eDiT$"),
+	_T("\\.exe$"), _T("^notepad\\.exe:"), _T("a\\+b"), _T("\\(x\\)"),
+	_T("\\[1\\]"), _T("\\{"), _T("\\}"), _T("\\*"), _T("\\?"), _T("\\|"),
+	_T("\\^"), _T("\\$"), _T("\\$$"), _T("^\\^"), _T("\\\\"), _T("\\/"),
+	_T("\\-"), _T("\\:"), _T("\\#"), _T("\\,"), _T("\\ "),
+	_T("a b"), _T("#32770"), _T("Internet Explorer_Server"),
+	_T("a.b"), _T("^a.*b$"), _T("x|y"), _T("^(x|y)$"), _T("(ab)+"),
+	_T("[a-c]x"), _T("[^a]"), _T("\\d+$"), _T("\\w:\\s"), _T("ab?c"),
+	_T("^$|^x$"), _T("a$b"), _T("a^b"), _T("^^a"), _T("a$$"),
+	_T("\\bEdit\\b"), _T("(?:Edit)"), _T("Ed{1}it"), _T("\\x41"),
+	_T("\x00e9"), _T("^\x00e9t\x00e9$"), _T("\x00c9T\x00c9"), _T("\x65e5\x672c"),
+	_T("^\x65e5"), _T("a\x00e9$"),
+};
+
+
+/// the names of windows: cases, non-ASCII characters and line breaks
+static const _TCHAR *s_names[] = {
+	_T(""), _T("Edit"), _T("edit"), _T("EDIT"), _T("xEditx"),
+	_T("Emacs:Edit"), _T("notepad.exe:Edit"), _T("NOTEPAD.EXE"),
+	_T("notepadxexe:Edit"), _T("a+b"), _T("aab"), _T("(x)"), _T("[1]"),
+	_T("{}"), _T("*?|"), _T("^$"), _T("$"), _T("^"), _T("\\"), _T("/"),
+	_T("-:#, "), _T("a b"), _T("#32770"), _T("Internet Explorer_Server"),
+	_T("axb"), _T("y"), _T("abab"), _T("bx"), _T("123"), _T("a: "),
+	_T("ac"), _T("abc"), _T("a$b"), _T("a^b"),
+	_T("\x00e9"), _T("\x00c9"), _T("\x00e9t\x00e9"), _T("\x00c9T\x00c9"),
+	_T("\x65e5\x672c"), _T("a\x00e9"), _T("A\x00c9"),
+	_T("Edit\nx"), _T("x\nEdit"), _T("x\nEdit\ny"), _T("\n"), _T("\r\n"),
+	_T("Edit\r"), _T("\rEdit"), _T("Edit\f"), _T("\vEdit"),
+	_T("Edit\x0085"), _T("\x2028") _T("Edit"), _T("Edit\x2029"),
+	_T("x\n"), _T("\nx"), _T("a\nb"), _T("\x00e9\n"),
+};
+
+
+/// the result of boost::regex_search as the former keymaps got it
+static bool regexSearch(const tregex &i_regex, const tstringi &i_name)
+{
+	tsmatch what;
+	return boost::regex_search(i_name, what, i_regex);
+}
+
+
+/// does i_wp match i_name like i_regex ?
+static bool check(const WindowPattern &i_wp, const tregex &i_regex,
+				  const tstring &i_name)
+{
+	tstringi name(i_name.c_str());
+	bool expected = regexSearch(i_regex, name);
+	bool found = i_wp.match(name, WindowPattern::toLowerAscii(i_name));
+	if (found == expected)
+		return true;
+	printf("/%ls/ =~ \"%ls\": %d, expected %d\n",
+		   i_wp.str().c_str(), i_name.c_str(), found, expected);
+	return false;
+}
+
+
+/// all of s_patterns against all of s_names
+static int testPatterns()
+{
+	int failures = 0;
+	for (size_t p = 0; p < NUMBER_OF(s_patterns); ++ p) {
+		WindowPattern wp;
+		wp.assign(s_patterns[p]);
+		tregex regex(s_patterns[p], tregex::normal | tregex::icase);
+		for (size_t n = 0; n < NUMBER_OF(s_names); ++ n)
+			if (!check(wp, regex, s_names[n]))
+				++ failures;
+	}
+	return failures;
+}
+
+
+/// a random string of i_chars
+static tstring randomString(const _TCHAR *i_chars, size_t i_maxSize)
+{
+	tstring str;
+	size_t size = rand() % (i_maxSize + 1);
+	size_t n = _tcslen(i_chars);
+	for (size_t i = 0; i < size; ++ i)
+		str += i_chars[rand() % n];
+	return str;
+}
+
+
+/** random patterns.  a pattern tregex compiles must match like tregex, and
+    a pattern tregex rejects must be rejected by validate(). */
+static int testRandom()
+{
+	srand(1);
+	int failures = 0;
+	std::vector<tstring> names;
+	for (int i = 0; i < 200; ++ i)
+		names.push_back(randomString(_T("abAB:.$^\\\n\x00e9"), 6));
+	for (int i = 0; i < RANDOM_PATTERNS; ++ i) {
+		tstring pattern = randomString(
+			_T("abAB:.$^\\\\()[]{}*+?|-,dw\x00e9"), 7);
+		tregex regex;
+		bool isValid = true;
+		try {
+			regex.assign(pattern, tregex::normal | tregex::icase);
+		} catch (boost::bad_expression &) {
+			isValid = false;
+		}
+
+		try {
+			WindowPattern::validate(pattern.c_str());
+		} catch (ErrorMessage &) {
+			if (isValid) {
+				printf("/%ls/: rejected\n", pattern.c_str());
+				++ failures;
+			}
+			continue;
+		}
+		if (!isValid) {
+			printf("/%ls/: accepted\n", pattern.c_str());
+			++ failures;
+			continue;
+		}
+		WindowPattern wp;
+		wp.assign(pattern.c_str());
+		for (size_t n = 0; n < names.size(); ++ n)
+			if (!check(wp, regex, names[n]))
+				++ failures;
+	}
+	return failures;
+}
+
+
+/// class name patterns of the keymaps of a setting
+static tstring randomPattern(int i_size)
+{
+	tstringstream ss;
+	int n = rand() % i_size;
+	switch (rand() % 8) {
+	case 0: ss << _T("^Class") << n << _T("$"); break;
+	case 1: ss << _T(":Class") << n << _T("$"); break;
+	case 2: ss << _T("^App") << n << _T(":"); break;
+	case 3: ss << _T("Class") << n; break;
+	case 4: ss << _T(".*"); break;
+	case 5: ss << _T("^(App|Class)") << n; break;
+	case 6: ss << _T("^App") << n << _T("\\.exe:"); break;
+	default: ss << _T("^Class") << n; break;
+	}
+	return ss.str();
+}
+
+
+/// a window name of the names of randomPattern()
+static tstring randomName(int i_size)
+{
+	tstringstream ss;
+	if (rand() % 2)
+		ss << _T("App") << rand() % i_size << (rand() % 2 ? _T(".exe") : _T(""))
+		   << _T(":");
+	ss << _T("Class") << rand() % i_size;
+	if (rand() % 10 == 0)
+		ss << _T("\nClass") << rand() % i_size;
+	if (rand() % 10 == 0)
+		ss << _T("x");
+	return ss.str();
+}
+
+
+/// the keymaps of i_keymaps for a window by testing each of them
+static void searchAll(Keymaps *i_keymaps, Keymaps::KeymapPtrList *o_found,
+					  const tstringi &i_className, const tstringi &i_titleName)
+{
+	Keymaps::KeymapPtrList keymaps;
+	i_keymaps->getKeymaps(&keymaps);
+	o_found->clear();
+	tstring lowerClassName = WindowPattern::toLowerAscii(i_className);
+	tstring lowerTitleName = WindowPattern::toLowerAscii(i_titleName);
+	for (Keymaps::KeymapPtrList::iterator
+			i = keymaps.begin(); i != keymaps.end(); ++ i)
+		if ((*i)->doesSameWindow(i_className, i_titleName,
+								 lowerClassName, lowerTitleName))
+			o_found->push_back(*i);
+}
+
+
+/// random keymaps of i_size windows
+static void addKeymaps(Keymaps *o_keymaps, int i_size)
+{
+	for (int i = 0; i < i_size; ++ i) {
+		tstringstream name;
+		name << _T("keymap") << i;
+		Keymap::Type type;
+		switch (rand() % 5) {
+		case 0: type = Keymap::Type_keymap; break;
+		case 1: type = Keymap::Type_windowOr; break;
+		default: type = Keymap::Type_windowAnd; break;
+		}
+		o_keymaps->add(Keymap(type, name.str().c_str(),
+							  randomPattern(i_size / 4).c_str(),
+							  (rand() % 2 ? _T(".*")
+							   : randomPattern(i_size / 4).c_str()),
+							  NULL, NULL));
+	}
+}
+
+
+/// random keymaps: searchWindow() must find what searchAll() finds
+static int testSearchWindow()
+{
+	srand(2);
+	int failures = 0;
+	for (int round = 0; round < ROUNDS; ++ round) {
+		Keymaps keymaps;
+		int size = rand() % 200 + 1;
+		addKeymaps(&keymaps, size);
+		for (int i = 0; i < QUERIES; ++ i) {
+			tstringi className(randomName(size / 4 + 1).c_str());
+			tstringi titleName(randomName(size / 4 + 1).c_str());
+			Keymaps::KeymapPtrList found, expected;
+			keymaps.searchWindow(&found, className, titleName);
+			searchAll(&keymaps, &expected, className, titleName);
+			if (found != expected && failures ++ < 10)
+				printf("round %d: \"%ls\" \"%ls\": %lu keymaps, expected %lu\n",
+					   round, className.c_str(), titleName.c_str(),
+					   static_cast<unsigned long>(found.size()),
+					   static_cast<unsigned long>(expected.size()));
+		}
+	}
+	return failures;
+}
+
+
+/** searches of KEYMAPS window keymaps like /:ClassN$/ for more windows
+    than the cache of searchWindow() holds */
+static void benchmark()
+{
+	srand(3);
+	Keymaps keymaps;
+	for (int i = 0; i < KEYMAPS; ++ i) {
+		tstringstream name, className;
+		name << _T("keymap") << i;
+		className << (i % 2 ? _T(":") : _T("^")) << _T("Class") << i << _T("$");
+		keymaps.add(Keymap(Keymap::Type_windowAnd, name.str().c_str(),
+						   className.str().c_str(), _T(".*"), NULL, NULL));
+	}
+	std::vector<tstringi> classNames;
+	for (int i = 0; i < 1000; ++ i) {
+		tstringstream className;
+		className << _T("App") << i << _T(":Class") << rand() % (KEYMAPS * 2);
+		classNames.push_back(className.str().c_str());
+	}
+
+	size_t found = 0;
+	clock_t start = clock();
+	for (int i = 0; i < LOOKUPS; ++ i) {
+		Keymaps::KeymapPtrList kl;
+		searchAll(&keymaps, &kl, classNames[i % classNames.size()], _T(""));
+		found += kl.size();
+	}
+	double allTime = double(clock() - start) / CLOCKS_PER_SEC;
+	start = clock();
+	for (int i = 0; i < LOOKUPS; ++ i) {
+		Keymaps::KeymapPtrList kl;
+		keymaps.searchWindow(&kl, classNames[i % classNames.size()], _T(""));
+		found += kl.size();
+	}
+	double indexTime = double(clock() - start) / CLOCKS_PER_SEC;
+	printf("searchWindow of %d keymaps: all %5.2f us, indexed %5.2f us "
+		   "(%lu found, %ld of %d cached)\n",
+		   KEYMAPS, allTime * 1e6 / LOOKUPS, indexTime * 1e6 / LOOKUPS,
+		   static_cast<unsigned long>(found),
+		   static_cast<long>(keymaps.getWindowCacheHitCount()), LOOKUPS);
+}
+
+
+int main()
+{
+	int failures = testPatterns();
+	failures += testRandom();
+	failures += testSearchWindow();
+	if (failures) {
+		printf("FAILED: %d\n", failures);
+		return 1;
+	}
+	benchmark();
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,191 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// textfile.cpp
+
+
+#include "misc.h"
+#include "textfile.h"
+#include <climits>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#  include <emmintrin.h>
+#  define TEXTFILE_SSE2
+#endif
+
+
+#ifdef _UNICODE
+
+// widen the ASCII characters at the beginning of i_data (returns the number
+// of them)
+static size_t widenAscii(wchar_t *o_text, const BYTE *i_data, size_t i_size)
+{
+	size_t n = 0;
+#ifdef TEXTFILE_SSE2
+	// 16 bytes at a time while none of them has the high bit
+	const __m128i zero = _mm_setzero_si128();
+	for (; n + 16 <= i_size; n += 16) {
+		__m128i b =
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(i_data + n));
+		if (_mm_movemask_epi8(b))
+			break;
+		__m128i lo = _mm_unpacklo_epi8(b, zero);
+		__m128i hi = _mm_unpackhi_epi8(b, zero);
+		__m128i *d = reinterpret_cast<__m128i *>(o_text + n);
+		if (sizeof(wchar_t) == 2) {
+			_mm_storeu_si128(d, lo);
+			_mm_storeu_si128(d + 1, hi);
+		} else {
+			_mm_storeu_si128(d, _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128(d + 1, _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128(d + 2, _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128(d + 3, _mm_unpackhi_epi16(hi, zero));
+		}
+	}
+#endif // TEXTFILE_SSE2
+	for (; n < i_size && !(i_data[n] & 0x80); ++ n)
+		o_text[n] = static_cast<wchar_t>(i_data[n]);
+	return n;
+}
+
+
+// decode UTF-8 (returns the length of the text, or size_t(-1) if i_data is
+// not UTF-8).  the text is never longer than i_size.
+static size_t decodeUtf8(wchar_t *o_text, const BYTE *i_data, size_t i_size)
+{
+	wchar_t *d = o_text;
+	const BYTE *s = i_data;
+	const BYTE *end = i_data + i_size;
+	while (true) {
+		size_t n = widenAscii(d, s, end - s);
+		d += n;
+		s += n;
+		if (s == end)
+			break;
+
+		u_int32 c = *s;
+		size_t length;
+		u_int32 min;
+		if ((c & 0xe0) == 0xc0)			// 110xxxxx 10xxxxxx
+			length = 2, min = 0x80, c &= 0x1f;
+		else if ((c & 0xf0) == 0xe0)		// 1110xxxx 10xxxxxx * 2
+			length = 3, min = 0x800, c &= 0x0f;
+		else if ((c & 0xf8) == 0xf0)		// 11110xxx 10xxxxxx * 3
+			length = 4, min = 0x10000, c &= 0x07;
+		else
+			return size_t(-1);
+		if (static_cast<size_t>(end - s) < length)
+			return size_t(-1);
+		for (size_t i = 1; i < length; ++ i) {
+			if ((s[i] & 0xc0) != 0x80)
+				return size_t(-1);
+			c = (c << 6) | (s[i] & 0x3f);
+		}
+		// overlong forms, surrogates and beyond U+10FFFF are not UTF-8
+		if (c < min || (0xd800 <= c && c <= 0xdfff) || 0x10ffff < c)
+			return size_t(-1);
+		s += length;
+
+		if (0x10000 <= c && sizeof(wchar_t) == 2) {
+			c -= 0x10000;
+			*d ++ = static_cast<wchar_t>(0xd800 | (c >> 10));
+			*d ++ = static_cast<wchar_t>(0xdc00 | (c & 0x3ff));
+		} else
+			*d ++ = static_cast<wchar_t>(c);
+	}
+	return d - o_text;
+}
+
+
+// decode UTF-16 (returns the length of the text)
+static size_t decodeUtf16(wchar_t *o_text, const BYTE *i_data, size_t i_size,
+						  bool i_isBigEndian)
+{
+	size_t size = i_size / 2;
+	const int high = i_isBigEndian ? 0 : 1;
+	for (size_t i = 0; i < size; ++ i, i_data += 2)
+		o_text[i] = static_cast<wchar_t>((i_data[high] << 8) |
+										 i_data[1 - high]);
+	return size;
+}
+
+#endif // _UNICODE
+
+
+// decode the contents of a text file
+void decodeText(tstring *o_text, const BYTE *i_data, size_t i_size)
+{
+#ifdef _UNICODE
+	// every encoding below takes at least one byte per wchar_t, so the text
+	// is decoded into o_text with a single allocation and then shrunk
+	o_text->resize(i_size);
+	if (i_size == 0)
+		return;
+	wchar_t *text = &(*o_text)[0];
+	size_t length;
+
+	if (2 <= i_size && i_size % 2 == 0 &&
+			((i_data[0] == 0xffU && i_data[1] == 0xfeU) ||
+			 (i_data[0] == 0xfeU && i_data[1] == 0xffU)))
+		// UTF-16 Little/Big Endien
+		length = decodeUtf16(text, i_data + 2, i_size - 2, i_data[0] == 0xfeU);
+	else {
+		// UTF-8 comes before the locale specific multibyte encoding,
+		// because a UTF-8 file may happen to be valid in the latter too
+		if (3 <= i_size &&
+				i_data[0] == 0xefU && i_data[1] == 0xbbU && i_data[2] == 0xbfU)
+			length = decodeUtf8(text, i_data + 3, i_size - 3);
+		else
+			length = decodeUtf8(text, i_data, i_size);
+
+		// try multibyte charset
+		if (length == size_t(-1) && i_size <= INT_MAX) {
+			int r = MultiByteToWideChar(CP_ACP, MB_ERR_INVALID_CHARS,
+										reinterpret_cast<const char *>(i_data),
+										static_cast<int>(i_size),
+										text, static_cast<int>(i_size));
+			if (0 < r)
+				length = static_cast<size_t>(r);
+		}
+
+		// assume ascii
+		if (length == size_t(-1)) {
+			for (size_t i = 0; i < i_size; ++ i)
+				text[i] = static_cast<wchar_t>(i_data[i]);
+			length = i_size;
+		}
+	}
+	o_text->resize(length);
+#else // _MBCS
+	o_text->assign(reinterpret_cast<const char *>(i_data), i_size);
+#endif // _MBCS
+}
+
+
+// read a text file
+bool readFile(tstring *o_text, const tstringi &i_filename)
+{
+	HANDLE file = CreateFile(i_filename.c_str(), GENERIC_READ,
+							 FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+							 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool isOk = false;
+	DWORD sizeHigh = 0;
+	DWORD size = GetFileSize(file, &sizeHigh);
+	if (size != INVALID_FILE_SIZE && sizeHigh == 0 && 0 < size) {
+		HANDLE mapping =
+			CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			const BYTE *data = reinterpret_cast<const BYTE *>(
+				MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (data) {
+				decodeText(o_text, data, size);
+				isOk = true;
+				CHECK_TRUE( UnmapViewOfFile(data) );
+			}
+			CHECK_TRUE( CloseHandle(mapping) );
+		}
+	}
+	CHECK_TRUE( CloseHandle(file) );
+	return isOk;
+}
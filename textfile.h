@@ -0,0 +1,23 @@
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// textfile.h
+
+
+#ifndef _TEXTFILE_H
+#  define _TEXTFILE_H
+
+#  include "misc.h"
+#  include "stringtool.h"
+
+
+/** decode the contents of a text file.
+    _UNICODE: UTF-16 LE/BE with a BOM, UTF-8 (with or without a BOM),
+    locale specific multibyte encoding, or else one character per byte.
+    _MBCS: the bytes as they are */
+extern void decodeText(tstring *o_text, const BYTE *i_data, size_t i_size);
+
+/** read a text file.  the file is mapped into memory and decoded by
+    decodeText().  an empty file cannot be read. */
+extern bool readFile(tstring *o_text, const tstringi &i_filename);
+
+
+#endif // !_TEXTFILE_H
@@ -97,18 +97,25 @@ for (var n = 0; n < lines.length; n++) {
 	outputFile.WriteLine("public:");
 	outputFile.WriteLine("  static FunctionData *create()");
 	outputFile.WriteLine("  {");
-	outputFile.WriteLine("    FunctionData_" + name + " *fd");
-	outputFile.WriteLine("      = new FunctionData_" + name + ";");
-	for (var i = 0; i < argc; i++) {
-	    if (argDefaultValues[i]) {
-		outputFile.WriteLine("    fd->m_"
-				     + argNames[i]
-				     + " = "
-				     + argDefaultValues[i]
-				     + ";");
+	if (argc == 0) {
+	    // a function without arguments has no state, so all of its uses
+	    // share one instance
+	    outputFile.WriteLine("    static FunctionData_" + name + " s_shared;");
+	    outputFile.WriteLine("    return &s_shared;");
+	} else {
+	    outputFile.WriteLine("    FunctionData_" + name + " *fd");
+	    outputFile.WriteLine("      = new FunctionData_" + name + ";");
+	    for (var i = 0; i < argc; i++) {
+		if (argDefaultValues[i]) {
+		    outputFile.WriteLine("    fd->m_"
+					 + argNames[i]
+					 + " = "
+					 + argDefaultValues[i]
+					 + ";");
+		}
 	    }
+	    outputFile.WriteLine("    return fd;");
 	}
-	outputFile.WriteLine("    return fd;");
 	outputFile.WriteLine("  }");
 	outputFile.WriteLine("  ");
 	outputFile.WriteLine("  virtual void load(SettingLoader *i_sl)");
@@ -169,7 +176,16 @@ for (var n = 0; n < lines.length; n++) {
 	outputFile.WriteLine("");
 	outputFile.WriteLine("  virtual FunctionData *clone() const");
 	outputFile.WriteLine("  {");
-	outputFile.WriteLine("    return new FunctionData_" + name + "(*this);");
+	if (argc == 0) {
+	    outputFile.WriteLine("    return const_cast<FunctionData_" + name + " *>(this);");
+	} else {
+	    outputFile.WriteLine("    return new FunctionData_" + name + "(*this);");
+	}
+	outputFile.WriteLine("  }");
+	outputFile.WriteLine("");
+	outputFile.WriteLine("  virtual bool isShared() const");
+	outputFile.WriteLine("  {");
+	outputFile.WriteLine("    return " + (argc == 0 ? "true" : "false") + ";");
 	outputFile.WriteLine("  }");
 	outputFile.WriteLine("};");
 	outputFile.WriteLine("");
@@ -188,10 +204,19 @@ for (var n = 0; n < names.length; n++) {
 outputFile.WriteLine("#endif // FUNCTION_FRIEND");
 outputFile.WriteLine("");
 outputFile.WriteLine("#ifdef FUNCTION_CREATOR");
+outputFile.WriteLine("// sorted by name for createFunctionData");
 outputFile.WriteLine("FunctionCreator functionCreators[] = {");
 
+var sortedNames = new Array();
 for (var n = 0; n < names.length; n++) {
-    var name = names[n];
+    if (names[n]) {
+	sortedNames.push(names[n]);
+    }
+}
+sortedNames.sort();
+
+for (var n = 0; n < sortedNames.length; n++) {
+    var name = sortedNames[n];
     outputFile.WriteLine("  { _T(\"" + name + "\"), FunctionData_" + name + "::create },");
 }
 